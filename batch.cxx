@@ -0,0 +1,221 @@
+#include "board.hpp"
+#include "search.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A bounded queue of input lines tagged with their position in the
+ * input, so the reader cannot run arbitrarily far ahead of the searchers.
+ */
+class line_queue
+{
+public:
+	explicit line_queue(std::size_t capacity) : capacity(capacity), closed(false) {}
+
+	void push(uint64_t index, std::string line)
+	{
+		std::unique_lock lock(mutex);
+		not_full.wait(lock, [this] { return lines.size() < capacity; });
+		lines.emplace_back(index, std::move(line));
+		not_empty.notify_one();
+	}
+
+	/**
+	 * @brief Take the next line.
+	 * @return false once the queue is closed and empty
+	 */
+	bool pop(uint64_t &index, std::string &line)
+	{
+		std::unique_lock lock(mutex);
+		not_empty.wait(lock, [this] { return !lines.empty() or closed; });
+		if (lines.empty())
+			return false;
+		index = lines.front().first;
+		line = std::move(lines.front().second);
+		lines.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+
+private:
+	std::size_t capacity;
+	bool closed;
+	std::deque<std::pair<uint64_t, std::string>> lines;
+	std::mutex mutex;
+	std::condition_variable not_empty, not_full;
+};
+
+/**
+ * @brief Writes results in input order. Results that finish early wait here
+ * until everything before them has been written.
+ */
+class ordered_writer
+{
+public:
+	explicit ordered_writer(std::ostream &os) : os(os), next(0) {}
+
+	void write(uint64_t index, std::string result)
+	{
+		std::lock_guard lock(mutex);
+		pending.emplace(index, std::move(result));
+		for (auto it = pending.begin();
+			 it != pending.end() and it->first == next;
+			 it = pending.erase(it), ++next)
+			os << it->second << '\n';
+		os.flush();
+	}
+
+private:
+	std::ostream &os;
+	uint64_t next;
+	std::map<uint64_t, std::string> pending;
+	std::mutex mutex;
+};
+
+std::string analyse(chess::searcher &search, const std::string &fen,
+					const chess::search_limits &limits)
+{
+	chess::board b;
+	try
+	{
+		b = chess::board(fen);
+	}
+	catch (std::invalid_argument &e)
+	{
+		return fen + "\terror\t" + e.what();
+	}
+
+	const chess::search_info info = search.run(b, limits);
+	std::string best = "0000";
+	if (!info.pv.empty())
+	{
+		const auto [from, to] = info.pv.front();
+		char str[chess::board::MOVE_CHARS];
+		best.assign(str, chess::board::format_move({from, to},
+			b.is_promotion(from, to) ? chess::board::QUEEN_PROMOTION : 0, str));
+	}
+	return fen + '\t' + best + '\t' + std::to_string(info.score) + '\t' +
+		   std::to_string(info.depth) + '\t' + std::to_string(info.nodes);
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-t threads] [-d depth] [-n nodes] "
+			  "[-m movetime] [-H hash MB] [file]\n"
+			  "Reads one FEN per line from the file, or stdin if there is "
+			  "none, and writes\n"
+			  "\"fen<TAB>bestmove<TAB>score<TAB>depth<TAB>nodes\" for each "
+			  "position in input order." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t hash = 64;
+	chess::search_limits limits;
+	std::string path;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg[0] != '-')
+		{
+			path = arg;
+			continue;
+		}
+		if (i + 1 >= argc or arg.size() != 2)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		const char *value = argv[++i];
+		try
+		{
+			switch (arg[1])
+			{
+			case 't': threads = std::max(1, atoi(value)); break;
+			case 'd': limits.depth = atoi(value); break;
+			case 'n': limits.nodes = std::stoull(value); break;
+			case 'm': limits.movetime = atoi(value); break;
+			case 'H': hash = std::stoul(value); break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		catch (std::logic_error &e)
+		{
+			// from std::stoull and friends, for a value that is not a number
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (!limits.depth and !limits.nodes and !limits.movetime)
+		limits.depth = 6;
+
+	std::ifstream file;
+	if (!path.empty())
+	{
+		file.open(path);
+		if (!file.is_open())
+		{
+			std::cerr << "file not found: " << path << std::endl;
+			return 1;
+		}
+	}
+	std::istream &in = path.empty() ? std::cin : file;
+
+	// one search per core, all sharing one transposition table
+	chess::transposition_table tt(hash);
+	line_queue queue(threads * 4);
+	ordered_writer writer(std::cout);
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; ++i)
+		pool.emplace_back([&] {
+			chess::searcher search(tt);
+			uint64_t index;
+			std::string fen;
+			while (queue.pop(index, fen))
+				writer.write(index, analyse(search, fen, limits));
+		});
+
+	uint64_t count = 0;
+	std::string line;
+	while (std::getline(in, line))
+		if (!line.empty())
+			queue.push(count++, std::move(line));
+	queue.close();
+
+	for (auto &t : pool)
+		t.join();
+
+	const double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	std::cerr << count << " positions in " << seconds << " s ("
+			  << (seconds > 0 ? count / seconds : 0) << " positions/s, "
+			  << threads << " threads)" << std::endl;
+	return 0;
+}
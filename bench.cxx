@@ -0,0 +1,468 @@
+#include "board.hpp"
+#include "networking/master.hpp"
+#include "networking/slave.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+const std::string MIDDLEGAME =
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4";
+// every kind of piece, pins, castling and en passant
+const std::string KIWIPETE =
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+/**
+ * @brief Keep the compiler from optimising away a value nobody reads.
+ */
+template <typename T>
+inline void keep(const T &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct options
+{
+	double min_time = 0.2;	// seconds per run
+	int runs = 5;
+	std::string filter;
+};
+
+/**
+ * @brief A benchmark runs its operation n times.
+ */
+struct benchmark
+{
+	std::string name;
+	std::function<void(uint64_t n)> run;
+};
+
+struct result
+{
+	std::string name;
+	double median;	// ns per operation
+	double fastest;
+	uint64_t iterations;	// per run
+};
+
+double seconds(uint64_t n, const benchmark &b)
+{
+	const auto start = clock_type::now();
+	b.run(n);
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/**
+ * @brief Find how many iterations take min_time, then time that many
+ * options.runs times.
+ */
+result measure(const benchmark &b, const options &o)
+{
+	b.run(1);	// anything set up on first use is not timed
+	uint64_t n = 1;
+	double t = seconds(n, b);
+	while (t < o.min_time / 20 and n < (uint64_t(1) << 40))
+	{
+		n *= 2;
+		t = seconds(n, b);
+	}
+	n = std::max<uint64_t>(1, static_cast<uint64_t>(n * o.min_time / t));
+
+	std::vector<double> per_op;
+	for (int i = 0; i < o.runs; ++i)
+		per_op.push_back(seconds(n, b) * 1e9 / n);
+	std::sort(per_op.begin(), per_op.end());
+	return {b.name, per_op[per_op.size() / 2], per_op.front(), n};
+}
+
+/**
+ * @brief The moves of a game picked at random with a fixed seed, so every
+ * run plays the same one.
+ */
+std::vector<chess::board::move_t> random_game(int plies)
+{
+	std::mt19937 random(1);
+	chess::board b;
+	std::vector<chess::board::move_t> moves;
+	for (int i = 0; i < plies; ++i)
+	{
+		const auto legal = b.legal_moves();
+		if (legal.empty())
+			break;
+		const auto m = legal[std::uniform_int_distribution<int>(
+			0, legal.size - 1)(random)];
+		b.move(m.first, m.second);
+		if (b.promotion_pending())
+			b.move(m.second, chess::board::QUEEN_PROMOTION);
+		moves.push_back(m);
+	}
+	return moves;
+}
+
+/**
+ * @brief Every square a piece of the given kind of the side to move could be
+ * asked to go to, legal or not.
+ */
+std::vector<chess::board::move_t> probes(const chess::board &b,
+										 chess::board::piece p)
+{
+	std::vector<chess::board::move_t> moves;
+	for (int from = 0; from < 64; ++from)
+		if (b.at(from, b.turn()) == p)
+			for (int to = 0; to < 64; ++to)
+				if (to != from)
+					moves.emplace_back(from, to);
+	return moves;
+}
+
+/**
+ * @brief A free port on the loopback interface, for the round trip.
+ */
+uint16_t free_port()
+{
+	asio::io_context io;
+	asio::ip::tcp::acceptor a(io, asio::ip::tcp::endpoint(
+		asio::ip::address_v4::loopback(), 0));
+	return a.local_endpoint().port();
+}
+
+/**
+ * @brief A master and a slave over loopback. The master's thread sends every
+ * move it gets back, so each iteration is a full round trip through both
+ * handlers, their listeners and the kernel.
+ */
+class loopback
+{
+public:
+	loopback()
+	{
+		// the master and the handler say when they connect and disconnect,
+		// which would end up among the results
+		const auto quiet = std::cout.rdbuf(nullptr);
+		const std::string code = networking::codes::encode(
+			networking::codes::ip_to_int("127.0.0.1"), free_port(), 1);
+		std::thread accept([&] {
+			m = std::make_unique<networking::master>(code, chess::board()());
+		});
+		// the master must be listening before the slave connects
+		for (int i = 0; i < 100 and !s; ++i)
+			try
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				s = std::make_unique<networking::slave>(
+					code, chess::board()(), networking::frames::LEGACY_VERSION,
+					false);
+			}
+			catch (std::runtime_error &e)
+			{
+			}
+		accept.join();
+		std::cout.rdbuf(quiet);
+		if (!s)
+			throw std::runtime_error("Could not connect over loopback");
+		m->set_no_delay(true);
+		s->set_no_delay(true);
+		threads.emplace_back([this] { m->listener(); });
+		threads.emplace_back([this] { s->listener(); });
+		threads.emplace_back([this] {
+			networking::header h;
+			std::string body;
+			while (m->wait(h, body) and h == networking::header::move)
+			{
+				m->queue(h, body);
+				m->flush();
+			}
+			// the slave's listener only returns once told to
+			m->queue(networking::header::disconnect, "    ");
+			m->flush();
+		});
+	}
+
+	~loopback()
+	{
+		const auto quiet = std::cout.rdbuf(nullptr);
+		s->queue(networking::header::disconnect, "    ");
+		s->flush();
+		for (auto &t : threads)
+			t.join();
+		m.reset();
+		s.reset();
+		std::cout.rdbuf(quiet);
+	}
+
+	void round_trips(uint64_t n)
+	{
+		networking::header h;
+		std::string body;
+		for (uint64_t i = 0; i < n; ++i)
+		{
+			s->queue(networking::header::move, "e2e4");
+			s->flush();
+			if (!s->wait(h, body))
+				throw std::runtime_error("The loopback connection closed");
+		}
+	}
+
+private:
+	std::unique_ptr<networking::master> m;
+	std::unique_ptr<networking::slave> s;
+	std::vector<std::thread> threads;
+};
+
+std::vector<benchmark> benchmarks(std::unique_ptr<loopback> &net)
+{
+	using chess::board;
+	std::vector<benchmark> list;
+
+	const auto game = random_game(40);
+	list.push_back({"board::move", [game](uint64_t n) {
+		// replay the game from the start each time it runs out, so the cost
+		// of the copy is spread over its moves
+		const board start;
+		board b;
+		std::size_t next = game.size();
+		for (uint64_t i = 0; i < n; ++i)
+		{
+			if (next == game.size())
+			{
+				b = start;
+				next = 0;
+			}
+			const auto [from, to] = game[next++];
+			keep(b.move(from, to));
+			if (b.promotion_pending())
+				b.move(to, board::QUEEN_PROMOTION);
+		}
+	}});
+
+	const std::vector<board> positions = {board(), board(MIDDLEGAME),
+										  board(KIWIPETE)};
+	list.push_back({"board::is_check", [positions](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+		{
+			const board &b = positions[i % positions.size()];
+			keep(b.is_check(b.turn()));
+		}
+	}});
+
+	const board kiwipete(KIWIPETE);
+	const std::pair<board::piece, const char *> pieces[] = {
+		{board::piece::pawn, "pawn"}, {board::piece::knight, "knight"},
+		{board::piece::bishop, "bishop"}, {board::piece::rook, "rook"},
+		{board::piece::queen, "queen"}, {board::piece::king, "king"}};
+	for (const auto &[p, name] : pieces)
+		list.push_back({std::string("board::is_legal, ") + name,
+			[kiwipete, moves = probes(kiwipete, p)](uint64_t n) {
+				for (uint64_t i = 0; i < n; ++i)
+				{
+					const auto [from, to] = moves[i % moves.size()];
+					keep(kiwipete.is_legal(from, to));
+				}
+			}});
+
+	list.push_back({"board::operator()()", [positions](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(positions[i % positions.size()]());
+	}});
+
+	std::vector<std::string> squares;
+	for (int pos = 0; pos < 64; ++pos)
+		squares.push_back(board::get_str(pos));
+	list.push_back({"board::get_pos", [squares](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(board::get_pos(squares[i % 64]));
+	}});
+	list.push_back({"board::get_str", [](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(board::get_str(static_cast<int>(i % 64)));
+	}});
+
+	const uint32_t ip = networking::codes::ip_to_int("192.168.1.20");
+	list.push_back({"codes::encode", [ip](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(networking::codes::encode(ip, 5000,
+										   static_cast<uint16_t>(i)));
+	}});
+	const std::string code = networking::codes::encode(ip, 5000, 1234);
+	list.push_back({"codes::code_to_int", [code](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(networking::codes::code_to_int(code));
+	}});
+
+	using networking::handler;
+	using networking::header;
+	const std::string move = "e2e4";
+	list.push_back({"handler::to_buffer, string", [move](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(handler::to_buffer(header::move, move));
+	}});
+	list.push_back({"handler::to_buffer, code", [](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(handler::to_buffer(header::connection_request,
+									static_cast<uint16_t>(i)));
+	}});
+	list.push_back({"handler::to_buffer, integer", [](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i)
+			keep(handler::to_buffer(header::board_hash,
+									static_cast<uint32_t>(i)));
+	}});
+
+	list.push_back({"loopback round trip", [&net](uint64_t n) {
+		if (!net)
+			net = std::make_unique<loopback>();
+		net->round_trips(n);
+	}});
+	return list;
+}
+
+/**
+ * @brief Results in the form they are printed, one per line:
+ * "name<TAB>median ns<TAB>fastest ns<TAB>iterations". Lines starting with #
+ * are comments.
+ */
+std::map<std::string, double> read_baseline(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("file not found: " + path);
+	std::map<std::string, double> baseline;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const auto tab = line.find('\t');
+		if (tab == std::string::npos or line[0] == '#')
+			continue;
+		baseline[line.substr(0, tab)] = std::stod(line.substr(tab + 1));
+	}
+	return baseline;
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-t seconds per run] [-r runs] "
+			  "[-f filter] [-o baseline file]\n"
+			  "       [-c baseline file] [-x percent]\n"
+			  "Times the hot paths of the board and the networking code and "
+			  "writes\n"
+			  "\"name<TAB>median ns<TAB>fastest ns<TAB>iterations\" for each, "
+			  "only those with\n"
+			  "the filter in their name if given. -o also writes the results "
+			  "to a file, to\n"
+			  "compare later runs with -c, which adds the median of the "
+			  "baseline and the\n"
+			  "change in percent, and exits with 1 if anything got slower by "
+			  "more than -x\n"
+			  "percent, 10 by default." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	options o;
+	std::string save, compare;
+	double threshold = 10;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (i + 1 >= argc or arg.size() != 2 or arg[0] != '-')
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		const char *value = argv[++i];
+		try
+		{
+			switch (arg[1])
+			{
+			case 't': o.min_time = std::stod(value); break;
+			case 'r': o.runs = std::max(1, atoi(value)); break;
+			case 'f': o.filter = value; break;
+			case 'o': save = value; break;
+			case 'c': compare = value; break;
+			case 'x': threshold = std::stod(value); break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		catch (std::logic_error &e)
+		{
+			// from std::stoull and friends, for a value that is not a number
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	try
+	{
+		std::map<std::string, double> baseline;
+		if (!compare.empty())
+			baseline = read_baseline(compare);
+		std::ofstream out;
+		if (!save.empty())
+		{
+			out.open(save);
+			if (!out.is_open())
+				throw std::runtime_error("Could not open " + save);
+			out << "# " << o.runs << " runs of " << o.min_time << " s on "
+				<< std::thread::hardware_concurrency() << " cores\n";
+		}
+
+		std::unique_ptr<loopback> net;
+		bool slower = false;
+		std::cout << std::fixed << std::setprecision(2);
+		out << std::fixed << std::setprecision(2);
+		for (const auto &b : benchmarks(net))
+		{
+			if (b.name.find(o.filter) == std::string::npos)
+				continue;
+			const result r = measure(b, o);
+			std::ostringstream line;
+			line << std::fixed << std::setprecision(2) << r.name << '\t'
+				 << r.median << '\t' << r.fastest << '\t' << r.iterations;
+			if (out.is_open())
+				out << line.str() << '\n';
+
+			const auto found = baseline.find(r.name);
+			if (found != baseline.end() and found->second > 0)
+			{
+				const double change = (r.median / found->second - 1) * 100;
+				line << '\t' << found->second << '\t' << std::showpos
+					 << change << '%' << std::noshowpos;
+				if (change > threshold)
+				{
+					line << "\tslower";
+					slower = true;
+				}
+			}
+			std::cout << line.str() << std::endl;
+		}
+		net.reset();
+		if (slower)
+			return 1;
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
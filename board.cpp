@@ -1,9 +1,54 @@
 #include "board.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <sstream>
 
 namespace chess {
+
+namespace {
+/**
+ * @brief Random keys for Zobrist hashing, generated at compile time with
+ * splitmix64 so every build and every machine agree on the keys.
+ */
+struct zobrist_keys
+{
+	uint64_t pieces[2][7][64];
+	uint64_t castle[4];
+	uint64_t en_passant[64];
+	uint64_t black_to_move;
+};
+
+constexpr uint64_t splitmix64(uint64_t &state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+constexpr zobrist_keys make_zobrist_keys()
+{
+	zobrist_keys keys {};
+	uint64_t state = 861317959;
+	for (auto &color : keys.pieces)
+		for (int p = 1; p < 7; ++p) // empty squares do not change the key
+			for (auto &sq : color[p])
+				sq = splitmix64(state);
+	for (auto &c : keys.castle)
+		c = splitmix64(state);
+	for (auto &sq : keys.en_passant)
+		sq = splitmix64(state);
+	keys.black_to_move = splitmix64(state);
+	return keys;
+}
+
+constexpr zobrist_keys ZOBRIST = make_zobrist_keys();
+}
 board::board()
 : pieces(), cur_player(WHITE), white_long(true), white_short(true),
-black_long(true), black_short(true), en_passant_square(-1)
+black_long(true), black_short(true), en_passant_square(-1), halfmoves(0),
+fullmoves(1), ply(0), history()
 {
 	pieces[WHITE][A1] = piece::rook;
 	pieces[WHITE][B1] = piece::knight;
@@ -29,6 +74,132 @@ black_long(true), black_short(true), en_passant_square(-1)
 	for (int i = A7; i <= H7; i += 8)
 		pieces[BLACK][i] = piece::pawn;
 
+	history[0] = compute_key();
+}
+
+board::board(const std::string &fen)
+: pieces(), cur_player(WHITE), white_short(false), white_long(false),
+black_short(false), black_long(false), en_passant_square(-1), halfmoves(0),
+fullmoves(1), ply(0), history()
+{
+	std::istringstream ss(fen);
+	std::string placement, side, castling, en_passant;
+	if (!(ss >> placement >> side >> castling >> en_passant))
+		throw std::invalid_argument("Invalid FEN. Expected the placement, "
+									"side to move, castling rights and en "
+									"passant square");
+
+	int row = 7, col = 0;
+	for (char c : placement)
+	{
+		if (c == '/')
+		{
+			if (col != 8 or --row < 0)
+				throw std::invalid_argument("Invalid FEN placement: " + placement);
+			col = 0;
+			continue;
+		}
+		if (c >= '1' and c <= '8')
+		{
+			col += c - '0';
+			if (col > 8)
+				throw std::invalid_argument("Invalid FEN placement: " + placement);
+			continue;
+		}
+
+		piece p;
+		switch (tolower(c))
+		{
+		case 'k': p = piece::king; break;
+		case 'q': p = piece::queen; break;
+		case 'r': p = piece::rook; break;
+		case 'b': p = piece::bishop; break;
+		case 'n': p = piece::knight; break;
+		case 'p': p = piece::pawn; break;
+		default:
+			throw std::invalid_argument(std::string("Invalid FEN piece: ") + c);
+		}
+		if (col > 7)
+			throw std::invalid_argument("Invalid FEN placement: " + placement);
+		pieces[islower(c) ? BLACK : WHITE][col * 8 + row] = p;
+		++col;
+	}
+	if (row != 0 or col != 8)
+		throw std::invalid_argument("Invalid FEN placement: " + placement);
+
+	if (side == "w")
+		cur_player = WHITE;
+	else if (side == "b")
+		cur_player = BLACK;
+	else
+		throw std::invalid_argument("Invalid FEN side to move: " + side);
+
+	for (char c : castling)
+	{
+		switch (c)
+		{
+		case 'K': white_short = true; break;
+		case 'Q': white_long = true; break;
+		case 'k': black_short = true; break;
+		case 'q': black_long = true; break;
+		case '-': break;
+		default:
+			throw std::invalid_argument("Invalid FEN castling rights: " + castling);
+		}
+	}
+
+	if (en_passant != "-")
+	{
+		en_passant_square = get_pos(en_passant);
+		if (en_passant_square < 0)
+			throw std::invalid_argument("Invalid FEN en passant square: " + en_passant);
+	}
+
+	// the move counters are optional
+	if (ss >> halfmoves and ss >> fullmoves and (halfmoves < 0 or fullmoves < 1))
+		throw std::invalid_argument("Invalid FEN move counters");
+	halfmoves = std::max(halfmoves, 0);
+	fullmoves = std::max(fullmoves, 1);
+
+	history[0] = compute_key();
+}
+
+std::string board::fen() const
+{
+	std::string result;
+	for (int row = 7; row >= 0; --row)
+	{
+		int empty = 0;
+		for (int col = 0; col < 8; ++col)
+		{
+			char c = (*this)[col * 8 + row];
+			if (c == EMPTY_SQUARE)
+			{
+				++empty;
+				continue;
+			}
+			if (empty)
+				result += static_cast<char>('0' + empty);
+			empty = 0;
+			result += c;
+		}
+		if (empty)
+			result += static_cast<char>('0' + empty);
+		if (row)
+			result += '/';
+	}
+
+	result += cur_player == WHITE ? " w " : " b ";
+	if (white_short) result += 'K';
+	if (white_long) result += 'Q';
+	if (black_short) result += 'k';
+	if (black_long) result += 'q';
+	if (!(white_short or white_long or black_short or black_long))
+		result += '-';
+	result += ' ';
+	result += en_passant_square < 0 ? "-" : get_str(en_passant_square);
+	result += ' ' + std::to_string(halfmoves) + ' ' + std::to_string(fullmoves);
+	return result;
 }
 
 std::ostream &operator<<(std::ostream &os, const board &b)
@@ -192,8 +363,7 @@ bool board::king_legal_move(int pos, int to) const
 {
 	const int diff_col = to / 8 - pos / 8;
 	const int diff_row = to % 8 - pos % 8;
-	return is_valid(pos, to) and (abs(diff_col) <= 1 and abs(diff_row) <= 1)
-	and (abs(diff_col));
+	return is_valid(pos, to) and (abs(diff_col) <= 1 and abs(diff_row) <= 1);
 }
 
 int board::pawn_legal_move(int pos, int to) const
@@ -235,6 +405,8 @@ int board::pawn_legal_move(int pos, int to) const
 	en_passent = capture and to == en_passant_square;
 	capture = capture and is(to,!cur_player);
 
+	if ((capture or move) and to % 8 == (cur_player == WHITE ? 7 : 0))
+		return PROMOTION;
 	if (capture)
 		return CAPTURE;
 	if (en_passent)
@@ -284,32 +456,30 @@ bool board::is_legal(int from, int to) const
 
 bool board::move(int from, int to)
 {
+	CHESS_COUNT(moves);
+	const auto reject = [] {
+		CHESS_COUNT(moves_rejected);
+		return false;
+	};
+
 	// check if it is a promotion move
 	switch (to)
 	{
 	case QUEEN_PROMOTION:
-		pieces[cur_player][from] = piece::queen;
-		return true;
+		return promote(from, piece::queen) or reject();
 	case ROOK_PROMOTION:
-		pieces[cur_player][from] = piece::rook;
-		return true;
+		return promote(from, piece::rook) or reject();
 	case BISHOP_PROMOTION:
-		pieces[cur_player][from] = piece::bishop;
-		return true;
+		return promote(from, piece::bishop) or reject();
 	case KNIGHT_PROMOTION:
-		pieces[cur_player][from] = piece::knight;
-		return true;
+		return promote(from, piece::knight) or reject();
 	default:
 		break;
 	}
 
-	// check if there are any pawns on the first and eighth rank
-	for (int sq = A1; sq <= H1; sq+=8)
-		if (pieces[BLACK][sq] == piece::pawn)
-			return false;
-	for (int sq = A8; sq <= H8; sq+=8)
-		if (pieces[WHITE][sq] == piece::pawn)
-			return false;
+	// a pawn on the last rank must be promoted before anything else is moved
+	if (promotion_pending())
+		return reject();
 
 
 	// handle castling first
@@ -318,9 +488,12 @@ bool board::move(int from, int to)
 
 	// check for legal moves
 	if (!is_legal(from, to))
-		return false;
+		return reject();
 
-	int pawn_status = pawn_legal_move(from, to);
+	int pawn_status = pieces[cur_player][from] == piece::pawn ?
+		pawn_legal_move(from, to) : ILLEGAL_MOVE;
+	const bool irreversible = pieces[cur_player][from] == piece::pawn or
+							  is(to, !cur_player);
 	if (pawn_status == EN_PASSANT)
 	{
 		// do enpassent
@@ -334,7 +507,8 @@ bool board::move(int from, int to)
 			pieces[cur_player][to] = piece::empty;
 			pieces[cur_player][from] = piece::pawn;
 			pieces[!cur_player][captured_square] = piece::pawn;
-			return false;
+			CHESS_COUNT(trial_moves);
+			return reject();
 		}
 	}
 	else
@@ -353,27 +527,267 @@ bool board::move(int from, int to)
 			pieces[cur_player][from] = pieces[cur_player][to];
 			pieces[!cur_player][to] = opp_to;
 			pieces[cur_player][to] = cp_to;
-			std::cout << "you are in check\n";
-			return false;
+			CHESS_COUNT(trial_moves);
+			return reject();
 		}
-		// update the castling rights
+		// update the castling rights, both for the piece moving and for a
+		// rook that may have been captured in its corner
 		update_castle_rights(from);
+		update_castle_rights(to);
 	}
 
 	// as the move is legal, and it is made, it is now your opponent's turn
 	// unless it is a pawn promotion, in which case it is your turn again to
 	// make the promotion
-	if (pawn_status != PROMOTION)
-		cur_player = !cur_player;
-
 	// update the en passant square
 	en_passant_square = pawn_status > 0 ? pawn_status : -1;
 
+	if (pawn_status != PROMOTION)
+	{
+		cur_player = !cur_player;
+		record(irreversible);
+	}
+
 	return true;
 }
 
+bool board::find_san(std::string_view san, move_t &m, int &promotion) const
+{
+	return parse_san(san, m, promotion) == move_status::ok;
+}
+
+board::move_status board::parse_san(std::string_view san, move_t &m,
+									int &promotion) const
+{
+	while (!san.empty() and (san.back() == '+' or san.back() == '#' or
+							 san.back() == '!' or san.back() == '?'))
+		san.remove_suffix(1);
+
+	promotion = 0;
+	const int king_square = cur_player == WHITE ? E1 : E8;
+	if (san == "O-O" or san == "0-0" or san == "O-O-O" or san == "0-0-0")
+	{
+		m = {king_square, king_square + (san.size() == 3 ? 16 : -16)};
+		if (promotion_pending())
+			return move_status::promotion_pending;
+		board copy = *this;
+		return copy.castle(m.first, m.second) ?
+			move_status::ok : move_status::illegal;
+	}
+
+	// the promotion piece comes last, with or without '='
+	if (san.size() >= 3)
+	{
+		switch (san.back())
+		{
+		case 'Q': promotion = QUEEN_PROMOTION; break;
+		case 'R': promotion = ROOK_PROMOTION; break;
+		case 'B': promotion = BISHOP_PROMOTION; break;
+		case 'N': promotion = KNIGHT_PROMOTION; break;
+		default: break;
+		}
+		if (promotion)
+		{
+			san.remove_suffix(1);
+			if (san.back() == '=')
+				san.remove_suffix(1);
+		}
+	}
+
+	piece type = piece::pawn;
+	if (!san.empty())
+	{
+		switch (san.front())
+		{
+		case 'K': type = piece::king; break;
+		case 'Q': type = piece::queen; break;
+		case 'R': type = piece::rook; break;
+		case 'B': type = piece::bishop; break;
+		case 'N': type = piece::knight; break;
+		default: break;
+		}
+	}
+	if (type != piece::pawn)
+		san.remove_prefix(1);
+
+	int to;
+	if (san.size() < 2 or !parse_square(san.substr(san.size() - 2), to))
+		return move_status::malformed;
+	san.remove_suffix(2);
+	if (!san.empty() and (san.back() == 'x' or san.back() == ':'))
+		san.remove_suffix(1);
+
+	// whatever is left disambiguates the piece by file, rank or both
+	int from_col = -1, from_row = -1;
+	for (char c : san)
+	{
+		if (c >= 'a' and c <= 'h')
+			from_col = c - 'a';
+		else if (c >= '1' and c <= '8')
+			from_row = c - '1';
+		else
+			return move_status::malformed;
+	}
+
+	if (promotion_pending())
+		return move_status::promotion_pending;
+
+	int found = 0;
+	for (int from = 0; from < 64; ++from)
+	{
+		if (pieces[cur_player][from] != type or
+			(from_col >= 0 and from / 8 != from_col) or
+			(from_row >= 0 and from % 8 != from_row))
+			continue;
+		if (is_legal(from, to) and king_safe_after(from, to))
+		{
+			m = {from, to};
+			++found;
+		}
+	}
+	if (found != 1)
+		return found ? move_status::ambiguous : move_status::illegal;
+
+	if (is_promotion(m.first, m.second))
+		promotion = promotion ? promotion : QUEEN_PROMOTION;
+	else if (promotion)
+		return move_status::bad_promotion;
+	return move_status::ok;
+}
+
+board::move_status board::parse_coordinates(std::string_view move, move_t &m,
+											int &promotion)
+{
+	if (move.size() < 4 or move.size() > MOVE_CHARS or
+		!parse_square(move.substr(0, 2), m.first) or
+		!parse_square(move.substr(2, 2), m.second))
+		return move_status::malformed;
+
+	promotion = 0;
+	if (move.size() == MOVE_CHARS)
+	{
+		switch (move[4])
+		{
+		case 'q': case 'Q': promotion = QUEEN_PROMOTION; break;
+		case 'r': case 'R': promotion = ROOK_PROMOTION; break;
+		case 'b': case 'B': promotion = BISHOP_PROMOTION; break;
+		case 'n': case 'N': promotion = KNIGHT_PROMOTION; break;
+		default: return move_status::malformed;
+		}
+	}
+	return move_status::ok;
+}
+
+board::move_status board::parse_move(std::string_view move, move_t &m,
+									 int &promotion) const
+{
+	move_status status = parse_coordinates(move, m, promotion);
+	if (status == move_status::ok)
+		status = validate(m.first, m.second);
+	if (status != move_status::ok)
+		return status;
+	if (is_promotion(m.first, m.second))
+		promotion = promotion ? promotion : QUEEN_PROMOTION;
+	else if (promotion)
+		return move_status::bad_promotion;
+	return move_status::ok;
+}
+
+board::move_status board::play(move_t m, int promotion)
+{
+	switch (promotion)
+	{
+	case 0:
+	case QUEEN_PROMOTION:
+	case ROOK_PROMOTION:
+	case BISHOP_PROMOTION:
+	case KNIGHT_PROMOTION:
+		break;
+	default:
+		return move_status::bad_promotion;
+	}
+	if (m.first < 0 or m.first >= 64 or m.second < 0 or m.second >= 64)
+		return move_status::malformed;
+	if (promotion and !is_promotion(m.first, m.second))
+		return move_status::bad_promotion;
+
+	// the reason is only worked out for a move that is rejected
+	if (!move(m.first, m.second))
+	{
+		const move_status status = validate(m.first, m.second);
+		return status == move_status::ok ? move_status::illegal : status;
+	}
+	if (promotion_pending())
+		move(m.second, promotion ? promotion : QUEEN_PROMOTION);
+	return move_status::ok;
+}
+
+board::move_status board::validate(int from, int to) const
+{
+	if (promotion_pending())
+		return move_status::promotion_pending;
+	if (!is(from, cur_player))
+		return move_status::no_piece;
+	if (pieces[cur_player][from] == piece::king and abs(to - from) == 16 and
+		(from == E1 or from == E8))
+	{
+		board copy = *this;
+		return copy.castle(from, to) ? move_status::ok : move_status::illegal;
+	}
+	if (!is_legal(from, to))
+		return move_status::illegal;
+	return king_safe_after(from, to) ? move_status::ok : move_status::in_check;
+}
+
+const char *board::describe(move_status s)
+{
+	switch (s)
+	{
+	case move_status::ok:
+		return "ok";
+	case move_status::malformed:
+		return "malformed move";
+	case move_status::no_piece:
+		return "no piece to move";
+	case move_status::illegal:
+		return "illegal move";
+	case move_status::in_check:
+		return "king left in check";
+	case move_status::ambiguous:
+		return "ambiguous move";
+	case move_status::promotion_pending:
+		return "promotion pending";
+	case move_status::bad_promotion:
+		return "bad promotion";
+	}
+	return "unknown";
+}
+
+bool board::king_safe_after(int from, int to) const
+{
+	// play the move on the piece arrays only, then put everything back
+	const piece moving = pieces[cur_player][from];
+	const int captured_square =
+		moving == piece::pawn and pawn_legal_move(from, to) == EN_PASSANT ?
+		en_passant_square + (cur_player == WHITE ? -1 : 1) : to;
+	const piece captured = pieces[!cur_player][captured_square];
+
+	pieces[!cur_player][captured_square] = piece::empty;
+	pieces[cur_player][to] = moving;
+	pieces[cur_player][from] = piece::empty;
+
+	const bool safe = !is_check(cur_player);
+	CHESS_COUNT(trial_moves);
+
+	pieces[cur_player][from] = moving;
+	pieces[cur_player][to] = piece::empty;
+	pieces[!cur_player][captured_square] = captured;
+	return safe;
+}
+
 bool board::is_check(bool king_color) const
 {
+	CHESS_COUNT(is_check);
 	// find where the king is
 	int king_pos {-1};
 	bool _cur_player = cur_player;
@@ -389,75 +803,260 @@ bool board::is_check(bool king_color) const
 		if (is_legal(i, king_pos))
 		{
 			cur_player = _cur_player;
+			CHESS_COUNT_N(is_check_squares, i + 1);
 			return true;
 		}
 	}
 	cur_player = _cur_player;
+	CHESS_COUNT_N(is_check_squares, 64);
 	return false;
 }
 
 bool board::castle(int from, int to)
 {
-	if (!is_valid(from, to) or is_check(cur_player))
+	int rook_from, rook_to;
+
+	if (from == E1 and cur_player == WHITE and to == G1 and white_short)
+	{
+		rook_from = H1;
+		rook_to = F1;
+	}
+	else if (from == E1 and cur_player == WHITE and to == C1 and white_long)
+	{
+		rook_from = A1;
+		rook_to = D1;
+	}
+	else if (from == E8 and cur_player == BLACK and to == G8 and black_short)
+	{
+		rook_from = H8;
+		rook_to = F8;
+	}
+	else if (from == E8 and cur_player == BLACK and to == C8 and black_long)
+	{
+		rook_from = A8;
+		rook_to = D8;
+	}
+	else
 		return false;
 
-	int king_from, king_to;
-	int rook_from, rook_to;
+	if (pieces[cur_player][from] != piece::king or
+		pieces[cur_player][rook_from] != piece::rook)
+		return false;
 
-	if (from == E1 and cur_player == WHITE)
+	// every square between the king and the rook must be empty
+	const int step = rook_from > from ? 8 : -8;
+	for (int sq = from + step; sq != rook_from; sq += step)
+		if (is(sq, WHITE) or is(sq, BLACK))
+			return false;
+
+	// the king may not castle out of, through or into check
+	if (is_check(cur_player))
+		return false;
+	for (int sq : {rook_to, to})
 	{
-		king_from = E1;
-		if (to==G1 and white_short)
+		pieces[cur_player][from] = piece::empty;
+		pieces[cur_player][sq] = piece::king;
+		const bool attacked = is_check(cur_player);
+		pieces[cur_player][sq] = piece::empty;
+		pieces[cur_player][from] = piece::king;
+		CHESS_COUNT(trial_moves);
+		if (attacked)
+			return false;
+	}
+
+	pieces[cur_player][from] = piece::empty;
+	pieces[cur_player][rook_from] = piece::empty;
+	pieces[cur_player][to] = piece::king;
+	pieces[cur_player][rook_to] = piece::rook;
+
+	update_castle_rights(from);
+	en_passant_square = -1;
+	cur_player = !cur_player;
+	record(false);
+	return true;
+}
+
+bool board::promote(int pos, piece p)
+{
+	if (pos < 0 or pos >= 64 or pieces[cur_player][pos] != piece::pawn or
+		pos % 8 != (cur_player == WHITE ? 7 : 0))
+		return false;
+
+	pieces[cur_player][pos] = p;
+	cur_player = !cur_player;
+	record(true);
+	return true;
+}
+
+void board::record(bool irreversible)
+{
+	halfmoves = irreversible ? 0 : halfmoves + 1;
+	if (cur_player == WHITE)
+		++fullmoves;
+	history[++ply & HISTORY_MASK] = compute_key();
+}
+
+bool board::is_draw(int repetitions) const
+{
+	if (halfmoves >= 100 or insufficient_material())
+		return true;
+
+	// a position can only repeat with the same side to move, and never
+	// across a pawn move or capture
+	const uint64_t current = key();
+	const int window = std::min({halfmoves, ply, HISTORY_SIZE - 1});
+	int seen = 1;
+	for (int back = 4; back <= window; back += 2)
+		if (history[(ply - back) & HISTORY_MASK] == current and
+			++seen >= repetitions)
+			return true;
+	return false;
+}
+
+bool board::insufficient_material() const
+{
+	int minors = 0;
+	int bishop_colors[2] = {0, 0};
+	for (int pos = 0; pos < 64; ++pos)
+	{
+		for (bool color : {false, true})
 		{
-			king_to = G1;
-			rook_from = H1;
-			rook_to = F1;
+			switch (pieces[color][pos])
+			{
+			case piece::pawn:
+			case piece::rook:
+			case piece::queen:
+				return false;
+			case piece::knight:
+				++minors;
+				break;
+			case piece::bishop:
+				++minors;
+				++bishop_colors[(pos / 8 + pos % 8) % 2];
+				break;
+			default:
+				break;
+			}
 		}
-		else if(to==C1 and white_long)
+	}
+	if (minors <= 1)
+		return true;
+	// any number of bishops, all on the same color
+	const int bishops = bishop_colors[0] + bishop_colors[1];
+	return bishops == minors and (!bishop_colors[0] or !bishop_colors[1]);
+}
+
+bool board::promotion_pending() const
+{
+	// check if there are any pawns on the first and eighth rank
+	for (int sq = A1; sq <= H1; sq+=8)
+		if (pieces[BLACK][sq] == piece::pawn)
+			return true;
+	for (int sq = A8; sq <= H8; sq+=8)
+		if (pieces[WHITE][sq] == piece::pawn)
+			return true;
+	return false;
+}
+
+board::move_list board::legal_moves(bool captures_only) const
+{
+	static constexpr int KNIGHT_STEPS[8][2] = {
+		{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}
+	};
+	static constexpr int KING_STEPS[8][2] = {
+		{0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}
+	};
+
+	move_list list;
+
+	if (promotion_pending())
+	{
+		for (int sq = 0; sq < 64; ++sq)
+			if (pieces[cur_player][sq] == piece::pawn and
+				sq % 8 == (cur_player == WHITE ? 7 : 0))
+				for (int p : {QUEEN_PROMOTION, ROOK_PROMOTION,
+							  BISHOP_PROMOTION, KNIGHT_PROMOTION})
+					list.push(sq, p);
+		return list;
+	}
+
+	// candidate destinations are generated per piece, then checked in place
+	// for leaving the king in check. Only castling, which is rare, is tried
+	// on a copy of the board.
+	auto try_move = [this, &list, captures_only](int from, int to) {
+		if (captures_only and !is(to, !cur_player) and !is_promotion(from, to)
+			and !(to == en_passant_square and pieces[cur_player][from] == piece::pawn))
+			return;
+		if (pieces[cur_player][from] == piece::king and abs(to - from) == 16)
 		{
-			king_to = C1;
-			rook_from = A1;
-			rook_to = D1;
+			board copy = *this;
+			if (copy.castle(from, to))
+				list.push(from, to);
 		}
-        else
-            return false;
-	}
-	if (from == E8 and cur_player == BLACK)
+		else if (is_legal(from, to) and king_safe_after(from, to))
+			list.push(from, to);
+	};
+	auto on_board = [](int col, int row) {
+		return col >= 0 and col < 8 and row >= 0 and row < 8;
+	};
+
+	for (int from = 0; from < 64; ++from)
 	{
-		king_from = E8;
-		if (to==G8 and black_short)
+		const piece p = pieces[cur_player][from];
+		if (p == piece::empty)
+			continue;
+
+		const int col = from / 8, row = from % 8;
+		switch (p)
+		{
+		case piece::pawn:
 		{
-			king_to = G8;
-			rook_from = H8;
-			rook_to = F8;
+			const int dir = cur_player == WHITE ? 1 : -1;
+			for (int dc : {-1, 0, 1})
+				if (on_board(col + dc, row + dir))
+					try_move(from, from + dc * 8 + dir);
+			if (on_board(col, row + 2 * dir))
+				try_move(from, from + 2 * dir);
+			break;
 		}
-        else if(to==C8 and black_long)
-        {
-            king_to = C8;
-            rook_from = A8;
-            rook_to = D8;
-        }
-        else
-            return false;
-	}
-    if (pieces[WHITE][rook_to] != piece::empty or
-        pieces[BLACK][rook_to] != piece::empty)
-        return false;
-
-    pieces[cur_player][king_from] = piece::empty;
-    pieces[cur_player][rook_to] = piece::king;
-
-    if (is_check(cur_player))
-    {
-        pieces[cur_player][king_from] = piece::king;
-        pieces[cur_player][rook_to] = piece::empty;
-        return false;
-    }
-    
-    pieces[cur_player][rook_to] = piece::rook;
-    pieces[cur_player][king_to] = piece::king;
-    pieces[cur_player][rook_from] = piece::empty;
-    return true;
+		case piece::knight:
+			for (auto [dc, dr] : KNIGHT_STEPS)
+				if (on_board(col + dc, row + dr))
+					try_move(from, from + dc * 8 + dr);
+			break;
+		case piece::king:
+			for (auto [dc, dr] : KING_STEPS)
+				if (on_board(col + dc, row + dr))
+					try_move(from, from + dc * 8 + dr);
+			if (from == E1 or from == E8)
+			{
+				try_move(from, from + 16);
+				try_move(from, from - 16);
+			}
+			break;
+		default:
+			for (auto [dc, dr] : KING_STEPS)
+			{
+				const bool diagonal = dc and dr;
+				if ((p == piece::rook and diagonal) or
+					(p == piece::bishop and !diagonal))
+					continue;
+				for (int c = col + dc, r = row + dr; on_board(c, r);
+					 c += dc, r += dr)
+				{
+					const int to = c * 8 + r;
+					if (is(to, cur_player))
+						break;
+					try_move(from, to);
+					if (is(to, !cur_player))
+						break;
+				}
+			}
+			break;
+		}
+	}
+
+	return list;
 }
 
 void board::update_castle_rights(int from)
@@ -479,10 +1078,10 @@ void board::update_castle_rights(int from)
 		black_long = false;
 		break;
 	case H1:
-		white_long = false;
+		white_short = false;
 		break;
 	case H8:
-		white_short = false;
+		black_short = false;
 		break;
 	default:
 		break;
@@ -515,7 +1114,7 @@ int board::get_pos(const std::string &str)
 	int row = str[0] - 'a';
 	int col = str[1] - '1';
 
-	if (row > 8 or row < 0 or col > 8 or col < 0)
+	if (row > 7 or row < 0 or col > 7 or col < 0)
 		throw std::invalid_argument("Invalid argument. The positions must be "
 									"within the range a1 to h8");
 
@@ -524,13 +1123,43 @@ int board::get_pos(const std::string &str)
 
 std::string board::get_str(int pos)
 {
-	int row = pos % 8;
-	int col = pos / 8;
-	return std::string(1, 'a' + row) + std::string(1, '1' + col);
+	if (pos < 0 or pos >= 64)
+		throw std::invalid_argument("Invalid position. The positions must be "
+									"within the range 0 to 63");
+	const char str[2] = {static_cast<char>('a' + pos / 8),
+						 static_cast<char>('1' + pos % 8)};
+	return std::string(str, 2);
+}
+
+bool board::parse_square(std::string_view str, int &pos)
+{
+	if (str.size() != 2 or str[0] < 'a' or str[0] > 'h' or str[1] < '1' or
+		str[1] > '8')
+		return false;
+	pos = (str[0] - 'a') * 8 + (str[1] - '1');
+	return true;
+}
+
+char *board::format_move(move_t m, int promotion, char *out)
+{
+	*out++ = static_cast<char>('a' + m.first / 8);
+	*out++ = static_cast<char>('1' + m.first % 8);
+	*out++ = static_cast<char>('a' + m.second / 8);
+	*out++ = static_cast<char>('1' + m.second % 8);
+	switch (promotion)
+	{
+	case QUEEN_PROMOTION: *out++ = 'q'; break;
+	case ROOK_PROMOTION: *out++ = 'r'; break;
+	case BISHOP_PROMOTION: *out++ = 'b'; break;
+	case KNIGHT_PROMOTION: *out++ = 'n'; break;
+	default: break;
+	}
+	return out;
 }
 
 uint32_t board::operator()() const
 {
+	CHESS_COUNT(hashes);
 	uint32_t hash = SEED;
 	for (int i = 0; i < 64; ++i)
 	{
@@ -540,6 +1169,26 @@ uint32_t board::operator()() const
 	return hash;
 }
 
+uint64_t board::compute_key() const
+{
+	CHESS_COUNT(hashes);
+	uint64_t key = 0;
+	for (int i = 0; i < 64; ++i)
+	{
+		key ^= ZOBRIST.pieces[WHITE][static_cast<int>(pieces[WHITE][i])][i];
+		key ^= ZOBRIST.pieces[BLACK][static_cast<int>(pieces[BLACK][i])][i];
+	}
+	if (white_short) key ^= ZOBRIST.castle[0];
+	if (white_long) key ^= ZOBRIST.castle[1];
+	if (black_short) key ^= ZOBRIST.castle[2];
+	if (black_long) key ^= ZOBRIST.castle[3];
+	if (en_passant_square >= 0)
+		key ^= ZOBRIST.en_passant[en_passant_square];
+	if (cur_player == BLACK)
+		key ^= ZOBRIST.black_to_move;
+	return key;
+}
+
 uint32_t board::seeded(board::piece p)
 {
 	switch (p)
@@ -1,19 +1,78 @@
 #pragma once
 #include <array>
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 namespace chess {
 class board
 {
 public:
-	enum class piece
+	enum class piece : uint8_t
 	{
 		empty = 0, king, queen, rook, bishop, knight, pawn
 	};
 	using move_t = std::pair<int, int>;
 	using board_t = std::array<piece, 64>;
 
+	/**
+	 * @brief Why a move was not accepted, from the functions that parse and
+	 * play moves without throwing.
+	 */
+	enum class move_status : uint8_t
+	{
+		ok = 0,
+		malformed,			// not a move in the notation
+		no_piece,			// the player has no piece on the square
+		illegal,			// the piece does not move that way
+		in_check,			// the move leaves the king in check
+		ambiguous,			// more than one legal move matches
+		promotion_pending,	// a pawn must be promoted first
+		bad_promotion		// a promotion piece for a move that is not one
+	};
+
+	/**
+	 * The most characters a move in coordinate notation takes, i.e. "e7e8q"
+	 */
+	static constexpr std::size_t MOVE_CHARS = 5;
+
+	/**
+	 * @brief A fixed capacity list of moves so move generation does not
+	 * allocate. No legal chess position has more than 218 moves.
+	 */
+	struct move_list
+	{
+		static constexpr int CAPACITY = 256;
+		std::array<move_t, CAPACITY> moves;
+		int size = 0;
+
+		inline void push(int from, int to) { moves[size++] = {from, to}; }
+		inline move_t &operator[] (int i) { return moves[i]; }
+		inline const move_t &operator[] (int i) const { return moves[i]; }
+		inline move_t *begin() { return moves.data(); }
+		inline move_t *end() { return moves.data() + size; }
+		inline const move_t *begin() const { return moves.data(); }
+		inline const move_t *end() const { return moves.data() + size; }
+		inline bool empty() const { return size == 0; }
+	};
+
 	board();
+
+	/**
+	 * @brief Construct a board from Forsyth-Edwards Notation, i.e.
+	 * "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+	 * @param fen The FEN string. The move counters are optional.
+	 * @throws std::invalid_argument if the string is not a valid FEN
+	 */
+	explicit board(const std::string &fen);
+
+	/**
+	 * @brief Get the Forsyth-Edwards Notation of the current position.
+	 * @return The FEN string of the position
+	 */
+	std::string fen() const;
+
 	friend std::ostream &operator<<(std::ostream &os, const board &b);
 
 	/**
@@ -25,12 +84,138 @@ public:
 
 	uint32_t operator() () const;
 
+	/**
+	 * @brief A 64-bit Zobrist key of the position. Unlike operator()() it also
+	 * covers the side to move, castling rights and the en passant square, so
+	 * it is suitable for transposition tables. The key is computed once per
+	 * move, so while a promotion is pending it is still the key from before
+	 * the pawn moved.
+	 * @return The Zobrist key of the position
+	 */
+	inline uint64_t key() const { return history[ply & HISTORY_MASK]; }
+
+	/**
+	 * @brief Check whether the game is drawn by repetition, the fifty-move
+	 * rule or insufficient material. Only the positions since the last pawn
+	 * move or capture are scanned for repetitions.
+	 * @param repetitions How many times the position must have occurred,
+	 * counting the current one. The rules say 3; a search uses 2 so it does
+	 * not walk into a repetition it could avoid.
+	 * @return true if the game is drawn, false otherwise
+	 */
+	bool is_draw(int repetitions = 3) const;
+
+	/**
+	 * @brief Check whether neither side has enough material left to checkmate:
+	 * king against king and a single minor piece, or bishops all on squares of
+	 * one color.
+	 */
+	bool insufficient_material() const;
+
+	/**
+	 * @brief The number of half moves since the last pawn move or capture.
+	 */
+	inline int halfmove_clock() const { return halfmoves; }
+
 	bool move(int from, int to);
 
+	/**
+	 * @brief Check whether the piece of the current player on a square can
+	 * move to another by the way it moves, without playing the move. Castling
+	 * and whether the king is left in check are not looked at, as move() does
+	 * that.
+	 */
+	bool is_legal(int from, int to) const;
+
 	bool is_check(bool king_color) const;
 
 	inline bool turn() const { return cur_player; }
 
+	/**
+	 * @brief Get the piece of a given color on a square.
+	 * @param pos The numerical position
+	 * @param color The color of the piece, 0 for white and 1 for black
+	 * @return The piece, or piece::empty if there is none
+	 */
+	inline piece at(int pos, bool color) const { return pieces[color][pos]; }
+
+	/**
+	 * @brief Generate every legal move for the current player. Promotions are
+	 * generated as a single move to the last rank; the promotion itself is
+	 * completed with a second call to move() once promotion_pending() is true.
+	 * @param captures_only Only generate captures and promotions
+	 * @return The list of legal moves
+	 */
+	move_list legal_moves(bool captures_only = false) const;
+
+	/**
+	 * @brief Find the legal move described in standard algebraic notation,
+	 * i.e. "Nf3", "exd5", "R1e2", "O-O" or "e8=Q+". Check and annotation
+	 * suffixes are ignored. Does not allocate or throw.
+	 * @param san The move in standard algebraic notation
+	 * @param m Filled with the move if it is found
+	 * @param promotion Filled with QUEEN_PROMOTION and friends for a
+	 * promotion, which defaults to a queen if the piece is omitted, or 0
+	 * @return true if exactly one legal move matches, false otherwise
+	 */
+	bool find_san(std::string_view san, move_t &m, int &promotion) const;
+
+	/**
+	 * @brief The same as find_san(), saying why no move was found.
+	 */
+	move_status parse_san(std::string_view san, move_t &m,
+						  int &promotion) const;
+
+	/**
+	 * @brief Parse a move in coordinate notation, i.e. "e2e4" or "e7e8q",
+	 * without looking at any position, for play(). Does not allocate or
+	 * throw.
+	 * @param promotion Filled with QUEEN_PROMOTION and friends if there is a
+	 * promotion letter, or 0
+	 * @return move_status::ok or move_status::malformed
+	 */
+	static move_status parse_coordinates(std::string_view move, move_t &m,
+										 int &promotion);
+
+	/**
+	 * @brief Parse a move in coordinate notation and check that it is legal,
+	 * without playing it. Does not allocate or throw.
+	 * @param move The move, with an optional promotion letter
+	 * @param m Filled with the move if it is legal
+	 * @param promotion Filled like for find_san()
+	 * @return move_status::ok if the move is legal, or why it is not
+	 */
+	move_status parse_move(std::string_view move, move_t &m,
+						   int &promotion) const;
+
+	/**
+	 * @brief Play a move and its promotion, if any, in one go. The position is
+	 * unchanged unless the move is played. Does not allocate or throw.
+	 * @param promotion QUEEN_PROMOTION and friends, or 0 for a queen if the
+	 * move is a promotion
+	 * @return move_status::ok if the move was played, or why it was not
+	 */
+	move_status play(move_t m, int promotion = 0);
+
+	/**
+	 * @brief A short description of a status, i.e. "illegal move".
+	 */
+	static const char *describe(move_status s);
+
+	/**
+	 * @brief Check whether a pawn has reached the last rank and is waiting to
+	 * be promoted with move(pos, QUEEN_PROMOTION) and friends.
+	 */
+	bool promotion_pending() const;
+
+	/**
+	 * @brief Check whether moving from one square to another moves a pawn
+	 * onto the last rank.
+	 */
+	inline bool is_promotion(int from, int to) const
+	{ return pieces[cur_player][from] == piece::pawn and
+		to % 8 == (cur_player == WHITE ? 7 : 0); }
+
 	/**
 	 * @brief Get the numerical position given a string representation: i.e. "a1"
 	 * -> 0, "h8" -> 63
@@ -49,12 +234,40 @@ public:
 	 */
 	static std::string get_str(int pos);
 
+	/**
+	 * @brief Parse a square, i.e. "a1" -> 0, "h8" -> 63. Does not allocate or
+	 * throw.
+	 * @return false if the string is not a square
+	 */
+	static bool parse_square(std::string_view str, int &pos);
+
+	/**
+	 * @brief Write a move in coordinate notation, i.e. "e7e8q", without a
+	 * terminating null.
+	 * @param out A buffer of at least MOVE_CHARS characters
+	 * @param promotion QUEEN_PROMOTION and friends, or 0
+	 * @return The end of what was written
+	 */
+	static char *format_move(move_t m, int promotion, char *out);
+
 private:
+	/**
+	 * The number of keys kept. Must be a power of two and more than the 100
+	 * half moves after which the fifty-move rule ends the game.
+	 */
+	static constexpr int HISTORY_SIZE = 128;
+	static constexpr int HISTORY_MASK = HISTORY_SIZE - 1;
+
 	mutable board_t pieces[2];
 	mutable bool cur_player;
 	bool white_short, white_long, black_short, black_long;
 	int en_passant_square;
 
+	int halfmoves;		// half moves since the last pawn move or capture
+	int fullmoves;		// the move number, starting at 1
+	int ply;			// half moves played since the board was set up
+	std::array<uint64_t, HISTORY_SIZE> history;	// ring buffer of keys by ply
+
 	inline bool is(int pos, bool color) const
 	{ return pieces[color][pos] != piece::empty; }
 
@@ -79,9 +292,13 @@ private:
 	bool king_legal_move(int pos, int to) const;
 	int pawn_legal_move(int pos, int to) const; // return -1 if en passant is
 	// not possible, and return enpassant square if it is possible.
-	bool is_legal(int from, int to) const;
 	void update_castle_rights(int from);
 	bool castle(int from, int to);
+	bool promote(int pos, piece p);
+	bool king_safe_after(int from, int to) const;
+	move_status validate(int from, int to) const;
+	void record(bool irreversible);
+	uint64_t compute_key() const;
 
 	static uint32_t seeded(piece p);
 
@@ -96,10 +313,6 @@ private:
 	 */
 	static constexpr int ILLEGAL_MOVE = 0, CAPTURE = -1, ADVANCE_1 = -2,
 	EN_PASSANT = -3, PROMOTION = -4;
-	static constexpr int QUEEN_PROMOTION = -100;
-	static constexpr int ROOK_PROMOTION = -101;
-	static constexpr int BISHOP_PROMOTION = -102;
-	static constexpr int KNIGHT_PROMOTION = -103;
 
 	static constexpr uint32_t SEED = 861317959;
 
@@ -114,6 +327,14 @@ private:
 		269,271,277,281,283,293,307,311
 	};
 public:
+	/**
+	 * Constants for promotions, passed to move() as the destination
+	 */
+	static constexpr int QUEEN_PROMOTION = -100;
+	static constexpr int ROOK_PROMOTION = -101;
+	static constexpr int BISHOP_PROMOTION = -102;
+	static constexpr int KNIGHT_PROMOTION = -103;
+
 	/**
 	 * Constants for squares
 	 */
@@ -0,0 +1,108 @@
+#include "deduplicator.hpp"
+#include "packed.hpp"
+#include "replay.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-t threads] [-b filter bits per "
+			  "position] [-w window]\n"
+			  "       [-m max set MB] input output\n"
+			  "Copies a file of packed positions, such as the output of "
+			  "chess_selfplay, keeping\n"
+			  "only the first occurrence of every position. The filter takes "
+			  "b/8 GB per billion\n"
+			  "positions, and the window 17 bytes per position. The exact "
+			  "set takes up to 36 GB\n"
+			  "per billion distinct positions that occur more than once, "
+			  "and gives up past -m." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	chess::dedup_options options;
+	options.threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg[0] != '-')
+		{
+			paths.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc or arg.size() != 2)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		const char *value = argv[++i];
+		try
+		{
+			switch (arg[1])
+			{
+			case 't': options.threads = std::max(1, atoi(value)); break;
+			case 'b': options.bloom_bits = std::stod(value); break;
+			case 'w': options.window = std::stoull(value); break;
+			case 'm': options.max_set_bytes = std::stoull(value) << 20; break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		catch (std::logic_error &e)
+		{
+			// from std::stoull and friends, for a value that is not a number
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (paths.size() != 2)
+	{
+		usage(argv[0]);
+		return 0;
+	}
+
+	try
+	{
+		const chess::mapped_file file(paths[0]);
+		const std::string_view data = file.view();
+		if (data.size() % sizeof(chess::packed_position))
+		{
+			std::cerr << paths[0] << " is not a file of packed positions"
+					  << std::endl;
+			return 1;
+		}
+		const std::span<const chess::packed_position> positions(
+			reinterpret_cast<const chess::packed_position *>(data.data()),
+			data.size() / sizeof(chess::packed_position));
+
+		const auto s = chess::deduplicate(positions, paths[1], options);
+		constexpr double MB = 1 << 20;
+		std::cout << s.positions << " positions, " << s.unique << " unique, "
+				  << s.positions - s.unique << " duplicates removed\n"
+				  << s.candidates << " possible duplicates checked exactly\n"
+				  << "memory: filter " << s.bloom_bytes / MB << " MB, set "
+				  << s.set_bytes / MB << " MB, window " << s.buffer_bytes / MB
+				  << " MB\n"
+				  << s.seconds << " s (" << (s.seconds > 0 ? s.positions / s.seconds : 0)
+				  << " positions/s on " << options.threads << " threads)"
+				  << std::endl;
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,271 @@
+#include "deduplicator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chess {
+
+namespace {
+constexpr uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	return x ^ x >> 31;
+}
+}
+
+blocked_bloom_filter::blocked_bloom_filter(std::size_t bytes)
+: count(std::max<std::size_t>(1, (bytes + sizeof(block) - 1) / sizeof(block)))
+{
+	blocks = std::make_unique<block[]>(count);
+}
+
+bool blocked_bloom_filter::test_and_set(uint64_t hash)
+{
+	// the low half picks the block and a remix of the whole picks one bit in
+	// each of its eight words
+	block &b = blocks[(hash & 0xFFFFFFFF) * count >> 32];
+	const uint64_t bits = hash * 0x9E3779B97F4A7C15ull;
+	bool present = true;
+	for (int i = 0; i < 8; ++i)
+	{
+		const uint64_t mask = 1ull << (bits >> (16 + 6 * i) & 63);
+		present &= (b.words[i] & mask) != 0;
+		b.words[i] |= mask;
+	}
+	return present;
+}
+
+hash_set::hash_set()
+: slots(1024), flags(1024), used(0)
+{
+}
+
+std::size_t hash_set::slot(uint64_t hash) const
+{
+	const std::size_t mask = slots.size() - 1;
+	std::size_t i = mix(hash) & mask;
+	while (slots[i] and slots[i] != hash)
+		i = (i + 1) & mask;
+	return i;
+}
+
+void hash_set::grow()
+{
+	std::vector<uint64_t> old_slots(slots.size() * 2);
+	std::vector<uint8_t> old_flags(flags.size() * 2);
+	old_slots.swap(slots);
+	old_flags.swap(flags);
+	for (std::size_t i = 0; i < old_slots.size(); ++i)
+		if (old_slots[i])
+		{
+			const std::size_t j = slot(old_slots[i]);
+			slots[j] = old_slots[i];
+			flags[j] = old_flags[i];
+		}
+}
+
+void hash_set::insert(uint64_t hash)
+{
+	if (2 * (used + 1) > slots.size())
+		grow();
+	const std::size_t i = slot(hash);
+	if (!slots[i])
+	{
+		slots[i] = hash;
+		++used;
+	}
+}
+
+int hash_set::find_and_flag(uint64_t hash)
+{
+	const std::size_t i = slot(hash);
+	if (!slots[i])
+		return -1;
+	const int previous = flags[i];
+	flags[i] = 1;
+	return previous;
+}
+
+uint64_t position_hash(const packed_position &p)
+{
+	uint64_t low, high;
+	std::memcpy(&low, p.pieces, sizeof(low));
+	std::memcpy(&high, p.pieces + 8, sizeof(high));
+	const uint64_t h = mix(mix(mix(p.occupancy) ^ low) ^ high ^ p.side);
+	return h ? h : 1;
+}
+
+dedup_summary deduplicate(std::span<const packed_position> positions,
+						  const std::string &path, const dedup_options &options)
+{
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+
+	const unsigned threads = std::max(1u, options.threads);
+	const std::size_t n = positions.size();
+	const std::size_t window =
+		std::min(n, std::max<std::size_t>(options.window, threads));
+
+	const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		throw std::runtime_error("Could not open " + path);
+
+	struct routed
+	{
+		uint64_t hash;
+		std::size_t index;
+	};
+
+	// one filter and one exact set per partition, each owned by one thread
+	const auto bloom_bytes = static_cast<std::size_t>(
+		std::ceil(n * options.bloom_bits / 8 / threads));
+	std::vector<blocked_bloom_filter> filters;
+	for (unsigned t = 0; t < threads; ++t)
+		filters.emplace_back(bloom_bytes);
+	std::vector<hash_set> sets(threads);
+
+	// buckets[producer][partition]
+	std::vector<std::vector<std::vector<routed>>> buckets(
+		threads, std::vector<std::vector<routed>>(threads));
+	std::vector<uint8_t> keep(window);
+	std::vector<std::size_t> counts(threads);
+	std::barrier sync(threads);
+	std::atomic<bool> failed(false), too_large(false);
+	std::size_t unique = 0;
+
+	auto partition = [threads](uint64_t hash) {
+		return static_cast<unsigned>((hash >> 32) * threads >> 32);
+	};
+
+	auto run = [&](unsigned t) {
+		std::vector<packed_position> out;
+		out.reserve(4096);
+		std::size_t written = 0;
+
+		auto flush = [&](std::size_t &offset) {
+			const char *data = reinterpret_cast<const char *>(out.data());
+			std::size_t size = out.size() * sizeof(packed_position);
+			off_t at = static_cast<off_t>(offset * sizeof(packed_position));
+			while (size and !failed)
+			{
+				const ssize_t w = pwrite(fd, data, size, at);
+				if (w < 0)
+					failed = true;
+				else
+				{
+					data += w;
+					at += w;
+					size -= w;
+				}
+			}
+			offset += out.size();
+			out.clear();
+		};
+
+		for (int pass = 1; pass <= 2; ++pass)
+		{
+			for (std::size_t low = 0; low < n; low += window)
+			{
+				const std::size_t high = std::min(n, low + window);
+				const std::size_t slice = (high - low + threads - 1) / threads;
+				const std::size_t first = std::min(high, low + t * slice);
+				const std::size_t last = std::min(high, first + slice);
+
+				// hash this thread's slice and route it to the owners
+				for (std::size_t i = first; i < last; ++i)
+				{
+					const uint64_t h = position_hash(positions[i]);
+					buckets[t][partition(h)].push_back({h, i});
+				}
+				sync.arrive_and_wait();
+
+				// process this thread's partition, in input order
+				for (unsigned s = 0; s < threads; ++s)
+				{
+					for (const routed &r : buckets[s][t])
+					{
+						if (pass == 1)
+						{
+							if (filters[t].test_and_set(r.hash))
+								sets[t].insert(r.hash);
+						}
+						else
+							keep[r.index - low] = sets[t].find_and_flag(r.hash) != 1;
+					}
+					buckets[s][t].clear();
+				}
+				if (pass == 1 and options.max_set_bytes and
+					sets[t].bytes() > options.max_set_bytes / threads)
+					too_large = true;
+				sync.arrive_and_wait();
+
+				// every thread sees the flag after the barrier, so all stop
+				if (too_large)
+					return;
+				if (pass == 1)
+					continue;
+
+				// write the kept positions of the slice where they belong
+				counts[t] = std::count(keep.begin() + (first - low),
+									   keep.begin() + (last - low), 1);
+				sync.arrive_and_wait();
+				std::size_t offset = written;
+				for (unsigned s = 0; s < t; ++s)
+					offset += counts[s];
+				for (std::size_t i = first; i < last; ++i)
+				{
+					if (!keep[i - low])
+						continue;
+					out.push_back(positions[i]);
+					if (out.size() == out.capacity())
+						flush(offset);
+				}
+				flush(offset);
+				for (unsigned s = 0; s < threads; ++s)
+					written += counts[s];
+			}
+		}
+		if (t == 0)
+			unique = written;
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; ++t)
+		pool.emplace_back(run, t);
+	run(0);
+	for (auto &t : pool)
+		t.join();
+	close(fd);
+	if (failed)
+		throw std::runtime_error("Could not write " + path);
+	if (too_large)
+		throw std::runtime_error("The exact set needs more than " +
+			std::to_string(options.max_set_bytes) + " bytes");
+
+	dedup_summary summary;
+	summary.positions = n;
+	summary.unique = unique;
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		summary.candidates += sets[t].size();
+		summary.bloom_bytes += filters[t].bytes();
+		summary.set_bytes += sets[t].bytes();
+	}
+	summary.buffer_bytes = window * (sizeof(routed) + 1);
+	summary.seconds = std::chrono::duration<double>(clock::now() - start).count();
+	return summary;
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "packed.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace chess {
+
+/**
+ * @brief A Bloom filter whose bits for any one key all lie in the same 64
+ * byte block, so a lookup touches a single cache line. Not thread safe.
+ */
+class blocked_bloom_filter
+{
+public:
+	/**
+	 * @param bytes The size of the filter, rounded up to whole blocks
+	 */
+	explicit blocked_bloom_filter(std::size_t bytes);
+
+	/**
+	 * @brief Add a key to the filter.
+	 * @return true if the key may have been added before, false if it
+	 * definitely was not
+	 */
+	bool test_and_set(uint64_t hash);
+
+	inline std::size_t bytes() const { return count * sizeof(block); }
+
+private:
+	struct alignas(64) block
+	{
+		uint64_t words[8];
+	};
+
+	std::unique_ptr<block[]> blocks;
+	std::size_t count;
+};
+
+/**
+ * @brief An open addressing set of 64-bit hashes, each with a flag. Zero is
+ * not a valid hash. Not thread safe.
+ */
+class hash_set
+{
+public:
+	hash_set();
+
+	void insert(uint64_t hash);
+
+	/**
+	 * @brief Find a hash and set its flag.
+	 * @return -1 if the hash is not in the set, otherwise the previous flag
+	 */
+	int find_and_flag(uint64_t hash);
+
+	inline std::size_t size() const { return used; }
+	inline std::size_t bytes() const
+	{ return slots.size() * sizeof(uint64_t) + flags.size(); }
+
+private:
+	std::vector<uint64_t> slots;
+	std::vector<uint8_t> flags;
+	std::size_t used;
+
+	std::size_t slot(uint64_t hash) const;
+	void grow();
+};
+
+/**
+ * @brief The hash of what a packed position describes, ignoring the score
+ * and result it is labelled with. Never zero.
+ */
+uint64_t position_hash(const packed_position &p);
+
+struct dedup_options
+{
+	unsigned threads = 1;
+	double bloom_bits = 12;				// filter bits per input position
+	std::size_t window = 1 << 22;		// positions in flight at once
+	std::size_t max_set_bytes = 0;		// for the exact sets, or 0 for no limit
+};
+
+struct dedup_summary
+{
+	std::size_t positions = 0;
+	std::size_t unique = 0;
+	std::size_t candidates = 0;	// distinct hashes the filter flagged
+	std::size_t bloom_bytes = 0;
+	std::size_t set_bytes = 0;
+	std::size_t buffer_bytes = 0;
+	double seconds = 0;
+};
+
+/**
+ * @brief Remove duplicate positions, keeping the first occurrence of each and
+ * the order of the input.
+ *
+ * The hashes are partitioned by their top bits, and each thread owns the
+ * Bloom filter and exact set of one partition, so neither needs any locking.
+ * The input is streamed through in windows: all threads hash a slice of the
+ * window and hand each hash to the thread owning its partition.
+ *
+ * A first pass adds every hash to the filter. Only those the filter has
+ * possibly seen before go into the exact set, which therefore holds the
+ * duplicates and the false positives rather than every position. A second
+ * pass keeps the positions whose hash is not in the exact set, and the first
+ * occurrence of those that are.
+ *
+ * Memory is the filter, options.bloom_bits per position, 17 bytes per
+ * position of the window, which is never larger than the input, and the exact
+ * set. The set has one entry for every distinct position that occurs more than
+ * once, however often it does, and one for every false positive of the
+ * filter, at 18 to 36 bytes each as it is kept between a quarter and half
+ * full. That is up to 36 GB per billion distinct duplicated positions, so
+ * options.max_set_bytes bounds it: the first pass stops at the end of the
+ * window during which the sets outgrew it, before anything is written.
+ *
+ * @param positions The input
+ * @param path Where to write the unique positions
+ * @throws std::runtime_error if the output cannot be written, or the exact
+ * set would need more than options.max_set_bytes
+ */
+dedup_summary deduplicate(std::span<const packed_position> positions,
+						  const std::string &path, const dedup_options &options);
+
+}
@@ -0,0 +1,114 @@
+#include "eval.hpp"
+
+namespace chess {
+
+namespace {
+/**
+ * Piece-square tables written from white's point of view with the eighth rank
+ * at the top, the same way the board is printed.
+ */
+constexpr int PAWN_TABLE[64] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	50, 50, 50, 50, 50, 50, 50, 50,
+	10, 10, 20, 30, 30, 20, 10, 10,
+	 5,  5, 10, 25, 25, 10,  5,  5,
+	 0,  0,  0, 20, 20,  0,  0,  0,
+	 5, -5,-10,  0,  0,-10, -5,  5,
+	 5, 10, 10,-20,-20, 10, 10,  5,
+	 0,  0,  0,  0,  0,  0,  0,  0
+};
+constexpr int KNIGHT_TABLE[64] = {
+	-50,-40,-30,-30,-30,-30,-40,-50,
+	-40,-20,  0,  0,  0,  0,-20,-40,
+	-30,  0, 10, 15, 15, 10,  0,-30,
+	-30,  5, 15, 20, 20, 15,  5,-30,
+	-30,  0, 15, 20, 20, 15,  0,-30,
+	-30,  5, 10, 15, 15, 10,  5,-30,
+	-40,-20,  0,  5,  5,  0,-20,-40,
+	-50,-40,-30,-30,-30,-30,-40,-50
+};
+constexpr int BISHOP_TABLE[64] = {
+	-20,-10,-10,-10,-10,-10,-10,-20,
+	-10,  0,  0,  0,  0,  0,  0,-10,
+	-10,  0,  5, 10, 10,  5,  0,-10,
+	-10,  5,  5, 10, 10,  5,  5,-10,
+	-10,  0, 10, 10, 10, 10,  0,-10,
+	-10, 10, 10, 10, 10, 10, 10,-10,
+	-10,  5,  0,  0,  0,  0,  5,-10,
+	-20,-10,-10,-10,-10,-10,-10,-20
+};
+constexpr int ROOK_TABLE[64] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,
+	 5, 10, 10, 10, 10, 10, 10,  5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	-5,  0,  0,  0,  0,  0,  0, -5,
+	 0,  0,  0,  5,  5,  0,  0,  0
+};
+constexpr int QUEEN_TABLE[64] = {
+	-20,-10,-10, -5, -5,-10,-10,-20,
+	-10,  0,  0,  0,  0,  0,  0,-10,
+	-10,  0,  5,  5,  5,  5,  0,-10,
+	 -5,  0,  5,  5,  5,  5,  0, -5,
+	  0,  0,  5,  5,  5,  5,  0, -5,
+	-10,  5,  5,  5,  5,  5,  0,-10,
+	-10,  0,  5,  0,  0,  0,  0,-10,
+	-20,-10,-10, -5, -5,-10,-10,-20
+};
+constexpr int KING_TABLE[64] = {
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-30,-40,-40,-50,-50,-40,-40,-30,
+	-20,-30,-30,-40,-40,-30,-30,-20,
+	-10,-20,-20,-20,-20,-20,-20,-10,
+	 20, 20,  0,  0,  0,  0, 20, 20,
+	 20, 30, 10,  0,  0, 10, 30, 20
+};
+
+constexpr const int *TABLES[7] = {
+	nullptr, KING_TABLE, QUEEN_TABLE, ROOK_TABLE, BISHOP_TABLE, KNIGHT_TABLE,
+	PAWN_TABLE
+};
+
+/**
+ * @brief Fold the piece values into the tables, so every piece is evaluated
+ * with a single lookup.
+ */
+constexpr std::array<int, WEIGHT_COUNT> combine()
+{
+	std::array<int, WEIGHT_COUNT> w {};
+	for (int p = 1; p < 7; ++p)
+		for (int i = 0; i < 64; ++i)
+			w[(p - 1) * 64 + i] = PIECE_VALUE[p] + TABLES[p][i];
+	return w;
+}
+
+constexpr std::array<int, WEIGHT_COUNT> WEIGHTS = combine();
+}
+
+const std::array<int, WEIGHT_COUNT> &weights()
+{
+	return WEIGHTS;
+}
+
+int evaluate(const board &b)
+{
+	int score = 0;
+	for (int pos = 0; pos < 64; ++pos)
+	{
+		for (bool color : {false, true})
+		{
+			const auto p = b.at(pos, color);
+			if (p == board::piece::empty)
+				continue;
+			const int value = WEIGHTS[weight_index(p, pos, color)];
+			score += color ? -value : value;
+		}
+	}
+	return b.turn() ? -score : score;
+}
+
+}
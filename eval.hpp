@@ -0,0 +1,46 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <array>
+
+namespace chess {
+
+/**
+ * @brief Piece values in centipawns, indexed by board::piece.
+ */
+constexpr int PIECE_VALUE[7] = {0, 0, 900, 500, 330, 320, 100};
+
+/**
+ * @brief The number of evaluation weights, one per piece type and square.
+ * Each weight is the value of the piece plus its piece-square bonus.
+ */
+constexpr int WEIGHT_COUNT = 6 * 64;
+
+/**
+ * @brief The index of the weight of a piece on a square. Black pieces use the
+ * square mirrored to white's side of the board.
+ * @param p The piece, which must not be piece::empty
+ * @param pos The numerical position
+ * @param color The color of the piece
+ */
+constexpr int weight_index(board::piece p, int pos, bool color)
+{
+	const int col = pos / 8, row = pos % 8;
+	return (static_cast<int>(p) - 1) * 64 + (color ? row : 7 - row) * 8 + col;
+}
+
+/**
+ * @brief The weights used by evaluate(), indexed by weight_index().
+ */
+const std::array<int, WEIGHT_COUNT> &weights();
+
+/**
+ * @brief Statically evaluate a position using material and piece-square
+ * tables.
+ * @param b The position to evaluate
+ * @return The score in centipawns from the point of view of the side to move
+ */
+int evaluate(const board &b);
+
+}
@@ -0,0 +1,281 @@
+#include "game_log.hpp"
+#include "replay.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chess {
+
+namespace {
+constexpr std::size_t HEADER_SIZE = 8;
+
+uint8_t checksum(std::string_view record)
+{
+	// FNV-1a over everything but the checksum byte itself, folded to 8 bits
+	uint32_t h = 2166136261u;
+	for (std::size_t i = 0; i < record.size(); ++i)
+		if (i != 1)
+			h = (h ^ static_cast<uint8_t>(record[i])) * 16777619u;
+	return static_cast<uint8_t>(h ^ h >> 8 ^ h >> 16 ^ h >> 24);
+}
+
+uint32_t read_le(std::string_view bytes)
+{
+	uint32_t v = 0;
+	for (std::size_t i = bytes.size(); i-- > 0;)
+		v = v << 8 | static_cast<uint8_t>(bytes[i]);
+	return v;
+}
+
+void write_le(std::string &out, uint32_t v, int size)
+{
+	for (int i = 0; i < size; ++i, v >>= 8)
+		out += static_cast<char>(v & 0xFF);
+}
+}
+
+uint16_t game_log::encode_move(int from, int to, int promotion)
+{
+	const int code = promotion ? board::QUEEN_PROMOTION - promotion + 1 : 0;
+	return static_cast<uint16_t>(from | to << 6 | code << 12);
+}
+
+void game_log::decode_move(uint16_t move, int &from, int &to, int &promotion)
+{
+	from = move & 63;
+	to = move >> 6 & 63;
+	const int code = move >> 12;
+	promotion = code ? board::QUEEN_PROMOTION - code + 1 : 0;
+}
+
+game_log::game_log(const std::string &path)
+: fd(open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644)), next_id(0),
+  head(new node), queued(0), closing(false), failed(false)
+{
+	tail = head.load();
+	if (fd < 0)
+	{
+		delete tail;
+		throw std::runtime_error("Could not open " + path);
+	}
+
+	try
+	{
+		std::size_t valid = 0;
+		struct stat st {};
+		fstat(fd, &st);
+		if (st.st_size)
+		{
+			const mapped_file file(path);
+			recover(file.view(), valid);
+		}
+		// cut off a record torn by a crash so new records follow valid ones
+		if (static_cast<std::size_t>(st.st_size) > valid and
+			ftruncate(fd, static_cast<off_t>(valid)) < 0)
+			throw std::runtime_error("Could not truncate " + path);
+	}
+	catch (...)
+	{
+		close(fd);
+		delete tail;
+		throw;
+	}
+
+	writer = std::thread([this] { write_loop(); });
+}
+
+game_log::~game_log()
+{
+	closing = true;
+	queued.fetch_add(1);
+	queued.notify_one();
+	writer.join();
+	delete tail;
+	close(fd);
+}
+
+void game_log::recover(std::string_view data, std::size_t &valid)
+{
+	uint32_t max_id = 0;
+	std::size_t offset = 0;
+	while (data.size() - offset >= HEADER_SIZE)
+	{
+		const std::string_view header = data.substr(offset, HEADER_SIZE);
+		const auto type = static_cast<record_type>(header[0]);
+		const uint16_t value = static_cast<uint16_t>(read_le(header.substr(2, 2)));
+		const uint32_t game = read_le(header.substr(4, 4));
+		const std::size_t size =
+			HEADER_SIZE + (type == game_start ? value : 0);
+
+		const std::string error = "Corrupt game log: game " +
+								  std::to_string(game) + " at offset " +
+								  std::to_string(offset);
+		const bool known = type >= game_start and type <= game_end;
+		if (known and data.size() - offset < size)
+			break;
+		const std::string_view record = data.substr(offset, size);
+		if (!known or static_cast<uint8_t>(record[1]) != checksum(record))
+		{
+			// a crash can only tear the last record written, or leave the
+			// file longer than what reached it, which reads back as zeros
+			const std::string_view rest = data.substr(offset);
+			if ((known and offset + size == data.size()) or
+				std::all_of(rest.begin(), rest.end(),
+							[](char c) { return c == 0; }))
+				break;
+			throw std::runtime_error(error +
+				(known ? ": bad checksum" : ": unknown record type"));
+		}
+
+		switch (type)
+		{
+		case game_start:
+		{
+			live_game g;
+			g.fen = record.substr(HEADER_SIZE);
+			try
+			{
+				if (!g.fen.empty())
+					g.position = board(g.fen);
+			}
+			catch (std::invalid_argument &e)
+			{
+				throw std::runtime_error(error + ": " + e.what());
+			}
+			live[game] = std::move(g);
+			break;
+		}
+		case game_move:
+		{
+			auto it = live.find(game);
+			int from, to, promotion;
+			decode_move(value, from, to, promotion);
+			if (it == live.end() or !it->second.position.move(from, to))
+				throw std::runtime_error(error + ": illegal move");
+			board &b = it->second.position;
+			if (b.promotion_pending())
+				b.move(to, promotion ? promotion : board::QUEEN_PROMOTION);
+			++it->second.moves;
+			break;
+		}
+		case game_end:
+			live.erase(game);
+			break;
+		}
+
+		max_id = std::max(max_id, game + 1);
+		offset += size;
+	}
+	valid = offset;
+	next_id = max_id;
+}
+
+uint32_t game_log::start(const std::string &fen)
+{
+	if (fen.size() > 0xFFFF)
+		throw std::invalid_argument("FEN too long");
+	const uint32_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+	append(game_start, static_cast<uint16_t>(fen.size()), id, fen);
+	return id;
+}
+
+void game_log::move(uint32_t game, int from, int to, int promotion)
+{
+	append(game_move, encode_move(from, to, promotion), game);
+}
+
+void game_log::end(uint32_t game, result_t result)
+{
+	append(game_end, result, game);
+}
+
+void game_log::sync()
+{
+	std::atomic<bool> done(false);
+	node *n = new node;
+	n->synced = &done;
+	push(n);
+	done.wait(false);
+	if (failed)
+		throw std::runtime_error("Could not write the game log");
+}
+
+void game_log::append(record_type type, uint16_t data, uint32_t game,
+					  std::string_view payload)
+{
+	node *n = new node;
+	n->bytes.reserve(HEADER_SIZE + payload.size());
+	n->bytes += static_cast<char>(type);
+	n->bytes += '\0';
+	write_le(n->bytes, data, 2);
+	write_le(n->bytes, game, 4);
+	n->bytes += payload;
+	n->bytes[1] = static_cast<char>(checksum(n->bytes));
+	push(n);
+}
+
+void game_log::push(node *n)
+{
+	node *prev = head.exchange(n, std::memory_order_acq_rel);
+	prev->next.store(n, std::memory_order_release);
+	queued.fetch_add(1, std::memory_order_release);
+	queued.notify_one();
+}
+
+void game_log::write_loop()
+{
+	std::string batch;
+	std::vector<std::atomic<bool> *> waiters;
+	while (true)
+	{
+		const uint64_t seen = queued.load(std::memory_order_acquire);
+
+		// take everything that is queued; the popped node becomes the stub
+		for (node *next; (next = tail->next.load(std::memory_order_acquire));)
+		{
+			delete tail;
+			tail = next;
+			batch += next->bytes;
+			next->bytes.clear();
+			if (next->synced)
+				waiters.push_back(next->synced);
+		}
+
+		if (batch.empty() and waiters.empty())
+		{
+			if (closing)
+				break;
+			queued.wait(seen, std::memory_order_acquire);
+			continue;
+		}
+
+		// one write and one flush for the whole group
+		for (std::size_t done = 0; done < batch.size() and !failed;)
+		{
+			const ssize_t written = ::write(fd, batch.data() + done,
+											batch.size() - done);
+			if (written < 0)
+				failed = true;
+			else
+				done += written;
+		}
+		if (!batch.empty() and fdatasync(fd) < 0)
+			failed = true;
+		batch.clear();
+
+		for (auto *w : waiters)
+		{
+			w->store(true);
+			w->notify_all();
+		}
+		waiters.clear();
+	}
+}
+
+}
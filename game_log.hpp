@@ -0,0 +1,134 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+
+namespace chess {
+
+/**
+ * @brief An append-only log of games on disk.
+ *
+ * Every record starts with the same 8 bytes, little endian:
+ * 	- type (1 byte): game_start, game_move or game_end
+ * 	- check (1 byte): a checksum of the rest of the record
+ * 	- data (2 bytes): the length of the FEN for game_start, the move for
+ * 	game_move (from | to << 6 | promotion << 12, see encode_move()) and the
+ * 	result for game_end
+ * 	- game (4 bytes): the id of the game
+ * and a game_start record is followed by the FEN of the starting position,
+ * which is empty for the standard one.
+ *
+ * Records are handed to a writer thread through a lock-free queue. The writer
+ * writes everything that has queued up while it was busy in one go, followed
+ * by a single fdatasync, so any number of games share each flush and no
+ * caller ever waits for the disk unless it asks to with sync().
+ *
+ * Opening an existing log scans it forward and rebuilds every game that has
+ * not ended. A torn record at the end, left by a crash during a write, is cut
+ * off. A record that is damaged anywhere else makes opening fail instead, so
+ * the records after it are never thrown away.
+ */
+class game_log
+{
+public:
+	enum record_type : uint8_t
+	{
+		game_start = 1, game_move, game_end
+	};
+
+	enum result_t : uint16_t
+	{
+		white_win = 0, black_win, draw, aborted
+	};
+
+	/**
+	 * @brief A game that was started but not ended when the log was opened.
+	 */
+	struct live_game
+	{
+		board position;
+		std::string fen;	// the starting position, empty for the standard one
+		int moves = 0;
+	};
+
+	/**
+	 * @brief Open a log, creating it if it does not exist, and recover the
+	 * games in it.
+	 * @param path The path of the log
+	 * @throws std::runtime_error if the log cannot be opened, contains a
+	 * move that is illegal in its game, or a damaged record before its end
+	 */
+	explicit game_log(const std::string &path);
+
+	/**
+	 * @brief Write and flush everything that was logged, then close the log.
+	 */
+	~game_log();
+
+	game_log(const game_log &) = delete;
+	game_log &operator=(const game_log &) = delete;
+
+	/**
+	 * @brief Start a new game.
+	 * @param fen The starting position, or an empty string for the standard one
+	 * @return The id of the game, which is never reused within a log
+	 */
+	uint32_t start(const std::string &fen = "");
+
+	/**
+	 * @brief Log a move of a game. Moves of the same game must be logged from
+	 * one thread at a time, in the order they are played.
+	 * @param promotion One of the board::X_PROMOTION values, or 0
+	 */
+	void move(uint32_t game, int from, int to, int promotion = 0);
+
+	void end(uint32_t game, result_t result);
+
+	/**
+	 * @brief Block until everything this thread has logged is on disk.
+	 * @throws std::runtime_error if the log could not be written
+	 */
+	void sync();
+
+	/**
+	 * @brief The games that had not ended when the log was opened, by id.
+	 */
+	inline const std::map<uint32_t, live_game> &recovered() const
+	{ return live; }
+
+	static uint16_t encode_move(int from, int to, int promotion);
+	static void decode_move(uint16_t move, int &from, int &to, int &promotion);
+
+private:
+	struct node
+	{
+		std::atomic<node *> next {nullptr};
+		std::string bytes;
+		std::atomic<bool> *synced = nullptr;	// set once the record is on disk
+	};
+
+	int fd;
+	std::map<uint32_t, live_game> live;
+	std::atomic<uint32_t> next_id;
+
+	// multiple producer, single consumer queue, pushed at head and popped
+	// at tail, with a permanent stub node so push never needs a lock
+	std::atomic<node *> head;
+	node *tail;
+	std::atomic<uint64_t> queued;	// incremented by push, waited on by the writer
+	std::atomic<bool> closing, failed;
+	std::thread writer;
+
+	void recover(std::string_view data, std::size_t &valid);
+	void push(node *n);
+	void append(record_type type, uint16_t data, uint32_t game,
+				std::string_view payload = {});
+	void write_loop();
+};
+
+}
@@ -0,0 +1,163 @@
+#include "board.hpp"
+#include "game_log.hpp"
+#include "position_index.hpp"
+#include "replay.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " build [-t threads] [-f moves|pgn] "
+			  "index archive\n"
+			  "       " << name << " games index startpos|fen [moves...]\n"
+			  "       " << name << " stats index startpos|fen [moves...]\n"
+			  "build indexes every position of every game in the archive. "
+			  "games lists the games\n"
+			  "that reached a position, by their index in the archive and "
+			  "the ply, and stats\n"
+			  "counts the moves played from it. The position is the "
+			  "starting position or a FEN,\n"
+			  "followed by moves in coordinate notation." << std::endl;
+}
+
+std::string move_string(uint16_t move)
+{
+	int from, to, promotion;
+	chess::game_log::decode_move(move, from, to, promotion);
+	std::string s = chess::board::get_str(from) + chess::board::get_str(to);
+	switch (promotion)
+	{
+	case chess::board::QUEEN_PROMOTION: s += 'q'; break;
+	case chess::board::ROOK_PROMOTION: s += 'r'; break;
+	case chess::board::BISHOP_PROMOTION: s += 'b'; break;
+	case chess::board::KNIGHT_PROMOTION: s += 'n'; break;
+	default: break;
+	}
+	return s;
+}
+
+int build(int argc, char **argv)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	bool forced = false;
+	chess::game_format format = chess::game_format::moves;
+	std::vector<std::string> paths;
+
+	for (int i = 2; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "-t" and i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (arg == "-f" and i + 1 < argc)
+		{
+			forced = true;
+			format = std::string(argv[++i]) == "pgn" ? chess::game_format::pgn :
+					 chess::game_format::moves;
+		}
+		else if (arg[0] == '-')
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+			paths.push_back(arg);
+	}
+	if (paths.size() != 2)
+	{
+		usage(argv[0]);
+		return 0;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const chess::mapped_file archive(paths[1]);
+	const auto text = archive.view();
+	const auto summary = chess::position_index::build(
+		text, forced ? format : chess::detect_format(text), threads, paths[0]);
+	const double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	std::cout << summary.games << " games, " << summary.postings
+			  << " positions, " << summary.keys << " distinct, "
+			  << summary.errors << " games with illegal moves\n"
+			  << summary.bytes << " bytes (" << (summary.postings ?
+				 static_cast<double>(summary.bytes) / summary.postings : 0)
+			  << " per position) in " << seconds << " s on " << threads
+			  << " threads" << std::endl;
+	return 0;
+}
+
+int query(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		usage(argv[0]);
+		return 0;
+	}
+	const std::string command = argv[1];
+	const chess::position_index index(argv[2]);
+
+	const std::string position = argv[3];
+	chess::board b;
+	if (position != "startpos")
+		b = chess::board(position);
+	for (int i = 4; i < argc; ++i)
+		if (!chess::play_token(b, argv[i], chess::game_format::moves))
+		{
+			std::cerr << "illegal move " << argv[i] << std::endl;
+			return 1;
+		}
+
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	auto microseconds = [&] {
+		return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+	};
+
+	if (command == "games")
+	{
+		const auto postings = index.lookup(b.key());
+		const double elapsed = microseconds();
+		for (const auto &p : postings)
+			std::cout << p.game << '\t' << p.ply << '\t'
+					  << (p.move ? move_string(p.move) : "end") << '\n';
+		std::cout << postings.size() << " games in " << elapsed << " us"
+				  << std::endl;
+	}
+	else
+	{
+		const auto stats = index.move_stats(b.key());
+		const double elapsed = microseconds();
+		for (const auto &s : stats)
+			std::cout << move_string(s.move) << '\t' << s.count << '\n';
+		std::cout << stats.size() << " moves in " << elapsed << " us"
+				  << std::endl;
+	}
+	return 0;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	const std::string command = argc > 1 ? argv[1] : "";
+	try
+	{
+		if (command == "build")
+			return build(argc, argv);
+		if (command == "games" or command == "stats")
+			return query(argc, argv);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	usage(argv[0]);
+	return 0;
+}
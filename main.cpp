@@ -1,53 +1,125 @@
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 #include "board.hpp"
-#include <fstream>
+#include "replay.hpp"
 
-void test_print_board()
+void usage(const char *name)
 {
-	chess::board board;
-	std::cout << board;
-
+	std::cout << "Usage: " << name << " [-t threads] [-f moves|pgn] [-v] file..."
+			  << std::endl
+			  << "Replays every game in the files and reports the illegal "
+				 "moves. A moves file has\n"
+				 "games in coordinate notation, i.e. \"e2e4 e7e5\", each ending "
+				 "with \"quit\", or\n"
+				 "one per line if there is no \"quit\" in the file. The format "
+				 "is\n"
+				 "guessed from the contents unless given with -f. -v prints "
+				 "the final position of\n"
+				 "every game instead of a summary." << std::endl;
 }
 
-void play_cmd()
+int main(int argc, char **argv)
 {
-	std::ifstream file;
-	file.open("/home/hina/Code/chess/test.txt");
-	if (!file.is_open())
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	bool forced = false, verbose = false;
+	chess::game_format format = chess::game_format::moves;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "-t" and i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (arg == "-f" and i + 1 < argc)
+		{
+			forced = true;
+			format = std::string(argv[++i]) == "pgn" ? chess::game_format::pgn :
+					 chess::game_format::moves;
+		}
+		else if (arg == "-v")
+			verbose = true;
+		else if (arg[0] == '-')
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+			paths.push_back(arg);
+	}
+	if (paths.empty())
 	{
-		std::cout << "file not found" << std::endl;
-		return;
+		usage(argv[0]);
+		return 0;
 	}
-	chess::board board;
-	std::string cmd;
-	int from, to;
-	while (file.is_open())
+
+	std::size_t errors = 0;
+	for (const auto &path : paths)
 	{
-		file >> cmd;
-		if (cmd == "quit")
-			break;
 		try
 		{
-			from = chess::board::get_pos(cmd.substr(0, 2));
-			to = chess::board::get_pos(cmd.substr(2, 2));
+			chess::mapped_file file(path);
+			const auto text = file.view();
+			const auto fmt = forced ? format : chess::detect_format(text);
+
+			if (verbose)
+			{
+				// single threaded so the boards come out in order
+				for (auto game : chess::split_games(text, fmt))
+				{
+					chess::board board;
+					chess::move_tokenizer tokens(game, fmt);
+					std::string_view token;
+					bool first = true, bad_fen = false;
+					while (tokens.next(token))
+					{
+						if (first and !tokens.fen().empty())
+						{
+							// only this game is lost to a bad tag
+							try
+							{
+								board = chess::board(std::string(tokens.fen()));
+							}
+							catch (std::invalid_argument &e)
+							{
+								std::cout << e.what() << std::endl;
+								bad_fen = true;
+								++errors;
+								break;
+							}
+						}
+						first = false;
+						if (!chess::play_token(board, token, fmt))
+						{
+							std::cout << "Invalid move " << token << std::endl;
+							break;
+						}
+					}
+					if (!bad_fen)
+						std::cout << board() << std::endl << board << std::endl;
+				}
+				continue;
+			}
+
+			const auto summary = chess::replay_games(text, fmt, threads);
+			for (const auto &e : summary.errors)
+				std::cout << path << ": game " << e.game + 1 << ", ply "
+						  << e.ply + 1 << ": " << e.message << '\n';
+			std::cout << path << ": " << summary.games << " games, "
+					  << summary.moves << " moves, " << summary.errors.size()
+					  << " errors in " << summary.seconds << " s ("
+					  << summary.games / std::max(summary.seconds, 1e-9)
+					  << " games/s, "
+					  << summary.moves / std::max(summary.seconds, 1e-9)
+					  << " moves/s)" << std::endl;
+			errors += summary.errors.size();
 		}
-		catch (std::invalid_argument &e)
+		catch (std::exception &e)
 		{
-			std::cout << "invalid argument" << e.what() << std::endl;
-			continue;
+			std::cout << e.what() << std::endl;
+			++errors;
 		}
-
-		if (!board.move(from, to))
-			std::cout << "Invalid move" << std::endl;
-
-		std::cout << board() << std::endl;
-		std::cout << board << std::endl;
 	}
-}
-
-int main()
-{
-	play_cmd();
 
-	return 0;
+	return errors ? 1 : 0;
 }
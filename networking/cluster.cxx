@@ -0,0 +1,59 @@
+#include "coordinator.hpp"
+#include "worker.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+	const std::string mode = argc > 1 ? argv[1] : "";
+	if (argc < 3 or (mode != "worker" and argc < 4) or
+		(mode != "worker" and mode != "analyse" and mode != "perft"))
+	{
+		std::cout << "Usage: " << argv[0] << " worker [game code]\n"
+				  << "       " << argv[0] << " analyse [game code] [depth] [moves...]\n"
+				  << "       " << argv[0] << " perft [game code] [depth] [moves...]\n"
+				  << "Generate the game code with code_generator. Start the "
+					 "coordinator with analyse or perft, then any number of "
+					 "workers with the same code." << std::endl;
+		return 0;
+	}
+	const std::string code = argv[2];
+
+	if (mode == "worker")
+	{
+		try
+		{
+			networking::worker w(code);
+			std::cout << "Completed " << w.serve() << " work units" << std::endl;
+		}
+		catch (std::runtime_error &e)
+		{
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	const int depth = atoi(argv[3]);
+	std::vector<std::string> moves(argv + 4, argv + argc);
+
+	networking::coordinator c(code);
+	auto results = mode == "perft" ? c.perft(moves, depth) : c.analyse(moves, depth);
+
+	int64_t total = 0;
+	for (const auto &r : results)
+	{
+		std::cout << r.move << ": " << r.value << std::endl;
+		total += r.value;
+	}
+	if (mode == "perft")
+		std::cout << "Nodes searched: " << total << std::endl;
+	else if (!results.empty())
+	{
+		auto best = std::max_element(results.begin(), results.end(),
+			[](const auto &a, const auto &b) { return a.value < b.value; });
+		std::cout << "bestmove " << best->move << " score " << best->value << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,321 @@
+#include "coordinator.hpp"
+
+#include <algorithm>
+
+namespace networking {
+
+namespace {
+std::string bytes(const asio::const_buffer &buffer)
+{
+	return std::string(static_cast<const char *>(buffer.data()), buffer.size());
+}
+}
+
+coordinator::coordinator(const std::string &code)
+		: uid(codes::decode_uid(code)),
+		  port(codes::decode_port(code)),
+		  acceptor(io_context, tcp::endpoint(tcp::v4(), port)),
+		  remaining(0),
+		  next_id(0),
+		  workers(0),
+		  shutting_down(false)
+{
+	accept_thread = std::thread([this] { accept_loop(); });
+}
+
+coordinator::~coordinator()
+{
+	{
+		// only stop the reads of workers busy with a unit, so the threads
+		// serving them can still send the disconnect
+		std::lock_guard lock(mutex);
+		shutting_down = true;
+		for (auto &c : connections)
+		{
+			asio::error_code ec;
+			c.socket.shutdown(tcp::socket::shutdown_receive, ec);
+		}
+	}
+	work_ready.notify_all();
+	work_done.notify_all();
+
+	// wake the blocking accept with a connection of our own
+	asio::error_code ec;
+	tcp::socket wake(io_context);
+	wake.connect(tcp::endpoint(asio::ip::address_v4::loopback(), port), ec);
+	accept_thread.join();
+
+	for (auto &c : connections)
+		c.thread.join();
+	std::cout << "Coordinator closed" << std::endl;
+}
+
+std::size_t coordinator::worker_count() const
+{
+	std::lock_guard lock(mutex);
+	return workers;
+}
+
+bool coordinator::apply_move(chess::board &b, const std::string &move)
+{
+	using status = chess::board::move_status;
+	chess::board::move_t m;
+	int promotion;
+	return chess::board::parse_coordinates(move, m, promotion) == status::ok and
+		   b.play(m, promotion) == status::ok;
+}
+
+std::vector<coordinator::unit_result> coordinator::analyse(
+	const std::vector<std::string> &moves, int depth)
+{
+	return run(moves, depth, task::search);
+}
+
+std::vector<coordinator::unit_result> coordinator::perft(
+	const std::vector<std::string> &moves, int depth)
+{
+	return run(moves, depth, task::perft);
+}
+
+std::vector<coordinator::unit_result> coordinator::run(
+	const std::vector<std::string> &moves, int depth, task kind)
+{
+	if (depth < 1 or depth > 255)
+		throw std::invalid_argument("depth must be between 1 and 255");
+
+	chess::board root;
+	for (const auto &m : moves)
+		if (!apply_move(root, m))
+			throw std::invalid_argument("illegal move " + m);
+
+	std::vector<uint16_t> ids;
+	std::vector<unit_result> results;
+	{
+		std::lock_guard lock(mutex);
+		auto add = [&](chess::board::move_t m, int promotion) {
+			char str[chess::board::MOVE_CHARS];
+			const std::string move(str,
+				chess::board::format_move(m, promotion, str));
+			unit u {moves, static_cast<uint8_t>(depth), kind, 0, false, 0};
+			u.path.push_back(move);
+
+			const uint16_t id = next_id++;
+			units[id] = std::move(u);
+			pending.push_back(id);
+			ids.push_back(id);
+			results.push_back({move, 0});
+		};
+		// every promotion is a root move of its own
+		for (auto m : root.legal_moves())
+			if (root.is_promotion(m.first, m.second))
+				for (int promotion : {chess::board::QUEEN_PROMOTION,
+									  chess::board::ROOK_PROMOTION,
+									  chess::board::BISHOP_PROMOTION,
+									  chess::board::KNIGHT_PROMOTION})
+					add(m, promotion);
+			else
+				add(m, 0);
+		remaining += ids.size();
+	}
+	work_ready.notify_all();
+
+	std::unique_lock lock(mutex);
+	work_done.wait(lock, [&] {
+		return shutting_down or std::all_of(ids.begin(), ids.end(),
+			[this](uint16_t id) { return units[id].done; });
+	});
+	for (std::size_t i = 0; i < ids.size(); ++i)
+	{
+		const unit &u = units[ids[i]];
+		// the workers score the position after the root move
+		results[i].value = kind == task::search ? -u.value : u.value;
+		units.erase(ids[i]);
+	}
+	return results;
+}
+
+void coordinator::accept_loop()
+{
+	while (true)
+	{
+		tcp::socket socket(io_context);
+		asio::error_code ec;
+		acceptor.accept(socket, ec);
+
+		std::lock_guard lock(mutex);
+		if (shutting_down)
+			break;
+		if (ec)
+		{
+			std::cerr << ec.message() << std::endl;
+			continue;
+		}
+		prune();
+		connection &c = connections.emplace_back(io_context);
+		c.socket = std::move(socket);
+		c.thread = std::thread([this, &c] { serve(c); });
+	}
+}
+
+void coordinator::prune()
+{
+	// a finished thread only has to return, so joining it does not block
+	for (auto it = connections.begin(); it != connections.end();)
+		if (it->finished)
+		{
+			it->thread.join();
+			it = connections.erase(it);
+		}
+		else
+			++it;
+}
+
+bool coordinator::handshake(tcp::socket &socket)
+{
+	// the same exchange a master makes with a slave
+	char msg[handler::MSG_SIZE];
+	asio::error_code ec;
+	asio::read(socket, asio::buffer(msg, handler::MSG_SIZE), ec);
+	if (ec or static_cast<header>(msg[0]) != header::connection_request or
+		uid != (static_cast<uint8_t>(msg[1]) << 8 | static_cast<uint8_t>(msg[2])))
+		return false;
+
+	asio::write(socket, handler::to_buffer(header::board_hash, chess::board()()), ec);
+	return !ec;
+}
+
+void coordinator::serve(connection &c)
+{
+	tcp::socket &socket = c.socket;
+	if (!handshake(socket))
+	{
+		std::lock_guard lock(mutex);
+		c.finished = true;
+		return;
+	}
+	{
+		std::lock_guard lock(mutex);
+		++workers;
+	}
+	std::cout << "Worker joined" << std::endl;
+
+	uint16_t id;
+	unit u;
+	while (next_unit(id, u))
+	{
+		// send the whole unit in a single write
+		std::string batch = bytes(handler::to_buffer(header::new_position, "    "));
+		for (const auto &m : u.path)
+		{
+			if (m.size() > 4)
+				batch += bytes(handler::to_buffer(header::move,
+												  m.substr(4) + "   "));
+			batch += bytes(handler::to_buffer(header::move, m.substr(0, 4)));
+		}
+		batch += bytes(handler::to_buffer(header::work,
+			static_cast<uint32_t>(id) << 16 | static_cast<uint32_t>(u.depth) << 8 |
+			static_cast<uint32_t>(u.kind)));
+
+		asio::error_code ec;
+		asio::write(socket, asio::buffer(batch), ec);
+
+		// a result message followed by the high and low half of the value
+		char reply[3 * handler::MSG_SIZE];
+		if (!ec)
+			asio::read(socket, asio::buffer(reply, sizeof(reply)), ec);
+		if (ec or static_cast<header>(reply[0]) != header::result or
+			handler::to_uint32(reply + 1) >> 16 != id)
+		{
+			release(id);
+			break;
+		}
+
+		const uint64_t value =
+			static_cast<uint64_t>(handler::to_uint32(reply + handler::MSG_SIZE + 1)) << 32 |
+			handler::to_uint32(reply + 2 * handler::MSG_SIZE + 1);
+		complete(id, static_cast<int64_t>(value));
+	}
+
+	bool closing;
+	{
+		std::lock_guard lock(mutex);
+		closing = shutting_down;
+	}
+	if (closing)
+	{
+		asio::error_code ec;
+		asio::write(socket, handler::to_buffer(header::disconnect, "    "), ec);
+	}
+
+	std::lock_guard lock(mutex);
+	--workers;
+	if (!closing)
+		std::cout << "Worker left" << std::endl;
+	c.finished = true;
+}
+
+bool coordinator::next_unit(uint16_t &id, unit &u)
+{
+	std::unique_lock lock(mutex);
+
+	auto straggler = [this] {
+		auto best = units.end();
+		for (auto it = units.begin(); it != units.end(); ++it)
+			if (!it->second.done and it->second.copies < MAX_COPIES and
+				(best == units.end() or it->second.copies < best->second.copies))
+				best = it;
+		return best;
+	};
+
+	work_ready.wait(lock, [&] {
+		return shutting_down or !pending.empty() or
+			   (remaining and straggler() != units.end());
+	});
+	if (shutting_down)
+		return false;
+
+	if (!pending.empty())
+	{
+		id = pending.front();
+		pending.pop_front();
+	}
+	else
+		id = straggler()->first;
+
+	unit &chosen = units[id];
+	++chosen.copies;
+	u = chosen;
+	return true;
+}
+
+void coordinator::release(uint16_t id)
+{
+	{
+		std::lock_guard lock(mutex);
+		auto it = units.find(id);
+		if (it == units.end())
+			return;
+		if (--it->second.copies == 0 and !it->second.done)
+			pending.push_front(id);
+	}
+	work_ready.notify_one();
+}
+
+void coordinator::complete(uint16_t id, int64_t value)
+{
+	{
+		std::lock_guard lock(mutex);
+		auto it = units.find(id);
+		if (it == units.end())
+			return;
+		--it->second.copies;
+		if (it->second.done)
+			return;
+		it->second.done = true;
+		it->second.value = value;
+		--remaining;
+	}
+	work_done.notify_all();
+}
+
+}
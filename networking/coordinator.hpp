@@ -0,0 +1,157 @@
+#pragma once
+
+#include "handler.hpp"
+#include "../board.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace networking {
+
+/**
+ * @brief The coordinator of a distributed search. It listens on the port of
+ * the game code like a master, but accepts any number of workers, at any time.
+ * A search is split into one work unit per root move which are handed to idle
+ * workers and merged once every unit has a result.
+ *
+ * A position is sent to a worker as the moves from the starting position,
+ * each as a move message, followed by a work message. A move message holds
+ * four characters, so a promotion is preceded by a move message carrying only
+ * its letter, i.e. "n   " before "e7e8". The worker answers with
+ * a result message and two value messages carrying a 64-bit value.
+ *
+ * Units held by a worker that disconnects are handed to the next idle worker.
+ * Once nothing is left to hand out, idle workers are given a second copy of
+ * an unfinished unit and the first result wins, so one slow machine does not
+ * hold up the whole search.
+ */
+class coordinator
+{
+public:
+	/**
+	 * @brief The kind of work in a work unit.
+	 */
+	enum class task : uint8_t
+	{
+		search = 0, perft
+	};
+
+	/**
+	 * @brief The result of the work unit for one root move.
+	 */
+	struct unit_result
+	{
+		std::string move;	// the root move in UCI notation, i.e. "e2e4",
+							// with every promotion a move of its own
+		int64_t value;		// score for the side to move at the root, or the
+							// number of leaf nodes for perft
+	};
+
+	/**
+	 * @brief Start listening for workers on the port of the game code.
+	 * @param code The game code. Workers must connect with the same code.
+	 */
+	coordinator(const std::string &code);
+	~coordinator();
+
+	/**
+	 * @brief Search every root move to a depth on the workers. Blocks until
+	 * every root move has a score, waiting for workers to join if there are
+	 * none.
+	 * @param moves The moves from the starting position in UCI notation.
+	 * Promotions are to a queen unless a letter is given, i.e. "e7e8n".
+	 * @param depth The depth in plies, including the root move
+	 * @return The score of every root move
+	 * @throws std::invalid_argument if one of the moves is illegal
+	 */
+	std::vector<unit_result> analyse(const std::vector<std::string> &moves,
+									 int depth);
+
+	/**
+	 * @brief Count the leaf nodes below every root move on the workers.
+	 * @param moves The moves from the starting position in UCI notation.
+	 * @param depth The depth in plies, including the root move
+	 * @return The leaf count of every root move
+	 * @throws std::invalid_argument if one of the moves is illegal
+	 */
+	std::vector<unit_result> perft(const std::vector<std::string> &moves,
+								   int depth);
+
+	/**
+	 * @brief The number of workers currently connected.
+	 */
+	std::size_t worker_count() const;
+
+	/**
+	 * @brief Play a move in UCI notation on a board, promoting to a queen
+	 * unless a letter is given.
+	 * @return true if the move was legal and played, false otherwise
+	 */
+	static bool apply_move(chess::board &b, const std::string &move);
+
+private:
+	using tcp = asio::ip::tcp;
+
+	/**
+	 * A unit is never handed out more than this many times at once
+	 */
+	static constexpr int MAX_COPIES = 2;
+
+	struct unit
+	{
+		std::vector<std::string> path;	// moves from the starting position
+		uint8_t depth;
+		task kind;
+		int copies;						// number of workers holding it
+		bool done;
+		int64_t value;
+	};
+
+	uint16_t uid;
+	uint16_t port;
+	asio::io_context io_context;
+	tcp::acceptor acceptor;
+
+	mutable std::mutex mutex;
+	std::condition_variable work_ready, work_done;
+	std::map<uint16_t, unit> units;
+	std::deque<uint16_t> pending;
+	std::size_t remaining;
+	uint16_t next_id;
+	std::size_t workers;
+	bool shutting_down;
+
+	/**
+	 * @brief A worker's socket and the thread serving it, which is the only
+	 * one to read or write the socket.
+	 */
+	struct connection
+	{
+		tcp::socket socket;
+		std::thread thread;
+		bool finished = false;	// the thread is done with the socket
+
+		explicit connection(asio::io_context &io) : socket(io) {}
+	};
+
+	std::list<connection> connections;	// kept until their thread finishes
+	std::thread accept_thread;
+
+	void accept_loop();
+	void prune();
+	void serve(connection &c);
+	bool handshake(tcp::socket &socket);
+	bool next_unit(uint16_t &id, unit &u);
+	void release(uint16_t id);
+	void complete(uint16_t id, int64_t value);
+	std::vector<unit_result> run(const std::vector<std::string> &moves,
+								 int depth, task kind);
+};
+
+}
@@ -0,0 +1,91 @@
+#include "frame.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace networking {
+
+namespace frames {
+
+void append(std::string &out, header h, std::string_view payload)
+{
+	if (payload.size() > MAX_PAYLOAD)
+		throw std::invalid_argument("Frame payload too long");
+	out += static_cast<char>(payload.size() >> 8);
+	out += static_cast<char>(payload.size() & 0xFF);
+	out += static_cast<char>(h);
+	out += payload;
+}
+
+std::string move_payload(std::string_view move, int64_t clock)
+{
+	std::string payload;
+	payload += static_cast<char>(move.size());
+	payload += move;
+	if (clock >= 0)
+	{
+		const auto c = static_cast<uint32_t>(clock);
+		payload += static_cast<char>(c >> 24);
+		payload += static_cast<char>(c >> 16);
+		payload += static_cast<char>(c >> 8);
+		payload += static_cast<char>(c & 0xFF);
+	}
+	return payload;
+}
+
+bool parse_move(std::string_view payload, std::string_view &move,
+				int64_t &clock)
+{
+	if (payload.empty())
+		return false;
+	const std::size_t n = static_cast<uint8_t>(payload[0]);
+	if (n < 4 or n > 5 or payload.size() < 1 + n)
+		return false;
+	move = payload.substr(1, n);
+	const std::string_view rest = payload.substr(1 + n);
+	if (rest.empty())
+		clock = -1;
+	else if (rest.size() == 4)
+		clock = handler::to_uint32(rest.data());
+	else
+		return false;
+	return true;
+}
+
+char *reader::prepare(std::size_t n)
+{
+	// move what is left of a partial frame to the front, keeping the size so
+	// the buffer is only ever grown, and then only once
+	if (begin)
+	{
+		std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+	}
+	if (buffer.size() < end + n)
+		buffer.resize(end + n);
+	return buffer.data() + end;
+}
+
+void reader::commit(std::size_t n)
+{
+	end += n;
+}
+
+bool reader::next(header &h, std::string_view &payload)
+{
+	if (end - begin < HEADER_SIZE)
+		return false;
+	const std::size_t size = static_cast<uint8_t>(buffer[begin]) << 8 |
+							 static_cast<uint8_t>(buffer[begin + 1]);
+	if (end - begin < HEADER_SIZE + size)
+		return false;
+	h = static_cast<header>(buffer[begin + 2]);
+	payload = std::string_view(buffer.data() + begin + HEADER_SIZE, size);
+	begin += HEADER_SIZE + size;
+	return true;
+}
+
+}
+
+}
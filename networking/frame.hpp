@@ -0,0 +1,91 @@
+#pragma once
+
+#include "handler.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace networking {
+
+/**
+ * @brief The length-prefixed protocol.
+ *
+ * A client asks for it instead of sending a connection request, with a
+ * 5-byte hello message: the hello header, the highest protocol version it
+ * speaks and the unique ID of the game, both 2 bytes in network byte order.
+ * The server answers with a hello message carrying the version both will use,
+ * and from then on everything in both directions is a frame:
+ * 	- the length of the payload, 2 bytes in network byte order
+ * 	- the header, 1 byte
+ * 	- the payload
+ *
+ * Payloads:
+ * 	- move: the length of the move, the move in coordinate notation with an
+ * 	optional promotion letter, i.e. "e7e8n", and optionally the mover's clock
+ * 	in milliseconds as 4 bytes. See move_payload().
+ * 	- fen: empty to ask for the position, or the FEN of the position.
+ * 	- chat: text.
+ * 	- metadata: a key and a value separated by a zero byte.
+ * 	- token: 8 bytes, from a server. See server.hpp.
+ * 	- resume: the token and a ply, 2 bytes, from a client, and the ply alone
+ * 	from a server. See server.hpp.
+ * 	- any other header: the same 4 bytes as in a fixed-size message.
+ */
+namespace frames {
+	constexpr uint16_t LEGACY_VERSION = 1;	// fixed-size messages
+	constexpr uint16_t VERSION = 2;			// the length-prefixed protocol
+	constexpr std::size_t HEADER_SIZE = 3;
+	constexpr std::size_t MAX_PAYLOAD = UINT16_MAX;
+
+	/**
+	 * @brief Append a frame to a buffer, so any number of frames can be sent
+	 * with a single write.
+	 * @throws std::invalid_argument if the payload is too long
+	 */
+	void append(std::string &out, header h, std::string_view payload);
+
+	/**
+	 * @brief The payload of a move message.
+	 * @param move The move in coordinate notation, with an optional promotion
+	 * letter
+	 * @param clock The mover's clock in milliseconds, or -1 to leave it out
+	 */
+	std::string move_payload(std::string_view move, int64_t clock = -1);
+
+	/**
+	 * @brief Split the payload of a move message.
+	 * @param clock Set to the clock, or -1 if there is none
+	 * @return false if the payload is malformed
+	 */
+	bool parse_move(std::string_view payload, std::string_view &move,
+					int64_t &clock);
+
+	/**
+	 * @brief Splits a stream of bytes into frames. Bytes are added as they
+	 * arrive, and a frame is only returned once all of it has arrived.
+	 */
+	class reader
+	{
+	public:
+		/**
+		 * @brief Space for at least n more bytes, to be read into directly.
+		 * Call commit() with the number actually read.
+		 */
+		char *prepare(std::size_t n);
+		void commit(std::size_t n);
+
+		/**
+		 * @brief Take the next complete frame.
+		 * @param payload Valid until the next call to prepare()
+		 * @return false if no complete frame is buffered
+		 */
+		bool next(header &h, std::string_view &payload);
+
+	private:
+		std::string buffer;
+		std::size_t begin = 0, end = 0;
+	};
+}
+
+}
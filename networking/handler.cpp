@@ -1,4 +1,9 @@
 #include "handler.hpp"
+#include "frame.hpp"
+#include "../trace.hpp"
+
+#include <algorithm>
+#include <span>
 
 namespace networking {
 
@@ -6,58 +11,349 @@ handler::handler(const std::string &code)
 		: server_ip(codes::decode_ip(code)),
 		  server_port(codes::decode_port(code)),
 		  socket(io_context),
-		  connected(false)
+		  connected(false),
+		  events(0),
+		  listener_parked(false),
+		  version(frames::LEGACY_VERSION),
+		  outgoing_count(0),
+		  queued_count(0),
+		  token(0)
 {
-	data.resize(MSG_SIZE);
 }
 
 void handler::listener()
 {
-	while(connected)
+	// fixed-size messages are read into a buffer of their own, frames into
+	// the frame reader
+	std::array<char, 64 * MSG_SIZE> buffer;
+	std::size_t filled = 0;
+	frames::reader frames_in;
+	constexpr std::size_t READ_SIZE = 4096;
+	chess::trace::name_thread("listener");
+	while (connected)
 	{
-		while (data_ready)
-			;
-		asio::read(socket, asio::buffer(data, MSG_SIZE));
-		log_error();
-		if (static_cast<header>(data[0]) == header::disconnect)
+		char *const into = version >= frames::VERSION
+			? frames_in.prepare(READ_SIZE) : buffer.data() + filled;
+		const std::size_t room = version >= frames::VERSION
+			? READ_SIZE : buffer.size() - filled;
+		asio::error_code ec;
+		std::size_t n;
+		if (local)
 		{
-			std::cout << "Client has disconnected" << std::endl;
-			connected = false;
+			n = local->read_some(into, room);
+			if (!n)
+				ec = asio::error::eof;
 		}
 		else
-			data_ready = true;
+			n = socket.read_some(asio::buffer(into, room), ec);
+		if (ec)
+		{
+			// the other side closing the connection is not an error
+			if (connected and ec != asio::error::eof)
+			{
+				error_code = ec;
+				log_error();
+			}
+			break;
+		}
+
+		chess::trace::span receive("receive", "network", "bytes", n);
+		stats.received(n);
+		message m;
+		m.received = std::chrono::steady_clock::now();
+		if (version >= frames::VERSION)
+		{
+			frames_in.commit(n);
+			std::string_view payload;
+			while (connected and frames_in.next(m.head, payload))
+			{
+				m.body.assign(payload);
+				if (!deliver(m))
+					break;
+			}
+		}
+		else
+		{
+			filled += n;
+			std::size_t used = 0;
+			for (; filled - used >= MSG_SIZE and connected; used += MSG_SIZE)
+			{
+				m.head = static_cast<header>(buffer[used]);
+				m.body.assign(buffer.data() + used + 1, MSG_SIZE - 1);
+				if (!deliver(m))
+					break;
+			}
+			std::copy(buffer.begin() + used, buffer.begin() + filled,
+					  buffer.begin());
+			filled -= used;
+		}
+		wake();
 	}
+	connected = false;
+	wake();
+}
+
+bool handler::deliver(message &m)
+{
+	// pings are answered and pongs timed here, and neither is read
+	if (m.head == header::ping or m.head == header::pong)
+	{
+		stats.delivered(0);
+		if (m.body.size() != MSG_SIZE - 1)
+			return connected;
+		if (m.head == header::ping)
+			echo(m);
+		else
+			stats.pong(to_uint32(m.body.data()));
+		return connected;
+	}
+
+	if (m.head == header::token)
+	{
+		stats.delivered(0);
+		if (m.body.size() == 8)
+			token = static_cast<uint64_t>(to_uint32(m.body.data())) << 32 |
+					to_uint32(m.body.data() + 4);
+		return connected;
+	}
+
+	if (m.head == header::disconnect)
+	{
+		std::cout << "Client has disconnected" << std::endl;
+		connected = false;
+		return false;
+	}
+
+	while (!inbox.try_push(m) and connected)
+	{
+		// let a waiting reader drain the queue, and park until it has made
+		// room, checking again after announcing it so a read in between is
+		// not missed
+		wake();
+		const uint32_t seen = events.load();
+		listener_parked = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (inbox.try_push(m))
+		{
+			listener_parked = false;
+			break;
+		}
+		events.wait(seen);
+		listener_parked = false;
+	}
+	stats.delivered(inbox.size());
+	return connected;
+}
+
+void handler::echo(const message &ping)
+{
+	std::string pong;
+	if (version >= frames::VERSION)
+		frames::append(pong, header::pong, ping.body);
+	else
+	{
+		pong += static_cast<char>(header::pong);
+		pong += ping.body;
+	}
+
+	std::lock_guard<std::mutex> lock(write_mutex);
+	if (local)
+		local->write(pong.data(), pong.size());
+	else
+	{
+		asio::error_code ec;
+		asio::write(socket, asio::buffer(pong), ec);
+	}
+	stats.echoed(pong.size());
 }
 
 void handler::send(const asio::const_buffer &msg)
 {
-	asio::write(socket, msg);
+	chess::trace::span sending("send", "network", "bytes", msg.size());
+	std::lock_guard<std::mutex> lock(write_mutex);
+	const auto start = std::chrono::steady_clock::now();
+	if (local)
+		local->write(static_cast<const char *>(msg.data()), msg.size());
+	else
+		asio::write(socket, msg);
+	stats.sent(1, msg.size(), std::chrono::steady_clock::now() - start);
+	log_error();
+}
+
+void handler::queue(header h, std::string_view payload)
+{
+	if (version >= frames::VERSION)
+	{
+		frames::append(outgoing, h, payload);
+		++outgoing_count;
+	}
+	else if (payload.size() == MSG_SIZE - 1)
+	{
+		packet *p = pool.acquire();
+		if (!p)
+		{
+			flush();
+			p = pool.acquire();
+		}
+		p->encode(h, payload);
+		queued[queued_count++] = p;
+	}
+	else
+		throw std::invalid_argument("The payload must be 4 bytes long "
+									"without frames");
+}
+
+void handler::queue_move(std::string_view move, int64_t clock)
+{
+	if (version >= frames::VERSION)
+		queue(header::move, frames::move_payload(move, clock));
+	else
+		queue(header::move, move.substr(0, MSG_SIZE - 1));
+}
+
+void handler::flush()
+{
+	const std::size_t messages = outgoing_count + queued_count;
+	if (!messages)
+		return;
+	const std::size_t bytes = outgoing.size() + queued_count * MSG_SIZE;
+	outgoing_count = 0;
+
+	chess::trace::span sending("send", "network", "bytes", bytes);
+	std::lock_guard<std::mutex> lock(write_mutex);
+	const auto start = std::chrono::steady_clock::now();
+	if (local)
+	{
+		// the ring takes each message as it is, so there is nothing to gather
+		local->write(outgoing.data(), outgoing.size());
+		outgoing.clear();
+		for (std::size_t i = 0; i < queued_count; ++i)
+		{
+			local->write(queued[i]->bytes.data(), queued[i]->bytes.size());
+			pool.release(queued[i]);
+		}
+		queued_count = 0;
+		stats.sent(messages, bytes, std::chrono::steady_clock::now() - start);
+		return;
+	}
+	if (!outgoing.empty())
+	{
+		asio::write(socket, asio::buffer(outgoing), error_code);
+		outgoing.clear();
+		log_error();
+	}
+	if (queued_count)
+	{
+		std::array<asio::const_buffer, POOL_SIZE> buffers;
+		for (std::size_t i = 0; i < queued_count; ++i)
+			buffers[i] = asio::buffer(queued[i]->bytes);
+		asio::write(socket,
+			std::span<const asio::const_buffer>(buffers.data(), queued_count),
+			error_code);
+		for (std::size_t i = 0; i < queued_count; ++i)
+			pool.release(queued[i]);
+		queued_count = 0;
+		log_error();
+	}
+	stats.sent(messages, bytes, std::chrono::steady_clock::now() - start);
+}
+
+void handler::ping()
+{
+	const uint32_t sequence = stats.ping();
+	const char body[MSG_SIZE - 1] = {
+		static_cast<char>(sequence >> 24), static_cast<char>(sequence >> 16),
+		static_cast<char>(sequence >> 8), static_cast<char>(sequence & 0xFF)};
+	queue(header::ping, std::string_view(body, sizeof(body)));
+}
+
+std::string handler::metrics_snapshot(connection_metrics::format f) const
+{
+	return stats.snapshot(f, inbox.size());
+}
+
+void handler::set_no_delay(bool no_delay)
+{
+	socket.set_option(tcp::no_delay(no_delay), error_code);
 	log_error();
 }
 
+void handler::wake()
+{
+	events.fetch_add(1, std::memory_order_release);
+	events.notify_all();
+}
+
+bool handler::pop(message &m)
+{
+	if (!inbox.try_pop(m))
+		return false;
+	stats.read(m.received);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (listener_parked)
+		wake();
+	return true;
+}
+
 bool handler::read(header &head, std::string &body)
 {
-	if (!data_ready)
+	message m;
+	if (!pop(m))
 		return false;
-	head = *(header*)(data.substr(0, sizeof(header)).c_str());
-	body = data.substr(sizeof(header));
-	data_ready = false;
+	head = m.head;
+	body = std::move(m.body);
 	return true;
 }
 
+std::size_t handler::read(std::vector<message> &messages)
+{
+	std::size_t count = 0;
+	for (message m; pop(m); ++count)
+		messages.push_back(std::move(m));
+	return count;
+}
+
+bool handler::wait(header &head, std::string &body)
+{
+	while (true)
+	{
+		const uint32_t seen = events.load(std::memory_order_acquire);
+		if (read(head, body))
+			return true;
+		if (!connected)
+			return false;
+		events.wait(seen, std::memory_order_acquire);
+	}
+}
+
+void handler::disconnect()
+{
+	connected = false;
+	if (local)
+		local->close();
+	wake();
+}
+
 void handler::log_error (std::ostream &err_stream) const
 {
 	if (error_code)
 		err_stream << error_code.message() << std::endl;
 }
 
+namespace {
+/**
+ * @brief Storage for to_buffer() that outlives the call, so the returned
+ * asio::const_buffer does not point into a destroyed temporary.
+ */
+thread_local packet stable_packet;
+}
+
 asio::const_buffer handler::to_buffer(header h, const std::string &data4)
 {
 	if (data4.size() != 4)
 		throw std::invalid_argument("data4 must be 4 bytes long");
-	std::stringstream ss;
-	ss << static_cast<char>(h) << data4;
-	return asio::buffer(ss.str(), MSG_SIZE);
+	stable_packet.encode(h, data4);
+	return asio::buffer(stable_packet.bytes);
 }
 
 asio::const_buffer handler::to_buffer(header h, uint16_t code)
@@ -66,23 +362,29 @@ asio::const_buffer handler::to_buffer(header h, uint16_t code)
 		throw std::invalid_argument("Header must be connection_request to "
 									"send a code. To send a move, use a "
 									"string instead like \"d2d4\"");
-	std::stringstream ss;
-	ss << static_cast<char>(h) << static_cast<char>(code >> 8)
-	   << static_cast<char>(code & 0xFF) << '\0' << '\0';
-	return asio::buffer(ss.str(), MSG_SIZE);
+	stable_packet.encode(h, code);
+	return asio::buffer(stable_packet.bytes);
 }
 
 asio::const_buffer handler::to_buffer(header h, uint32_t hash)
 {
-	if (h != header::board_hash)
-		throw std::invalid_argument("Header must be board_hash to send a "
-									"hash. To send a move, use a string "
-									"instead like \"d2d4\"");
-	std::stringstream ss;
-	ss << static_cast<char>(h) << static_cast<char>(hash >> 24)
-	   << static_cast<char>(hash >> 16) << static_cast<char>(hash >> 8)
-	   << static_cast<char>(hash & 0xFF);
-	return asio::buffer(ss.str(), MSG_SIZE);
+	if (h != header::board_hash and h != header::work and
+		h != header::result and h != header::value)
+		throw std::invalid_argument("Header must be board_hash, work, result "
+									"or value to send an integer. To send a "
+									"move, use a string instead like "
+									"\"d2d4\"");
+	stable_packet.encode(h, hash);
+	return asio::buffer(stable_packet.bytes);
+}
+
+uint32_t handler::to_uint32(const char *data4)
+{
+	const auto *bytes = reinterpret_cast<const uint8_t *>(data4);
+	return static_cast<uint32_t>(bytes[0]) << 24 |
+		   static_cast<uint32_t>(bytes[1]) << 16 |
+		   static_cast<uint32_t>(bytes[2]) << 8 |
+		   static_cast<uint32_t>(bytes[3]);
 }
 
 namespace codes {
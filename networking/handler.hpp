@@ -1,9 +1,20 @@
 #pragma once
 
+#include "metrics.hpp"
+#include "packet.hpp"
+#include "shm_transport.hpp"
+#include "spsc_ring.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 #define ASIO_STANDALONE
 #include <asio.hpp>
@@ -17,7 +28,9 @@ namespace networking {
  */
 enum class header : uint8_t
 {
-	connection_request, board_hash, move, game_over, reject, disconnect
+	connection_request, board_hash, move, game_over, reject, disconnect,
+	new_position, work, result, value, hello, fen, chat, metadata, watch,
+	sync, resync, delta, ping, pong, token, resume
 };
 
 /**
@@ -30,10 +43,23 @@ enum class header : uint8_t
  */
 class handler
 {
-protected:
+public:
+	static_assert(packet::SIZE == 5);
 	static constexpr std::size_t MSG_SIZE = 5; // The size of each message
+	static constexpr std::size_t QUEUE_SIZE = 256; // Messages held unread
+	static constexpr std::size_t POOL_SIZE = 64; // Messages queued to be sent
+
+	/**
+	 * @brief A decoded message. The body is 4 bytes long for fixed-size
+	 * messages, and the whole payload for frames.
+	 */
+	struct message
+	{
+		header head;
+		std::string body;
+		std::chrono::steady_clock::time_point received {};	// by the listener
+	};
 
-public:
 	virtual ~handler() = default;
 
 	/**
@@ -41,10 +67,10 @@ public:
 	 * on a separate thread as it is blocking. It will not return until the
 	 * handler is disconnected.
 	 *
-	 * Once the listener receives a message, it will set the data_ready flag to
-	 * true, and it will stop receiving messages until the flag is set to
-	 * false by reading the data.
-	 *
+	 * The listener takes as many messages as have arrived with each read from
+	 * the socket, or shared memory, and queues them for read(). It sleeps in
+	 * the read while nothing arrives, and parks when QUEUE_SIZE messages are
+	 * waiting to be read, so it never uses CPU while idle.
 	 */
 	void listener();
 
@@ -56,9 +82,82 @@ public:
 	void send(const asio::const_buffer &msg);
 
 	/**
-	 * @brief Attempt to read the message received from the server, then if
-	 * successful, set the data_ready flag to false to allow the listener to read
-	 * more data.
+	 * @brief Queue a message to be sent by the next flush(), so any number of
+	 * messages go out in a single write. Only one thread may queue and flush.
+	 *
+	 * Fixed-size messages are encoded in place into packets from the
+	 * connection's pool and sent with one gathered write, so nothing is
+	 * allocated. The queue is flushed early when the pool runs out.
+	 *
+	 * @param payload The payload of a frame, or the 4-byte body of a
+	 * fixed-size message if the connection does not use frames.
+	 * @throws std::invalid_argument if the payload does not fit the protocol
+	 */
+	void queue(header h, std::string_view payload);
+
+	/**
+	 * @brief Queue a move, with the mover's clock if the connection uses
+	 * frames. The clock and promotion letter are left out otherwise.
+	 * @param move The move in coordinate notation, i.e. "e7e8q"
+	 * @param clock The clock in milliseconds, or -1 for none
+	 */
+	void queue_move(std::string_view move, int64_t clock = -1);
+
+	/**
+	 * @brief Write everything queued.
+	 */
+	void flush();
+
+	/**
+	 * @brief Queue a ping carrying a new sequence number, which the other
+	 * side's listener echoes at once in a pong. The listener here times the
+	 * pong for the round trip histogram of metrics(), and neither message is
+	 * ever read. The caller flushes. Both sides should turn Nagle's
+	 * algorithm off with set_no_delay(), or pongs can wait for an ACK.
+	 */
+	void ping();
+
+	/**
+	 * @brief The token a server gave this connection to resume the game with
+	 * if the connection drops, or 0 if it has not given one.
+	 */
+	uint64_t session_token() const { return token.load(); }
+
+	/**
+	 * @brief The counters of this connection: messages and bytes each way,
+	 * when the last ones went, the round trip of pings, how long writes take,
+	 * how long messages wait to be read and how many do, and connections made.
+	 */
+	const connection_metrics &metrics() const { return stats; }
+
+	/**
+	 * @brief A snapshot of metrics(), as text or JSON. Can be taken from any
+	 * thread at any time.
+	 */
+	std::string metrics_snapshot(connection_metrics::format f =
+									 connection_metrics::format::text) const;
+
+	/**
+	 * @brief Turn Nagle's algorithm off, so small messages go out at once
+	 * instead of waiting to be combined with later ones.
+	 */
+	void set_no_delay(bool no_delay);
+
+	/**
+	 * @brief The protocol version agreed on with the other side. See
+	 * frame.hpp.
+	 */
+	uint16_t protocol_version() const { return version; }
+
+	/**
+	 * @brief Whether messages go through shared memory instead of the socket.
+	 * See shm_transport.hpp.
+	 */
+	bool shared_memory() const { return local != nullptr; }
+
+	/**
+	 * @brief Attempt to read the oldest message received from the server.
+	 * Does not block. Only one thread may read from a handler.
 	 * @param head the header of the message read. Not modified if no message is
 	 * available.
 	 * @param body the body of the message read. Not modified if no message is
@@ -68,11 +167,26 @@ public:
 	 */
 	bool read(header &head, std::string &body);
 
+	/**
+	 * @brief Read every message that has been received so far. Does not block.
+	 * @param messages The messages are appended here, oldest first.
+	 * @return The number of messages read.
+	 */
+	std::size_t read(std::vector<message> &messages);
+
+	/**
+	 * @brief Block until a message has been received, then read it. The
+	 * thread sleeps while it waits.
+	 * @return true if a message was read, false if the handler was
+	 * disconnected first.
+	 */
+	bool wait(header &head, std::string &body);
+
 	/**
 	 * @brief Disconnects the handler from the server. This will stop the
-	 * listener thread if it is running.
+	 * listener thread if it is running, and wake any thread in wait().
 	 */
-	inline void disconnect() { connected = false; }
+	void disconnect();
 
 	/**
 	 * @brief Log the error message to the console, if it exists.
@@ -85,7 +199,9 @@ public:
 	 * @param h The header describing the type of message.
 	 * @param data4 4-byte string to be sent.
 	 * @return The header and data packaged into an asio::const_buffer which is
-	 * ready to be sent over the network.
+	 * ready to be sent over the network. The buffer stays valid until the next
+	 * call to to_buffer on the same thread.
+	 * @see queue() to send several messages without a write for each.
 	 */
 	static asio::const_buffer to_buffer(header h, const std::string &data4);
 
@@ -100,14 +216,22 @@ public:
 	static asio::const_buffer to_buffer(header h, uint16_t code);
 
 	/**
-	 * @brief Package a 4-byte board hash into a buffer to be sent over the network.
-	 * @param h The header describing the type of message. Must be board_hash.
-	 * @param hash 4-byte board hash to be sent.
+	 * @brief Package a 4-byte integer into a buffer to be sent over the network.
+	 * @param h The header describing the type of message. Must be board_hash,
+	 * work, result or value.
+	 * @param hash 4-byte integer to be sent in network byte order.
 	 * @return The header and data packaged into an asio::const_buffer which is
 	 * ready to be sent over the network.
 	 */
 	static asio::const_buffer to_buffer(header h, uint32_t hash);
 
+	/**
+	 * @brief Read a 4-byte integer in network byte order from a message body.
+	 * @param data4 Pointer to the 4 bytes following the header.
+	 * @return The decoded integer.
+	 */
+	static uint32_t to_uint32(const char *data4);
+
 protected:
 	using tcp = asio::ip::tcp;
 
@@ -119,8 +243,26 @@ protected:
 
 	asio::error_code error_code;// The error code for the last operation
 
-	bool data_ready, connected; // Flags for the listener thread
-	std::string data;			// The data received from the server
+	std::atomic<bool> connected;// Cleared to stop the listener thread
+
+	spsc_ring<message, QUEUE_SIZE> inbox;	// Received and not yet read
+	std::atomic<uint32_t> events;	// Bumped to wake a parked thread
+	std::atomic<bool> listener_parked;	// The listener waits for room in inbox
+
+	uint16_t version;			// The protocol version in use
+	std::string outgoing;		// Frames queued and not yet written
+	std::size_t outgoing_count;	// The number of them
+
+	packet_pool<POOL_SIZE> pool;	// Packets for fixed-size messages
+	std::array<packet *, POOL_SIZE> queued;	// Packets not yet written
+	std::size_t queued_count;
+
+	std::unique_ptr<shm_transport> local;	// Used instead of the socket if set
+
+	std::atomic<uint64_t> token;	// Set by the listener, see session_token()
+
+	connection_metrics stats;
+	std::mutex write_mutex;		// The listener writes pongs too
 
 protected:
 	/**
@@ -132,6 +274,11 @@ protected:
 	 */
 	handler(const std::string &code);
 
+private:
+	void wake();
+	bool pop(message &m);
+	bool deliver(message &m);
+	void echo(const message &ping);
 };
 
 namespace codes {
@@ -0,0 +1,899 @@
+#include "frame.hpp"
+#include "handler.hpp"
+#include "server.hpp"
+#include "slave.hpp"
+#include "../board.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+
+namespace {
+
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+using networking::header;
+
+constexpr int WHITE = 0, BLACK = 1;
+constexpr int MAX_PLY = 300;	// games longer than this are started over
+constexpr std::size_t READ_SIZE = 4096;
+
+/**
+ * @brief Settings shared by every simulated game.
+ */
+struct settings
+{
+	tcp::endpoint server;
+	uint16_t version = networking::frames::LEGACY_VERSION;
+	clock_type::duration interval {};	// between moves of white, or none
+	std::vector<std::vector<std::string>> scripts;	// or random moves
+	std::atomic<bool> measuring {false};
+	std::atomic<std::size_t> ready {0};	// games that have started once
+};
+
+/**
+ * @brief What the games of one client thread measured while measuring.
+ */
+struct results
+{
+	std::vector<uint32_t> round_trips;	// in microseconds
+	uint64_t moves = 0;
+	uint64_t games = 0;
+	uint64_t errors = 0;
+};
+
+double cpu_seconds(clockid_t id)
+{
+	timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double thread_cpu_seconds(std::thread &t)
+{
+	clockid_t id;
+	if (pthread_getcpuclockid(t.native_handle(), &id) != 0)
+		return 0;
+	return cpu_seconds(id);
+}
+
+/**
+ * @brief Play a move in coordinate notation, promoting to a queen unless
+ * another piece is given.
+ * @return false if it is illegal
+ */
+bool play(chess::board &b, std::string_view move)
+{
+	chess::board::move_t m;
+	int promotion;
+	return chess::board::parse_coordinates(move, m, promotion) ==
+			   chess::board::move_status::ok and
+		   b.play(m, promotion) == chess::board::move_status::ok;
+}
+
+/**
+ * @brief The next move of a game, random or from a script, as it is sent.
+ * @param script The index of the script to play, if there are scripts
+ * @return The move, or an empty string once the game should end
+ */
+std::string choose_move(const settings &shared, const chess::board &b, int ply,
+					  std::size_t script, std::mt19937 &random)
+{
+	if (ply >= MAX_PLY)
+		return {};
+
+	std::string move;
+	if (shared.scripts.empty())
+	{
+		const auto moves = b.legal_moves();
+		const auto m = moves[std::uniform_int_distribution<int>(
+			0, moves.size - 1)(random)];
+		char str[chess::board::MOVE_CHARS];
+		move.assign(str, chess::board::format_move(m,
+			b.is_promotion(m.first, m.second)
+				? chess::board::QUEEN_PROMOTION : 0, str));
+	}
+	else
+	{
+		const auto &moves = shared.scripts[script % shared.scripts.size()];
+		if (static_cast<std::size_t>(ply) >= moves.size())
+			return {};
+		move = moves[ply];
+	}
+
+	// without frames a promotion is always to a queen
+	if (shared.version < networking::frames::VERSION)
+		move.resize(std::min<std::size_t>(move.size(), 4));
+	return move;
+}
+
+/**
+ * @brief Two clients playing each other through the server, over and over,
+ * exactly as two slaves would. White measures the time from sending a move
+ * to getting the answer, and black answers as soon as a move arrives. Only
+ * used from the thread running its io_context.
+ */
+class match
+{
+public:
+	match(asio::io_context &io, settings &shared, results &out, uint16_t uid,
+		  uint32_t seed)
+			: shared(shared), out(out), uid(uid), random(seed),
+			  players {player(io), player(io)}, tick(io), ply(0), started(false),
+			  ending(false), scripted(0)
+	{
+	}
+
+	void start() { connect(WHITE); }
+
+private:
+	struct player
+	{
+		tcp::socket socket;
+		unsigned generation = 0;	// of the connection, to ignore old handlers
+		bool open = false;
+		std::array<char, networking::handler::MSG_SIZE> msg;
+		networking::frames::reader frames_in;
+		std::string pending, writing;
+
+		explicit player(asio::io_context &io) : socket(io) {}
+	};
+
+	settings &shared;
+	results &out;
+	uint16_t uid;
+	std::mt19937 random;
+	player players[2];
+	asio::steady_timer tick;
+	clock_type::time_point next_move, sent;
+	chess::board b;
+	int ply;
+	std::string last;	// the last move sent, as sent
+	bool started, ending;
+	std::size_t scripted;	// games played from a script
+
+	bool framed() const
+	{
+		return shared.version >= networking::frames::VERSION;
+	}
+
+	void connect(int c)
+	{
+		player &p = players[c];
+		const unsigned gen = ++p.generation;
+		p.pending.clear();
+		p.writing.clear();
+		p.frames_in = networking::frames::reader();
+		p.socket.async_connect(shared.server,
+			[this, c, gen](const asio::error_code &ec)
+			{
+				player &p = players[c];
+				if (gen != p.generation)
+					return;
+				if (ec)
+				{
+					++out.errors;
+					return;
+				}
+				p.open = true;
+				asio::error_code ignored;
+				p.socket.set_option(tcp::no_delay(true), ignored);
+				if (framed())
+				{
+					const char hello[] = {
+						static_cast<char>(header::hello),
+						static_cast<char>(shared.version >> 8),
+						static_cast<char>(shared.version & 0xFF),
+						static_cast<char>(uid >> 8),
+						static_cast<char>(uid & 0xFF)};
+					send(c, std::string_view(hello, sizeof(hello)));
+					asio::async_read(p.socket, asio::buffer(p.msg),
+						[this, c, gen](const asio::error_code &ec, std::size_t)
+						{
+							if (gen != players[c].generation)
+								return;
+							if (ec or static_cast<header>(players[c].msg[0]) !=
+										  header::hello)
+								closed(c);
+							else
+								read(c);
+						});
+				}
+				else
+				{
+					send(c, networking::handler::to_buffer(
+								header::connection_request, uid));
+					read(c);
+				}
+			});
+	}
+
+	void read(int c)
+	{
+		player &p = players[c];
+		const unsigned gen = p.generation;
+		if (!framed())
+		{
+			asio::async_read(p.socket, asio::buffer(p.msg),
+				[this, c, gen](const asio::error_code &ec, std::size_t)
+				{
+					player &p = players[c];
+					if (gen != p.generation)
+						return;
+					if (ec)
+						return closed(c);
+					on_message(c, static_cast<header>(p.msg[0]),
+							   std::string_view(p.msg.data() + 1,
+												p.msg.size() - 1));
+					if (gen == p.generation and p.open)
+						read(c);
+				});
+			return;
+		}
+		p.socket.async_read_some(
+			asio::buffer(p.frames_in.prepare(READ_SIZE), READ_SIZE),
+			[this, c, gen](const asio::error_code &ec, std::size_t n)
+			{
+				player &p = players[c];
+				if (gen != p.generation)
+					return;
+				if (ec)
+					return closed(c);
+				p.frames_in.commit(n);
+				header h;
+				std::string_view payload;
+				while (gen == p.generation and p.open and
+					   p.frames_in.next(h, payload))
+					on_message(c, h, payload);
+				if (gen == p.generation and p.open)
+					read(c);
+			});
+	}
+
+	void send(int c, asio::const_buffer bytes)
+	{
+		send(c, std::string_view(static_cast<const char *>(bytes.data()),
+								 bytes.size()));
+	}
+
+	void send(int c, std::string_view bytes)
+	{
+		players[c].pending += bytes;
+		if (players[c].writing.empty())
+			flush(c);
+	}
+
+	void send(int c, header h, const std::string &payload)
+	{
+		if (framed())
+		{
+			networking::frames::append(players[c].pending, h, payload);
+			if (players[c].writing.empty())
+				flush(c);
+		}
+		else
+			send(c, networking::handler::to_buffer(h, payload));
+	}
+
+	void flush(int c)
+	{
+		player &p = players[c];
+		const unsigned gen = p.generation;
+		p.writing.swap(p.pending);
+		asio::async_write(p.socket, asio::buffer(p.writing),
+			[this, c, gen](const asio::error_code &ec, std::size_t)
+			{
+				player &p = players[c];
+				if (gen != p.generation)
+					return;
+				p.writing.clear();
+				if (!ec and !p.pending.empty())
+					flush(c);
+			});
+	}
+
+	/**
+	 * @brief A connection has gone. Once both have, the next game starts.
+	 */
+	void closed(int c)
+	{
+		player &p = players[c];
+		if (!p.open and !p.socket.is_open())
+			return;
+		if (!ending and p.open)
+			++out.errors;
+		ending = true;
+		p.open = false;
+		asio::error_code ignored;
+		p.socket.close(ignored);
+		++p.generation;
+		tick.cancel();
+		if (!players[!c].open and !players[!c].socket.is_open())
+			connect(WHITE);
+	}
+
+	/**
+	 * @brief End the game by leaving it. The server closes both connections.
+	 */
+	void finish(int c, bool error = false)
+	{
+		if (ending)
+			return;
+		if (error)
+			++out.errors;
+		else if (shared.measuring)
+			++out.games;
+		ending = true;
+		send(c, header::disconnect, "    ");
+	}
+
+	void on_message(int c, header h, std::string_view payload)
+	{
+		switch (h)
+		{
+		case header::board_hash:
+			if (c == WHITE)
+				connect(BLACK);
+			else
+				begin();
+			break;
+		case header::move:
+		{
+			std::string_view move = payload;
+			int64_t clock;
+			if (framed() and
+				!networking::frames::parse_move(payload, move, clock))
+				return finish(c, true);
+			if (move != last)
+				return finish(c, true);
+			if (shared.measuring)
+				++out.moves;
+			if (c == WHITE and shared.measuring)
+				out.round_trips.push_back(static_cast<uint32_t>(
+					std::chrono::duration_cast<std::chrono::microseconds>(
+						clock_type::now() - sent).count()));
+
+			// the server ends a game that is over by itself
+			if (b.legal_moves().empty() or b.is_draw())
+				break;
+			if (c == BLACK)
+				move_now(BLACK);
+			else
+				schedule();
+			break;
+		}
+		case header::game_over:
+			finish(c);
+			break;
+		case header::reject:
+			finish(c, true);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void begin()
+	{
+		b = chess::board();
+		ply = 0;
+		ending = false;
+		if (!started)
+		{
+			started = true;
+			++shared.ready;
+		}
+		// spread the games over the interval, so they do not move in step
+		next_move = clock_type::now() - shared.interval +
+			std::chrono::duration_cast<clock_type::duration>(
+				shared.interval * std::uniform_real_distribution<double>()(random));
+		schedule();
+	}
+
+	/**
+	 * @brief Wait for white's next move, keeping to the rate even if a round
+	 * trip took longer than the interval before.
+	 */
+	void schedule()
+	{
+		if (shared.interval == clock_type::duration::zero())
+			return move_now(WHITE);
+		next_move = std::max(next_move + shared.interval, clock_type::now());
+		tick.expires_at(next_move);
+		const unsigned gen = players[WHITE].generation;
+		tick.async_wait([this, gen](const asio::error_code &ec) {
+			if (!ec and gen == players[WHITE].generation and !ending)
+				move_now(WHITE);
+		});
+	}
+
+	void move_now(int c)
+	{
+		const std::string move =
+			choose_move(shared, b, ply, uid + scripted, random);
+		if (move.empty())
+		{
+			++scripted;
+			return finish(c);
+		}
+		if (!play(b, move))
+			return finish(c, true);
+		++ply;
+		last = move;
+		if (c == WHITE)
+			sent = clock_type::now();
+		send(c, header::move, framed()
+			? networking::frames::move_payload(move) : move);
+	}
+};
+
+/**
+ * @brief Two networking::slave handlers playing each other through the
+ * server, over and over, on a thread of their own with a listener thread
+ * for each, so the numbers include the handler's listener, inbox, queue and
+ * flush. White measures the time from sending a move to getting the answer.
+ */
+class slave_match
+{
+public:
+	slave_match(settings &shared, const std::string &code, uint16_t uid,
+				uint32_t seed, const std::atomic<bool> &stop)
+			: shared(shared), code(code), uid(uid), random(seed), stop(stop),
+			  scripted(0), started(false)
+	{
+	}
+
+	void start() { thread = std::thread([this] { run(); }); }
+
+	void join() { thread.join(); }
+
+	/**
+	 * @brief What the game measured, once joined.
+	 */
+	const results &measured() const { return out; }
+
+	/**
+	 * @brief The CPU time of the game's threads so far, including listeners
+	 * that have ended.
+	 */
+	double cpu_seconds()
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		double total = ended_ns.load() / 1e9 + thread_cpu_seconds(thread);
+		for (auto &l : listeners)
+			if (l.joinable())
+				total += thread_cpu_seconds(l);
+		return total;
+	}
+
+private:
+	settings &shared;
+	results out;
+	std::string code;
+	uint16_t uid;
+	std::mt19937 random;
+	const std::atomic<bool> &stop;
+	std::unique_ptr<networking::slave> players[2];
+	std::thread listeners[2];
+	std::thread thread;
+	std::mutex threads_mutex;	// for cpu_seconds() while listeners change
+	std::atomic<uint64_t> ended_ns {0};	// CPU of listeners that ended
+	std::size_t scripted;
+	bool started;
+
+	void run()
+	{
+		while (!stop)
+		{
+			if (connect())
+				play_game();
+			else
+			{
+				++out.errors;
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			close();
+		}
+	}
+
+	bool connect()
+	{
+		try
+		{
+			for (auto &p : players)
+			{
+				p = std::make_unique<networking::slave>(code, chess::board()(),
+					shared.version, false);
+				p->set_no_delay(true);
+			}
+		}
+		catch (std::runtime_error &e)
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		for (int c : {WHITE, BLACK})
+			listeners[c] = std::thread([this, c] {
+				players[c]->listener();
+				timespec ts;
+				clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+				ended_ns += ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+			});
+		if (!started)
+		{
+			started = true;
+			++shared.ready;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Leave the game, which makes the server close both connections
+	 * and so ends both listeners.
+	 */
+	void close()
+	{
+		if (auto &p = players[players[WHITE] ? WHITE : BLACK])
+		{
+			p->queue(header::disconnect, "    ");
+			p->flush();
+		}
+		for (auto &p : players)
+			if (p)
+				p->disconnect();
+		{
+			std::lock_guard<std::mutex> lock(threads_mutex);
+			for (auto &l : listeners)
+				if (l.joinable())
+					l.join();
+		}
+		for (auto &p : players)
+			p.reset();
+	}
+
+	/**
+	 * @brief Wait for the move just sent to arrive at a player.
+	 * @return false if something else came, i.e. the end of the game
+	 */
+	bool receive(int c, std::string_view expected)
+	{
+		header h;
+		std::string body;
+		while (players[c]->wait(h, body))
+		{
+			if (h == header::game_over or h == header::reject or
+				h == header::disconnect)
+				return false;
+			if (h != header::move)
+				continue;
+			std::string_view move = body;
+			int64_t clock;
+			return (shared.version < networking::frames::VERSION or
+					networking::frames::parse_move(body, move, clock)) and
+				   move == expected;
+		}
+		return false;
+	}
+
+	void play_game()
+	{
+		chess::board b;
+		int ply = 0;
+		int c = WHITE;
+		// spread the games over the interval, so they do not move in step
+		auto next = clock_type::now() - shared.interval +
+			std::chrono::duration_cast<clock_type::duration>(
+				shared.interval * std::uniform_real_distribution<double>()(random));
+		clock_type::time_point sent;
+		while (!stop)
+		{
+			if (b.legal_moves().empty() or b.is_draw())
+			{
+				// the server ends a game that is over by itself
+				if (receive(c, {}) or !shared.measuring)
+					return;
+				++out.games;
+				return;
+			}
+			const std::string move =
+				choose_move(shared, b, ply, uid + scripted, random);
+			if (move.empty())
+			{
+				++scripted;
+				if (shared.measuring)
+					++out.games;
+				return;
+			}
+			if (!play(b, move))
+			{
+				++out.errors;
+				return;
+			}
+			++ply;
+
+			if (c == WHITE and shared.interval != clock_type::duration::zero())
+			{
+				next = std::max(next + shared.interval, clock_type::now());
+				std::this_thread::sleep_until(next);
+			}
+			if (c == WHITE)
+				sent = clock_type::now();
+			players[c]->queue_move(move);
+			players[c]->flush();
+			if (!receive(!c, move))
+			{
+				++out.errors;
+				return;
+			}
+			if (shared.measuring)
+			{
+				++out.moves;
+				if (c == BLACK)
+					out.round_trips.push_back(static_cast<uint32_t>(
+						std::chrono::duration_cast<std::chrono::microseconds>(
+							clock_type::now() - sent).count()));
+			}
+			c = !c;
+		}
+	}
+};
+
+/**
+ * @brief A client thread and the games it plays.
+ */
+struct client
+{
+	asio::io_context io;
+	results out;
+	std::vector<std::unique_ptr<match>> matches;
+	std::thread thread;
+};
+
+std::vector<std::vector<std::string>> read_scripts(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		throw std::runtime_error("file not found: " + path);
+	std::vector<std::vector<std::string>> scripts;
+	std::string line, move;
+	while (std::getline(file, line))
+	{
+		std::istringstream moves(line);
+		std::vector<std::string> script;
+		while (moves >> move)
+			script.push_back(move);
+		if (!script.empty())
+			scripts.push_back(std::move(script));
+	}
+	if (scripts.empty())
+		throw std::runtime_error("no games in " + path);
+	return scripts;
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-g games] [-r moves/s per game] "
+			  "[-s seconds] [-c client threads]\n"
+			  "       [-t server threads] [-v protocol version] [-p port] "
+			  "[-f games file]\n"
+			  "       [-m async|slaves]\n"
+			  "Starts a server on localhost and plays the games against it "
+			  "with two clients\n"
+			  "each, as fast as possible with a rate of 0. Moves are random "
+			  "unless a file\n"
+			  "has games to play, one per line as moves in coordinate "
+			  "notation. Reports\n"
+			  "throughput, move round trip latency, and the CPU time of the "
+			  "server and the\n"
+			  "clients per connection, and exits with 1 if anything went "
+			  "wrong. The clients\n"
+			  "are asynchronous sockets on the client threads by default, "
+			  "or with -m slaves\n"
+			  "networking::slave handlers on threads of their own, three per "
+			  "game, so the\n"
+			  "numbers include the handler's path as well." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	std::size_t games = 1000;
+	double rate = 10, seconds = 10;
+	unsigned client_threads = 1;
+	unsigned server_threads = std::max(1u, std::thread::hardware_concurrency());
+	uint16_t port = 0;
+	bool slaves = false;
+	settings shared;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (i + 1 >= argc or arg.size() != 2 or arg[0] != '-')
+			{
+				usage(argv[0]);
+				return 0;
+			}
+			const char *value = argv[++i];
+			switch (arg[1])
+			{
+			case 'g': games = std::stoul(value); break;
+			case 'r': rate = std::stod(value); break;
+			case 's': seconds = std::stod(value); break;
+			case 'c': client_threads = std::max(1, atoi(value)); break;
+			case 't': server_threads = std::max(1, atoi(value)); break;
+			case 'v': shared.version = static_cast<uint16_t>(atoi(value)); break;
+			case 'p': port = static_cast<uint16_t>(atoi(value)); break;
+			case 'f': shared.scripts = read_scripts(value); break;
+			case 'm':
+				if (std::string_view(value) != "async" and
+					std::string_view(value) != "slaves")
+					throw std::invalid_argument("Unknown mode " +
+												std::string(value));
+				slaves = std::string_view(value) == "slaves";
+				break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		if (games == 0 or games > UINT16_MAX)
+			throw std::invalid_argument("There can be 1 to 65535 games");
+
+		// two connections per client and one per server side of each
+		rlimit files;
+		if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+		{
+			files.rlim_cur = files.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &files);
+			if (files.rlim_cur < 4 * games + 64)
+				std::cerr << "Only " << files.rlim_cur << " open files are "
+						  << "allowed, which is too few for " << games
+						  << " games" << std::endl;
+		}
+
+		networking::server s(port, server_threads);
+		shared.server = tcp::endpoint(asio::ip::address_v4::loopback(), s.port());
+		if (rate > 0)
+			shared.interval = std::chrono::duration_cast<clock_type::duration>(
+				std::chrono::duration<double>(2 / rate));
+
+		std::vector<std::unique_ptr<client>> clients;
+		std::vector<std::unique_ptr<slave_match>> slave_matches;
+		std::atomic<bool> stop {false};
+		if (slaves)
+		{
+			const uint32_t ip = networking::codes::ip_to_int("127.0.0.1");
+			for (std::size_t i = 0; i < games; ++i)
+			{
+				const auto uid = static_cast<uint16_t>(i + 1);
+				slave_matches.push_back(std::make_unique<slave_match>(shared,
+					networking::codes::encode(ip, s.port(), uid), uid, i, stop));
+				slave_matches.back()->start();
+			}
+		}
+		else
+		{
+			for (unsigned i = 0; i < client_threads; ++i)
+				clients.push_back(std::make_unique<client>());
+			for (std::size_t i = 0; i < games; ++i)
+			{
+				client &c = *clients[i % client_threads];
+				c.matches.push_back(std::make_unique<match>(
+					c.io, shared, c.out, static_cast<uint16_t>(i + 1), i));
+			}
+			for (auto &c : clients)
+			{
+				for (auto &m : c->matches)
+					m->start();
+				c->thread = std::thread([&io = c->io] {
+					auto work = asio::make_work_guard(io);
+					io.run();
+				});
+			}
+		}
+
+		// measure once every game has started
+		const auto deadline = clock_type::now() + std::chrono::seconds(30);
+		while (shared.ready < games and clock_type::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if (shared.ready < games)
+			std::cerr << "Only " << shared.ready << " of " << games
+					  << " games started" << std::endl;
+
+		const auto client_cpu = [&clients, &slave_matches] {
+			double total = 0;
+			for (auto &c : clients)
+				total += thread_cpu_seconds(c->thread);
+			for (auto &m : slave_matches)
+				total += m->cpu_seconds();
+			return total;
+		};
+		const double process_start = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+		const double clients_start = client_cpu();
+		const auto start = clock_type::now();
+		shared.measuring = true;
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		shared.measuring = false;
+		const double elapsed =
+			std::chrono::duration<double>(clock_type::now() - start).count();
+		const double clients_used = client_cpu() - clients_start;
+		const double server_used =
+			cpu_seconds(CLOCK_PROCESS_CPUTIME_ID) - process_start - clients_used;
+
+		for (auto &c : clients)
+		{
+			c->io.stop();
+			c->thread.join();
+		}
+		stop = true;
+		for (auto &m : slave_matches)
+			m->join();
+
+		results total;
+		const auto add = [&total](const results &out) {
+			total.round_trips.insert(total.round_trips.end(),
+									 out.round_trips.begin(),
+									 out.round_trips.end());
+			total.moves += out.moves;
+			total.games += out.games;
+			total.errors += out.errors;
+		};
+		for (auto &c : clients)
+			add(c->out);
+		for (auto &m : slave_matches)
+			add(m->measured());
+		auto &samples = total.round_trips;
+		std::sort(samples.begin(), samples.end());
+		const auto percentile = [&samples](double p) -> uint32_t {
+			if (samples.empty())
+				return 0;
+			return samples[std::min(samples.size() - 1,
+				static_cast<std::size_t>(p * samples.size()))];
+		};
+
+		const std::size_t connections = 2 * games;
+		std::cout << games << " games, " << connections << " connections, "
+				  << "protocol version " << shared.version << ", "
+				  << elapsed << " s\n"
+				  << total.moves << " moves (" << total.moves / elapsed
+				  << "/s), " << samples.size() << " round trips, "
+				  << total.games << " games finished, " << total.errors
+				  << " errors\n"
+				  << "round trip (us): p50 " << percentile(0.5) << ", p99 "
+				  << percentile(0.99) << ", p999 " << percentile(0.999)
+				  << ", max " << (samples.empty() ? 0 : samples.back()) << "\n"
+				  << "CPU per connection (us/s): server "
+				  << server_used * 1e6 / elapsed / connections << ", clients "
+				  << clients_used * 1e6 / elapsed / connections << "\n"
+				  << "CPU per move (us): server "
+				  << (total.moves ? server_used * 1e6 / total.moves : 0)
+				  << ", clients "
+				  << (total.moves ? clients_used * 1e6 / total.moves : 0)
+				  << std::endl;
+		if (total.errors or samples.empty())
+			return 1;
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
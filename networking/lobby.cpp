@@ -0,0 +1,194 @@
+#include "lobby.hpp"
+#include "handler.hpp"
+
+#include <bit>
+#include <random>
+#include <stdexcept>
+
+namespace networking {
+
+bool lobby::endpoint::claim(uint16_t &uid, uint16_t start)
+{
+	// look for a free ID from the starting one on, a word at a time
+	const std::size_t first = start / 64;
+	const int offset = start % 64;
+	for (std::size_t i = 0; i < used.size(); ++i)
+	{
+		auto &word = used[(first + i) % used.size()];
+		uint64_t bits = word.load(std::memory_order_relaxed);
+		while (~bits)
+		{
+			// rotate so the search starts at the offset in the first word
+			const int shift = i == 0 ? offset : 0;
+			const int bit = (std::countr_one(std::rotr(bits, shift)) + shift) % 64;
+			if (word.compare_exchange_weak(bits, bits | uint64_t(1) << bit,
+										   std::memory_order_acq_rel))
+			{
+				uid = static_cast<uint16_t>((first + i) % used.size() * 64 + bit);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void lobby::endpoint::release(uint16_t uid)
+{
+	used[uid / 64].fetch_and(~(uint64_t(1) << uid % 64),
+							 std::memory_order_release);
+}
+
+lobby::lobby(const std::vector<std::pair<uint32_t, uint16_t>> &addresses,
+			 clock::duration ttl, std::size_t shard_count)
+		: shards(std::bit_ceil(std::max<std::size_t>(shard_count, 2))),
+		  shard_shift(64 - std::countr_zero(shards.size())),
+		  ttl(ttl),
+		  next_endpoint(0),
+		  count(0)
+{
+	if (addresses.empty())
+		throw std::invalid_argument("A lobby needs at least one endpoint");
+	for (const auto &[ip, port] : addresses)
+	{
+		auto e = std::make_unique<endpoint>();
+		e->base = key(ip, port, 0);
+		for (auto &word : e->used)
+			word.store(0, std::memory_order_relaxed);
+		if (by_base.emplace(e->base, e.get()).second)
+			endpoints.push_back(std::move(e));
+	}
+}
+
+std::string lobby::create()
+{
+	thread_local std::mt19937 rng(std::random_device {}());
+	const std::size_t n = endpoints.size();
+	const std::size_t first = next_endpoint.fetch_add(1, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		endpoint &e = *endpoints[(first + i) % n];
+		uint16_t uid;
+		if (!e.claim(uid, static_cast<uint16_t>(rng())))
+			continue;
+
+		const uint64_t k = e.base | uid;
+		const auto now = clock::now();
+		shard &s = shard_of(k);
+		{
+			std::lock_guard lock(s.mutex);
+			expire(s, now);
+			s.games[k] = {state::open, now + ttl};
+			s.deadlines.emplace_back(k, now + ttl);
+		}
+		count.fetch_add(1, std::memory_order_relaxed);
+		return codes::int_to_code(k);
+	}
+	return "";
+}
+
+bool lobby::join(uint64_t key)
+{
+	shard &s = shard_of(key);
+	std::lock_guard lock(s.mutex);
+	expire(s, clock::now());
+	const auto it = s.games.find(key);
+	if (it == s.games.end())
+		return false;
+	it->second.s = state::playing;
+	return true;
+}
+
+bool lobby::join(const std::string &code)
+{
+	return join(codes::code_to_int(code));
+}
+
+bool lobby::find(uint64_t key, state &st)
+{
+	shard &s = shard_of(key);
+	std::lock_guard lock(s.mutex);
+	expire(s, clock::now());
+	const auto it = s.games.find(key);
+	if (it == s.games.end())
+		return false;
+	st = it->second.s;
+	return true;
+}
+
+bool lobby::find(const std::string &code, state &st)
+{
+	return find(codes::code_to_int(code), st);
+}
+
+bool lobby::touch(uint64_t key)
+{
+	shard &s = shard_of(key);
+	const auto now = clock::now();
+	std::lock_guard lock(s.mutex);
+	expire(s, now);
+	const auto it = s.games.find(key);
+	if (it == s.games.end())
+		return false;
+	if (it->second.s == state::open)
+	{
+		// the old deadline stays queued and is skipped when it comes up
+		it->second.deadline = now + ttl;
+		s.deadlines.emplace_back(key, now + ttl);
+	}
+	return true;
+}
+
+void lobby::close(uint64_t key)
+{
+	shard &s = shard_of(key);
+	std::lock_guard lock(s.mutex);
+	const auto it = s.games.find(key);
+	if (it != s.games.end())
+		remove(s, it);
+}
+
+std::size_t lobby::expire()
+{
+	const auto now = clock::now();
+	std::size_t removed = 0;
+	for (auto &s : shards)
+	{
+		std::lock_guard lock(s.mutex);
+		removed += expire(s, now);
+	}
+	return removed;
+}
+
+std::size_t lobby::size() const
+{
+	return count.load(std::memory_order_relaxed);
+}
+
+void lobby::remove(shard &s, std::unordered_map<uint64_t, entry>::iterator it)
+{
+	const uint64_t k = it->first;
+	s.games.erase(it);
+	by_base.at(k & ~uint64_t(0xFFFF))->release(static_cast<uint16_t>(k));
+	count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::size_t lobby::expire(shard &s, clock::time_point now)
+{
+	// a deadline is stale if the game was touched, joined or closed since
+	std::size_t removed = 0;
+	while (!s.deadlines.empty() and s.deadlines.front().second <= now)
+	{
+		const auto [k, deadline] = s.deadlines.front();
+		s.deadlines.pop_front();
+		const auto it = s.games.find(k);
+		if (it != s.games.end() and it->second.s == state::open and
+			it->second.deadline == deadline)
+		{
+			remove(s, it);
+			++removed;
+		}
+	}
+	return removed;
+}
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace networking {
+
+/**
+ * @brief A registry of games by game code, used by any number of threads at
+ * once.
+ *
+ * Codes are allocated on a fixed set of endpoints, the address and port of a
+ * server, each of which has room for 65536 games, one per unique ID. Unique
+ * IDs are picked at random, like code_generator does, but the ones in use are
+ * kept in a bitmap per endpoint and claimed with an atomic compare and swap,
+ * so two games never get the same code and allocation takes no lock.
+ *
+ * Games are found by the whole decoded code, and spread over shards by a hash
+ * of it. Each shard has a lock of its own, so threads only wait for each
+ * other when they touch games in the same shard.
+ *
+ * A game is open until its first player joins, and is removed if that has not
+ * happened within the time to live of the lobby. Each shard keeps the
+ * deadlines of its open games in the order they were set, and removes the
+ * expired ones from the front whenever it is used, so expiry costs nothing
+ * for games that are joined in time.
+ */
+class lobby
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	enum class state : uint8_t
+	{
+		open, playing
+	};
+
+	/**
+	 * @param endpoints The IPv4 address and port of every server to allocate
+	 * codes on
+	 * @param ttl How long a game stays open without a player
+	 * @param shards The number of shards, rounded up to a power of two
+	 * @throws std::invalid_argument if there are no endpoints
+	 */
+	lobby(const std::vector<std::pair<uint32_t, uint16_t>> &endpoints,
+		  clock::duration ttl, std::size_t shards = 64);
+
+	lobby(const lobby &) = delete;
+	lobby &operator=(const lobby &) = delete;
+
+	/**
+	 * @brief Register a new open game.
+	 * @return Its game code, or an empty string if every code is in use
+	 */
+	std::string create();
+
+	/**
+	 * @brief A player arrived, so the game no longer expires.
+	 * @param key The decoded game code, see codes::code_to_int()
+	 * @return false if there is no such game
+	 */
+	bool join(uint64_t key);
+	bool join(const std::string &code);
+
+	/**
+	 * @brief Look up a game.
+	 * @return false if there is no such game
+	 */
+	bool find(uint64_t key, state &s);
+	bool find(const std::string &code, state &s);
+
+	/**
+	 * @brief Keep an open game for another time to live.
+	 * @return false if there is no such game
+	 */
+	bool touch(uint64_t key);
+
+	/**
+	 * @brief Remove a game, so its code can be used again.
+	 */
+	void close(uint64_t key);
+
+	/**
+	 * @brief Remove every open game past its time to live. This also happens
+	 * on its own as the lobby is used.
+	 * @return The number of games removed
+	 */
+	std::size_t expire();
+
+	/**
+	 * @brief The number of games, open or playing.
+	 */
+	std::size_t size() const;
+
+	/**
+	 * @brief The decoded game code of a game.
+	 */
+	static constexpr uint64_t key(uint32_t ip, uint16_t port, uint16_t uid)
+	{
+		return static_cast<uint64_t>(ip) << 32 |
+			   static_cast<uint64_t>(port) << 16 | uid;
+	}
+
+private:
+	/**
+	 * @brief The unique IDs in use on one endpoint.
+	 */
+	struct endpoint
+	{
+		uint64_t base;	// the key without the unique ID
+		std::array<std::atomic<uint64_t>, 65536 / 64> used;
+
+		bool claim(uint16_t &uid, uint16_t start);
+		void release(uint16_t uid);
+	};
+
+	struct entry
+	{
+		state s;
+		clock::time_point deadline;
+	};
+
+	struct alignas(64) shard
+	{
+		std::mutex mutex;
+		std::unordered_map<uint64_t, entry> games;
+		std::deque<std::pair<uint64_t, clock::time_point>> deadlines;
+	};
+
+	std::vector<std::unique_ptr<endpoint>> endpoints;
+	std::unordered_map<uint64_t, endpoint *> by_base;
+	std::vector<shard> shards;
+	int shard_shift;
+	clock::duration ttl;
+	std::atomic<std::size_t> next_endpoint;
+	std::atomic<std::size_t> count;
+
+	shard &shard_of(uint64_t key)
+	{
+		return shards[(key * 0x9E3779B97F4A7C15ull) >> shard_shift];
+	}
+
+	void remove(shard &s, std::unordered_map<uint64_t, entry>::iterator it);
+	std::size_t expire(shard &s, clock::time_point now);
+};
+
+}
@@ -1,4 +1,7 @@
 #include "master.hpp"
+#include "frame.hpp"
+
+#include <algorithm>
 
 namespace networking {
 
@@ -8,8 +11,10 @@ master::master(const std::string &code, uint32_t initial_board_hash)
 		  acceptor(io_context, reciever)
 {
 	uint16_t uid = codes::decode_uid(code);
+	auto offered = shm_transport::is_local(server_ip)
+		? shm_transport::offer(server_port, uid) : nullptr;
 
-	char connection_req[MSG_SIZE];
+	char connection_req[MSG_SIZE] = {static_cast<char>(header::reject)};
 	while (!validate_connection(connection_req, uid))
 	{
 		acceptor.accept(socket, error_code);
@@ -17,11 +22,41 @@ master::master(const std::string &code, uint32_t initial_board_hash)
         asio::read(socket, asio::buffer(connection_req, MSG_SIZE), error_code);
 		log_error();
 
-		asio::write(socket, to_buffer(header::board_hash, initial_board_hash), error_code);
+		// a hello asks for frames, which are used from its answer on
+		version = frames::LEGACY_VERSION;
+		if (static_cast<header>(*connection_req) == header::hello)
+		{
+			version = std::min<uint16_t>(frames::VERSION,
+				static_cast<uint8_t>(connection_req[1]) << 8 |
+				static_cast<uint8_t>(connection_req[2]));
+			const char hello[MSG_SIZE] = {
+				static_cast<char>(header::hello),
+				static_cast<char>(version >> 8),
+				static_cast<char>(version & 0xFF), '\0', '\0'};
+			asio::write(socket, asio::buffer(hello), error_code);
+		}
+		// a slave on this machine that attached to the shared memory is
+		// accepted before it gets the board hash, and everything after the
+		// hash goes through the shared memory
+		asio::error_code peer_error;
+		const bool accepted = offered and
+			validate_connection(connection_req, uid) and
+			shm_transport::is_local(socket.remote_endpoint(peer_error).address())
+			and !peer_error and offered->accept();
+
+		const uint32_t hash = initial_board_hash;
+		const char body[MSG_SIZE - 1] = {
+			static_cast<char>(hash >> 24), static_cast<char>(hash >> 16),
+			static_cast<char>(hash >> 8), static_cast<char>(hash & 0xFF)};
+		queue(header::board_hash, std::string_view(body, sizeof(body)));
+		flush();
+		if (accepted)
+			local = std::move(offered);
 	}
 
 	std::cout << "Connection established" << std::endl;
 	connected = true;
+	stats.connected();
 }
 
 master::~master()
@@ -32,9 +67,13 @@ master::~master()
 
 bool master::validate_connection(const char *msg, uint16_t uid)
 {
+	// a hello carries the protocol version before the ID
+	if (static_cast<header>(*msg) == header::hello)
+		return uid ==
+			   (static_cast<uint8_t>(msg[3]) << 8 | static_cast<uint8_t>(msg[4]));
 	return static_cast<header>(*msg) == header::connection_request and
 		   uid ==
-		   (static_cast<uint16_t>(msg[1]) << 8 | static_cast<uint16_t>(msg[2]));
+		   (static_cast<uint8_t>(msg[1]) << 8 | static_cast<uint8_t>(msg[2]));
 }
 
 }
\ No newline at end of file
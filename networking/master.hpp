@@ -1,6 +1,7 @@
 #pragma once
 
 #include "handler.hpp"
+#include "sync.hpp"
 
 #include <iostream>
 
@@ -12,9 +13,16 @@ public:
 	master(const std::string &code, uint32_t initial_board_hash);
 	~master() override;
 
+	/**
+	 * @brief The position of the game, kept in step with the slave from the
+	 * start. Play moves and wait for the slave's with it.
+	 */
+	position_sync &game() { return sync; }
+
 private:
 	tcp::endpoint reciever;
 	tcp::acceptor acceptor;
+	position_sync sync;
 
 	bool validate_connection(const char *msg, uint16_t uid);
 };
@@ -0,0 +1,218 @@
+#include "metrics.hpp"
+#include "../stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <sstream>
+
+namespace networking {
+
+namespace {
+/**
+ * @brief Add to a counter only one thread writes, which needs no locked
+ * instruction.
+ */
+template <typename T>
+inline void bump(std::atomic<T> &counter, T n = 1)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n,
+				  std::memory_order_relaxed);
+}
+
+template <typename T>
+inline void keep_max(std::atomic<T> &counter, T value)
+{
+	if (value > counter.load(std::memory_order_relaxed))
+		counter.store(value, std::memory_order_relaxed);
+}
+
+inline int64_t now()
+{
+	return connection_metrics::clock_type::now().time_since_epoch().count();
+}
+
+/**
+ * @brief Milliseconds since a time kept as clock ticks, or -1 for never.
+ */
+int64_t ms_since(const std::atomic<int64_t> &when)
+{
+	const int64_t ticks = when.load(std::memory_order_relaxed);
+	if (!ticks)
+		return -1;
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		connection_metrics::clock_type::duration(now() - ticks)).count();
+}
+
+int64_t us(std::chrono::nanoseconds d)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+void text(std::ostream &os, const char *name, const latency_histogram &h)
+{
+	os << name << " (us): " << h.count() << " timed, p50 "
+	   << us(h.percentile(0.5)) << ", p99 " << us(h.percentile(0.99))
+	   << ", p999 " << us(h.percentile(0.999)) << ", max " << us(h.max())
+	   << '\n';
+}
+
+void json(std::ostream &os, const char *name, const latency_histogram &h)
+{
+	os << '"' << name << "_us\":{\"count\":" << h.count() << ",\"p50\":"
+	   << us(h.percentile(0.5)) << ",\"p99\":" << us(h.percentile(0.99))
+	   << ",\"p999\":" << us(h.percentile(0.999)) << ",\"max\":"
+	   << us(h.max()) << '}';
+}
+}
+
+void latency_histogram::record(std::chrono::nanoseconds d)
+{
+	const uint64_t ns = std::max<int64_t>(d.count(), 0);
+	bump(buckets[std::min<std::size_t>(std::bit_width(ns), BUCKETS - 1)],
+		 uint64_t(1));
+	keep_max(longest, static_cast<int64_t>(ns));
+}
+
+uint64_t latency_histogram::count() const
+{
+	uint64_t n = 0;
+	for (const auto &b : buckets)
+		n += b.load(std::memory_order_relaxed);
+	return n;
+}
+
+std::chrono::nanoseconds latency_histogram::percentile(double p) const
+{
+	const uint64_t total = count();
+	if (!total)
+		return std::chrono::nanoseconds(0);
+	const auto wanted = static_cast<uint64_t>(p * total);
+	uint64_t seen = 0;
+	for (std::size_t i = 0; i < BUCKETS; ++i)
+	{
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen > wanted)
+			return std::min(std::chrono::nanoseconds(int64_t(1) << i), max());
+	}
+	return max();
+}
+
+void connection_metrics::sent(std::size_t messages, std::size_t bytes,
+							  clock_type::duration took)
+{
+	CHESS_COUNT_N(messages_sent, messages);
+	bump(out.messages, uint64_t(messages));
+	bump(out.bytes, uint64_t(bytes));
+	bump(out.writes, uint64_t(1));
+	keep_max(out.largest_write, uint64_t(messages));
+	out.last.store(now(), std::memory_order_relaxed);
+	out.write.record(took);
+}
+
+uint32_t connection_metrics::ping()
+{
+	const uint32_t sequence = out.next_ping++;
+	const std::size_t slot = sequence % PINGS;
+	out.ping_sent[slot].store(now(), std::memory_order_relaxed);
+	out.ping_sequence[slot].store(sequence, std::memory_order_release);
+	return sequence;
+}
+
+void connection_metrics::received(std::size_t bytes)
+{
+	bump(in.bytes, uint64_t(bytes));
+	bump(in.reads, uint64_t(1));
+	in.last.store(now(), std::memory_order_relaxed);
+}
+
+void connection_metrics::delivered(std::size_t queued)
+{
+	CHESS_COUNT(messages_received);
+	bump(in.messages, uint64_t(1));
+	keep_max(in.most_queued, uint64_t(queued));
+}
+
+void connection_metrics::pong(uint32_t sequence)
+{
+	const std::size_t slot = sequence % PINGS;
+	if (out.ping_sequence[slot].load(std::memory_order_acquire) != sequence)
+		return;
+	const int64_t sent = out.ping_sent[slot].load(std::memory_order_relaxed);
+	if (sent)
+		in.round_trip.record(clock_type::duration(now() - sent));
+}
+
+void connection_metrics::echoed(std::size_t bytes)
+{
+	bump(in.pongs, uint64_t(1));
+	bump(in.pong_bytes, uint64_t(bytes));
+}
+
+void connection_metrics::read(clock_type::time_point received)
+{
+	bump(taken.messages, uint64_t(1));
+	taken.wait.record(clock_type::now() - received);
+}
+
+void connection_metrics::connected()
+{
+	connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string connection_metrics::snapshot(format f, std::size_t queued) const
+{
+	const auto load = [](const std::atomic<uint64_t> &c) {
+		return c.load(std::memory_order_relaxed);
+	};
+	const uint64_t made = load(connections);
+	const uint64_t reconnects = made ? made - 1 : 0;
+
+	std::ostringstream os;
+	if (f == format::text)
+	{
+		os << "sent: " << load(out.messages) << " messages, "
+		   << load(out.bytes) << " bytes, " << load(out.writes)
+		   << " writes of at most " << load(out.largest_write)
+		   << " messages, last " << ms_since(out.last) << " ms ago\n"
+		   << "received: " << load(in.messages) << " messages, "
+		   << load(in.bytes) << " bytes, " << load(in.reads)
+		   << " reads, last " << ms_since(in.last) << " ms ago\n"
+		   << "echoed: " << load(in.pongs) << " pongs, "
+		   << load(in.pong_bytes) << " bytes\n"
+		   << "read: " << load(taken.messages) << " messages, " << queued
+		   << " waiting, at most " << load(in.most_queued) << '\n'
+		   << "connections: " << made << ", " << reconnects
+		   << " reconnects\n";
+		text(os, "round trip", in.round_trip);
+		text(os, "write", out.write);
+		text(os, "wait to be read", taken.wait);
+	}
+	else
+	{
+		os << "{\"sent\":{\"messages\":" << load(out.messages)
+		   << ",\"bytes\":" << load(out.bytes) << ",\"writes\":"
+		   << load(out.writes) << ",\"largest_write\":"
+		   << load(out.largest_write) << ",\"last_ms_ago\":"
+		   << ms_since(out.last) << "},"
+		   << "\"received\":{\"messages\":" << load(in.messages)
+		   << ",\"bytes\":" << load(in.bytes) << ",\"reads\":"
+		   << load(in.reads) << ",\"last_ms_ago\":" << ms_since(in.last)
+		   << "},"
+		   << "\"echoed\":{\"messages\":" << load(in.pongs) << ",\"bytes\":"
+		   << load(in.pong_bytes) << "},"
+		   << "\"read\":{\"messages\":" << load(taken.messages)
+		   << ",\"queued\":" << queued << ",\"most_queued\":"
+		   << load(in.most_queued) << "},"
+		   << "\"connections\":" << made << ",\"reconnects\":" << reconnects
+		   << ',';
+		json(os, "round_trip", in.round_trip);
+		os << ',';
+		json(os, "write", out.write);
+		os << ',';
+		json(os, "read_wait", taken.wait);
+		os << '}';
+	}
+	return os.str();
+}
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace networking {
+
+/**
+ * @brief A histogram of durations with a bucket per power of two of
+ * nanoseconds, so recording is a bit scan and an increment. Only one thread
+ * may record, any thread may read.
+ */
+class latency_histogram
+{
+public:
+	static constexpr std::size_t BUCKETS = 40;	// up to about 18 minutes
+
+	void record(std::chrono::nanoseconds d);
+
+	uint64_t count() const;
+
+	/**
+	 * @brief The upper bound of the bucket holding the given fraction of the
+	 * durations recorded, i.e. 0.99 for the 99th percentile.
+	 */
+	std::chrono::nanoseconds percentile(double p) const;
+
+	std::chrono::nanoseconds max() const
+	{
+		return std::chrono::nanoseconds(longest.load(std::memory_order_relaxed));
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKETS> buckets {};
+	std::atomic<int64_t> longest {0};
+};
+
+/**
+ * @brief Counters of one connection, kept by the handler for as long as it
+ * lives.
+ *
+ * Each group of counters is written by one thread only: the thread that
+ * sends, the listener thread and the thread that reads. Each group has a
+ * cache line of its own, and every counter is bumped with a plain load and
+ * store instead of a locked read-modify-write, so keeping them costs about as
+ * much as keeping them in ordinary variables. Any thread can take a snapshot
+ * at any time.
+ */
+class connection_metrics
+{
+public:
+	using clock_type = std::chrono::steady_clock;
+
+	enum class format { text, json };
+
+	/**
+	 * @brief Count a write. Called from the thread that sends.
+	 * @param messages The number of messages written
+	 * @param bytes The number of bytes written
+	 * @param took How long the write took
+	 */
+	void sent(std::size_t messages, std::size_t bytes, clock_type::duration took);
+
+	/**
+	 * @brief Remember when a ping was sent. Called from the thread that
+	 * sends.
+	 * @return The sequence number of the ping
+	 */
+	uint32_t ping();
+
+	/**
+	 * @brief Count a read from the connection. Called from the listener.
+	 */
+	void received(std::size_t bytes);
+
+	/**
+	 * @brief Count a message received. Called from the listener.
+	 * @param queued The number of messages waiting to be read with it
+	 */
+	void delivered(std::size_t queued);
+
+	/**
+	 * @brief Time the round trip of a ping from the sequence number echoed,
+	 * ignoring pongs for pings too old to be remembered. Called from the
+	 * listener.
+	 */
+	void pong(uint32_t sequence);
+
+	/**
+	 * @brief Count a pong sent back for a ping. Called from the listener.
+	 */
+	void echoed(std::size_t bytes);
+
+	/**
+	 * @brief Count a message read, and how long it waited to be. Called from
+	 * the thread that reads.
+	 */
+	void read(clock_type::time_point received);
+
+	/**
+	 * @brief Count a connection being made, which is a reconnection after
+	 * the first one.
+	 */
+	void connected();
+
+	/**
+	 * @brief A snapshot of every counter.
+	 * @param queued The number of messages waiting to be read
+	 */
+	std::string snapshot(format f, std::size_t queued) const;
+
+private:
+	static constexpr std::size_t PINGS = 64;	// remembered until answered
+
+	struct alignas(64) sending
+	{
+		std::atomic<uint64_t> messages {0}, bytes {0}, writes {0};
+		std::atomic<uint64_t> largest_write {0};	// in messages
+		std::atomic<int64_t> last {0};	// when, in clock_type ticks
+		latency_histogram write;
+		uint32_t next_ping = 0;
+		std::array<std::atomic<uint32_t>, PINGS> ping_sequence {};
+		std::array<std::atomic<int64_t>, PINGS> ping_sent {};
+	};
+
+	struct alignas(64) receiving
+	{
+		std::atomic<uint64_t> messages {0}, bytes {0}, reads {0};
+		std::atomic<uint64_t> most_queued {0};
+		std::atomic<uint64_t> pongs {0}, pong_bytes {0};
+		std::atomic<int64_t> last {0};
+		latency_histogram round_trip;
+	};
+
+	struct alignas(64) reading
+	{
+		std::atomic<uint64_t> messages {0};
+		latency_histogram wait;	// from the listener to the reader
+	};
+
+	sending out;
+	receiving in;
+	reading taken;
+	alignas(64) std::atomic<uint64_t> connections {0};
+};
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace networking {
+
+enum class header : uint8_t;
+
+/**
+ * @brief A fixed-size message, encoded in place. The header and the 4 bytes
+ * of the body are laid out exactly as they are sent.
+ */
+struct packet
+{
+	static constexpr std::size_t SIZE = 5;
+
+	std::array<char, SIZE> bytes;
+
+	/**
+	 * @brief Encode a message with a 4-byte body. The body is not checked.
+	 */
+	void encode(header h, std::string_view data4)
+	{
+		bytes[0] = static_cast<char>(h);
+		for (std::size_t i = 0; i < SIZE - 1; ++i)
+			bytes[i + 1] = data4[i];
+	}
+
+	/**
+	 * @brief Encode a message with a 4-byte integer in network byte order.
+	 */
+	void encode(header h, uint32_t value)
+	{
+		bytes[0] = static_cast<char>(h);
+		bytes[1] = static_cast<char>(value >> 24);
+		bytes[2] = static_cast<char>(value >> 16);
+		bytes[3] = static_cast<char>(value >> 8);
+		bytes[4] = static_cast<char>(value & 0xFF);
+	}
+
+	/**
+	 * @brief Encode a message with a 2-byte integer in network byte order,
+	 * followed by two zero bytes.
+	 */
+	void encode(header h, uint16_t value)
+	{
+		bytes[0] = static_cast<char>(h);
+		bytes[1] = static_cast<char>(value >> 8);
+		bytes[2] = static_cast<char>(value & 0xFF);
+		bytes[3] = bytes[4] = '\0';
+	}
+};
+
+/**
+ * @brief A fixed number of packets for one connection, handed out and taken
+ * back without touching the heap.
+ *
+ * Packets are taken from the front of a stack of free indices, so the ones
+ * used most recently, still in cache, are used again first. Only one thread
+ * may use a pool.
+ *
+ * @tparam N The number of packets
+ */
+template <std::size_t N>
+class packet_pool
+{
+public:
+	packet_pool() : available(N)
+	{
+		for (std::size_t i = 0; i < N; ++i)
+			free[i] = static_cast<uint32_t>(N - 1 - i);
+	}
+
+	packet_pool(const packet_pool &) = delete;
+	packet_pool &operator=(const packet_pool &) = delete;
+
+	/**
+	 * @brief Take a packet.
+	 * @return nullptr if every packet is in use
+	 */
+	packet *acquire()
+	{
+		return available ? &slots[free[--available]] : nullptr;
+	}
+
+	/**
+	 * @brief Give back a packet taken from this pool.
+	 */
+	void release(packet *p)
+	{
+		free[available++] = static_cast<uint32_t>(p - slots.data());
+	}
+
+	/**
+	 * @brief The number of packets not in use.
+	 */
+	std::size_t size() const { return available; }
+
+	static constexpr std::size_t capacity() { return N; }
+
+private:
+	std::array<packet, N> slots;
+	std::array<uint32_t, N> free;
+	std::size_t available;
+};
+
+}
@@ -0,0 +1,206 @@
+#include "master.hpp"
+#include "slave.hpp"
+#include "sync.hpp"
+#include "../board.hpp"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace {
+
+using networking::header;
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " -m code | -j code [-v version] "
+			  "[-l 0|1] [-n plies] [-d every] [-s seed] [-f fen]\n"
+			  "Plays a game between two peers, hosting it as the master with "
+			  "white (-m) or\n"
+			  "joining it as the slave with black (-j), with the position kept "
+			  "in step by\n"
+			  "position_sync. Moves are read from stdin in coordinate "
+			  "notation, or played\n"
+			  "at random for -n plies. -d drops every nth move received to "
+			  "show the\n"
+			  "position being repaired, -l 0 keeps off shared memory, and "
+			  "-v is the\n"
+			  "protocol version the slave asks for, which must use frames. "
+			  "-f joins with\n"
+			  "another board, which the master's position replaces. Prints "
+			  "the final position\n"
+			  "and its hash, which both sides agree on." << std::endl;
+}
+
+/**
+ * @brief A random legal move in coordinate notation, or an empty string if
+ * there is none.
+ */
+std::string random_move(const chess::board &b, std::mt19937_64 &random)
+{
+	const chess::board::move_list moves = b.legal_moves();
+	if (moves.empty())
+		return {};
+	const chess::board::move_t m = moves[random() % moves.size];
+	char str[chess::board::MOVE_CHARS];
+	return std::string(str, chess::board::format_move(m,
+		b.is_promotion(m.first, m.second) ? chess::board::QUEEN_PROMOTION : 0,
+		str));
+}
+
+/**
+ * @brief Play until the game ends, either side leaves or the number of plies
+ * is reached.
+ * @param plies The number of plies to play at random, or 0 to read moves from
+ * stdin
+ * @param drop Drop every nth move received, or 0 for none
+ */
+void play(networking::handler &h, networking::position_sync &sync, bool color,
+		  int plies, int drop, uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	int received = 0;
+	bool over = false;
+	while (!over)
+	{
+		const chess::board &b = sync.position();
+		if (b.turn() == color and !sync.repairing())
+		{
+			if (plies and sync.ply() >= plies)
+				break;
+			std::string move;
+			if (plies)
+				move = random_move(b, random);
+			else
+			{
+				std::cout << b << "Your move: " << std::flush;
+				if (!std::getline(std::cin, move))
+					break;
+			}
+			if (move.empty())
+				break;
+			if (!sync.play(h, move))
+			{
+				std::cout << "Illegal move " << move << std::endl;
+				continue;
+			}
+			h.flush();
+			continue;
+		}
+
+		header head;
+		std::string body;
+		bool handled;
+		if (drop)
+		{
+			// a move is dropped before the position sees it
+			if (!h.wait(head, body))
+				return;
+			if (head == header::move and ++received % drop == 0)
+				continue;
+			handled = sync.receive(h, head, body);
+			h.flush();
+		}
+		else
+		{
+			if (!sync.wait(h, head, body))
+				return;
+			handled = head == header::move or head == header::delta;
+		}
+		if (!handled)
+			over = head == header::game_over or head == header::disconnect;
+		else if (head == header::move and !plies)
+		{
+			std::string_view move;
+			int64_t clock;
+			if (networking::frames::parse_move(body, move, clock))
+				std::cout << "Opponent played " << move << std::endl;
+		}
+	}
+
+	std::cout << "ply " << sync.ply() << ", " << sync.position().fen()
+			  << ", hash " << sync.position().key() << ", repaired "
+			  << sync.recoveries() << " times" << std::endl;
+	if (!over)
+		h.queue(header::game_over, "    ");
+	h.queue(header::disconnect, "    ");
+	h.flush();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	std::string code, fen;
+	bool host = false;
+	uint16_t version = networking::frames::VERSION;
+	bool shared_memory = true;
+	int plies = 0, drop = 0;
+	uint64_t seed = 1;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (i + 1 >= argc or arg.size() != 2 or arg[0] != '-')
+			{
+				usage(argv[0]);
+				return 0;
+			}
+			const char *value = argv[++i];
+			switch (arg[1])
+			{
+			case 'm': code = value; host = true; break;
+			case 'j': code = value; host = false; break;
+			case 'v': version = static_cast<uint16_t>(atoi(value)); break;
+			case 'l': shared_memory = atoi(value) != 0; break;
+			case 'n': plies = std::max(0, atoi(value)); break;
+			case 'd': drop = std::max(0, atoi(value)); break;
+			case 's': seed = std::stoull(value); break;
+			case 'f': fen = value; break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		if (code.empty() or version < networking::frames::VERSION)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+
+		std::unique_ptr<networking::handler> h;
+		networking::position_sync *sync;
+		if (host)
+		{
+			auto m = std::make_unique<networking::master>(code,
+														  chess::board()());
+			sync = &m->game();
+			h = std::move(m);
+		}
+		else
+		{
+			const chess::board b = fen.empty() ? chess::board()
+											   : chess::board(fen);
+			auto s = std::make_unique<networking::slave>(code, b(), version,
+														 shared_memory);
+			sync = &s->game();
+			h = std::move(s);
+		}
+		if (h->protocol_version() < networking::frames::VERSION)
+			throw std::runtime_error("The other side does not use frames");
+
+		std::thread listener([&h] { h->listener(); });
+		play(*h, *sync, !host, plies, drop, seed);
+		listener.join();
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
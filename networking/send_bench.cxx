@@ -0,0 +1,156 @@
+#include "handler.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief The way to_buffer() used to build messages, kept to measure against.
+ */
+asio::const_buffer stringstream_buffer(networking::header h,
+									   const std::string &data4)
+{
+	thread_local std::string storage;
+	std::stringstream ss;
+	ss << static_cast<char>(h) << data4;
+	storage = ss.str();
+	return asio::buffer(storage.data(), storage.size());
+}
+
+/**
+ * @brief A handler connected to a sink on this machine.
+ */
+class loopback : public networking::handler
+{
+public:
+	loopback(const std::string &code) : handler(code)
+	{
+		socket.connect(tcp::endpoint(server_ip, server_port));
+		socket.set_option(tcp::no_delay(true));
+	}
+};
+
+/**
+ * @brief Read and throw away everything sent to it, on a thread of its own.
+ */
+class sink
+{
+public:
+	sink() : acceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+	{
+		thread = std::thread([this] {
+			tcp::socket s = acceptor.accept();
+			std::array<char, 1 << 16> buffer;
+			asio::error_code ec;
+			while (!ec)
+				s.read_some(asio::buffer(buffer), ec);
+		});
+	}
+
+	~sink() { thread.join(); }
+
+	std::string code() const
+	{
+		return networking::codes::encode(
+			networking::codes::ip_to_int("127.0.0.1"),
+			acceptor.local_endpoint().port(), 0);
+	}
+
+private:
+	asio::io_context io;
+	tcp::acceptor acceptor;
+	std::thread thread;
+};
+
+void report(const char *name, std::size_t messages, clock_type::time_point start)
+{
+	const double seconds =
+		std::chrono::duration<double>(clock_type::now() - start).count();
+	std::cout << name << ": " << static_cast<uint64_t>(messages / seconds)
+			  << " messages/s" << std::endl;
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [messages]\n"
+			  << "Measures how many fixed-size messages one thread can "
+				 "encode, and send to\n"
+			  << "another over loopback, with each send path." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	std::size_t messages = 1000000;
+	try
+	{
+		if (argc > 2)
+			throw std::invalid_argument("too many arguments");
+		if (argc == 2)
+			messages = std::stoull(argv[1]);
+	}
+	catch (std::logic_error &e)
+	{
+		// from std::stoull and friends, for a count that is not a number
+		usage(argv[0]);
+		return 0;
+	}
+	const std::string move = "e2e4";
+	using networking::header;
+
+	try
+	{
+		// encoding alone
+		std::size_t checksum = 0;
+		auto start = clock_type::now();
+		for (std::size_t i = 0; i < messages; ++i)
+			checksum += stringstream_buffer(header::move, move).size();
+		report("encode, stringstream", messages, start);
+
+		start = clock_type::now();
+		for (std::size_t i = 0; i < messages; ++i)
+			checksum += networking::handler::to_buffer(header::move, move).size();
+		report("encode, in place", messages, start);
+
+		// one write per message, with either encoder, then queued messages
+		// sent with one gathered write per pool
+		for (int path = 0; path < 3; ++path)
+		{
+			sink s;
+			loopback l(s.code());
+			start = clock_type::now();
+			if (path == 0)
+				for (std::size_t i = 0; i < messages; ++i)
+					l.send(stringstream_buffer(header::move, move));
+			else if (path == 1)
+				for (std::size_t i = 0; i < messages; ++i)
+					l.send(networking::handler::to_buffer(header::move, move));
+			else
+			{
+				for (std::size_t i = 0; i < messages; ++i)
+					l.queue(header::move, move);
+				l.flush();
+			}
+			report(path == 0   ? "send, stringstream"
+				   : path == 1 ? "send, in place"
+							   : "send, pooled and gathered",
+				   messages, start);
+		}
+		if (checksum != 2 * messages * networking::handler::MSG_SIZE)
+			return 1;
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
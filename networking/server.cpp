@@ -0,0 +1,960 @@
+#include "server.hpp"
+#include "frame.hpp"
+#include "../board.hpp"
+#include "../stats.hpp"
+#include "../trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <random>
+#include <string>
+
+#include <sys/random.h>
+
+namespace networking {
+
+namespace {
+/**
+ * @brief A token to resume with, from the kernel's CSPRNG so nobody can
+ * work out the tokens of others from their own. Never 0, which means none.
+ */
+uint64_t new_token()
+{
+	uint64_t token = 0;
+	while (!token)
+	{
+		const ssize_t n = getrandom(&token, sizeof(token), 0);
+		if (n == sizeof(token))
+			continue;
+		token = 0;
+		if (n < 0 and errno != EINTR)
+		{
+			// only kernels without getrandom get here
+			std::random_device device;
+			token = static_cast<uint64_t>(device()) << 32 | device();
+		}
+	}
+	return token;
+}
+
+/**
+ * @brief Compare tokens in the same time whether or not they match.
+ */
+bool same_token(uint64_t a, uint64_t b)
+{
+	volatile uint64_t difference = a ^ b;
+	return difference == 0;
+}
+}
+
+/**
+ * @brief One client connection. Reads fixed-size messages or frames,
+ * depending on the protocol version, and queues writes, so any number of
+ * messages can be sent while a write is in flight and go out together in the
+ * next one. Only used from the thread of the shard that owns it.
+ */
+class server::session : public std::enable_shared_from_this<session>
+{
+public:
+	session(tcp::socket socket, shard &owner, uint16_t version)
+			: socket(std::move(socket)), owner(owner), version(version),
+			  color(0), closing(false)
+	{
+		++owner.connection_count;
+	}
+
+	~session() { --owner.connection_count; }
+
+	void start(std::shared_ptr<game> g, int c)
+	{
+		current = std::move(g);
+		color = c;
+		read();
+	}
+
+	/**
+	 * @brief Queue a message. The payload is in the form of a frame, and is
+	 * translated for a connection without frames. Messages that a fixed-size
+	 * message cannot carry are dropped for those.
+	 */
+	void send(header h, std::string_view payload)
+	{
+		if (closing)
+			return;
+		CHESS_COUNT(messages_sent);
+		if (version >= frames::VERSION)
+			frames::append(pending, h, payload);
+		else
+		{
+			std::string_view move;
+			int64_t clock;
+			if ((h == header::move or h == header::reject) and
+				payload.size() != handler::MSG_SIZE - 1 and
+				frames::parse_move(payload, move, clock))
+				payload = move.substr(0, handler::MSG_SIZE - 1);
+			if (payload.size() != handler::MSG_SIZE - 1)
+				return;
+			pending += static_cast<char>(h);
+			pending += payload;
+		}
+		if (writing.empty())
+			flush();
+	}
+
+	/**
+	 * @brief Queue the answer to a hello, which is a fixed-size message
+	 * carrying the version in use whatever the version.
+	 */
+	void hello()
+	{
+		const char body[] = {static_cast<char>(version >> 8),
+							 static_cast<char>(version & 0xFF), '\0', '\0'};
+		send_fixed(header::hello, std::string_view(body, sizeof(body)));
+	}
+
+	/**
+	 * @brief Queue a fixed-size message whatever the version, for answers
+	 * sent before frames are agreed on.
+	 */
+	void send_fixed(header h, std::string_view body)
+	{
+		CHESS_COUNT(messages_sent);
+		pending += static_cast<char>(h);
+		pending += body;
+		if (writing.empty())
+			flush();
+	}
+
+	uint16_t protocol() const { return version; }
+
+	/**
+	 * @brief Close the connection once everything queued has been written.
+	 */
+	void close()
+	{
+		closing = true;
+		current.reset();
+		if (writing.empty())
+			shutdown();
+	}
+
+private:
+	static constexpr std::size_t READ_SIZE = 4096;
+
+	tcp::socket socket;
+	shard &owner;
+	uint16_t version;
+	std::shared_ptr<game> current;
+	int color;
+	bool closing;
+	std::array<char, handler::MSG_SIZE> in;
+	frames::reader frames_in;
+	std::string pending, writing;
+
+	void read();
+	void read_frames();
+
+	void flush()
+	{
+		writing.swap(pending);
+		asio::async_write(socket, asio::buffer(writing),
+			[self = shared_from_this()](const asio::error_code &ec, std::size_t)
+			{
+				self->writing.clear();
+				if (ec)
+					self->shutdown();
+				else if (!self->pending.empty())
+					self->flush();
+				else if (self->closing)
+					self->shutdown();
+			});
+	}
+
+	void shutdown()
+	{
+		asio::error_code ec;
+		socket.shutdown(tcp::socket::shutdown_both, ec);
+		socket.close(ec);
+	}
+};
+
+/**
+ * @brief A connection watching a game. Frames are shared by every watcher of
+ * a game and never copied. A watcher that falls behind is sent the position
+ * instead of the moves it has not received yet, so it never holds up the
+ * players or the other watchers. Only used from the thread of the shard that
+ * owns it.
+ */
+class server::spectator : public std::enable_shared_from_this<spectator>
+{
+public:
+	using frame = std::shared_ptr<const std::string>;
+
+	static constexpr std::size_t MAX_QUEUED = 64;	// frames behind a write
+
+	spectator(tcp::socket socket, shard &owner)
+			: socket(std::move(socket)), owner(owner), writing(false),
+			  closing(false)
+	{
+		++owner.connection_count;
+		++owner.spectator_count;
+	}
+
+	~spectator()
+	{
+		--owner.connection_count;
+		--owner.spectator_count;
+	}
+
+	void start(std::shared_ptr<game> g)
+	{
+		current = std::move(g);
+		read();
+	}
+
+	/**
+	 * @brief Queue a frame that is never dropped.
+	 */
+	void send(const frame &f)
+	{
+		if (closing)
+			return;
+		CHESS_COUNT(messages_sent);
+		queued.push_back(f);
+		if (!writing)
+			flush();
+	}
+
+	/**
+	 * @brief Queue a frame. When too many are queued, the moves queued are
+	 * replaced with the position after them.
+	 * @param move Whether the frame is a move, which the position covers
+	 * @param snapshot Makes a frame with the FEN of the game
+	 */
+	template <typename F>
+	void send(const frame &f, bool move, F &&snapshot)
+	{
+		if (closing)
+			return;
+		CHESS_COUNT(messages_sent);
+		if (queued.size() < MAX_QUEUED)
+			queued.push_back(f);
+		else
+		{
+			queued.clear();
+			queued.push_back(snapshot());
+			if (!move)
+				queued.push_back(f);
+		}
+		if (!writing)
+			flush();
+	}
+
+	/**
+	 * @brief Close the connection once everything queued has been written.
+	 */
+	void close()
+	{
+		closing = true;
+		current.reset();
+		if (!writing)
+			shutdown();
+	}
+
+private:
+	tcp::socket socket;
+	shard &owner;
+	std::shared_ptr<game> current;
+	std::vector<frame> queued, in_flight;
+	std::vector<asio::const_buffer> buffers;
+	std::array<char, 64> in;
+	bool writing;
+	bool closing;
+
+	void read();
+
+	void flush()
+	{
+		in_flight.swap(queued);
+		buffers.clear();
+		for (const auto &f : in_flight)
+			buffers.push_back(asio::buffer(*f));
+		writing = true;
+		asio::async_write(socket, buffers,
+			[self = shared_from_this()](const asio::error_code &ec, std::size_t)
+			{
+				self->writing = false;
+				self->in_flight.clear();
+				if (ec)
+					self->shutdown();
+				else if (!self->queued.empty())
+					self->flush();
+				else if (self->closing)
+					self->shutdown();
+			});
+	}
+
+	void shutdown()
+	{
+		asio::error_code ec;
+		socket.shutdown(tcp::socket::shutdown_both, ec);
+		socket.close(ec);
+	}
+};
+
+/**
+ * @brief The state of one game. Only used from the thread of the shard that
+ * owns it.
+ */
+class server::game : public std::enable_shared_from_this<game>
+{
+public:
+	/**
+	 * @brief How long the seat of a player whose connection dropped is kept.
+	 */
+	static constexpr std::chrono::seconds RESUME_TIMEOUT {30};
+
+	/**
+	 * @param registry The lobby the game is registered in, if any
+	 * @param key The decoded game code of the game in the lobby
+	 */
+	game(shard &owner, uint16_t uid, lobby *registry, uint64_t key)
+			: owner(owner), uid(uid), registry(registry), key(key),
+			  resume_timers {asio::steady_timer(owner.io),
+							 asio::steady_timer(owner.io)},
+			  over(false), snapshot_ply(-1)
+	{
+		++owner.game_count;
+	}
+
+	~game() { --owner.game_count; }
+
+	/**
+	 * @brief Give a new connection a seat, and the token that lets it take
+	 * the seat back if its connection drops.
+	 * @return The color of the player, or -1 if the game is full
+	 */
+	int seat(const std::shared_ptr<session> &s, uint64_t &token)
+	{
+		for (int c : {0, 1})
+			if (!players[c] and !left[c] and !away[c])
+			{
+				players[c] = s;
+				tokens[c] = token = new_token();
+				return c;
+			}
+		return -1;
+	}
+
+	/**
+	 * @brief Give a player whose connection dropped its seat back, and send
+	 * it the ply of the game and every move from the one it has on.
+	 * @param ply The number of moves the player has
+	 * @return The color of the player, or -1 if the token is not for a seat
+	 * being kept
+	 */
+	int resume(const std::shared_ptr<session> &s, uint64_t token, uint16_t ply)
+	{
+		// both seats are compared whatever the first gives, so the time
+		// taken says nothing about the tokens
+		const bool matches[2] = {same_token(tokens[0], token),
+								 same_token(tokens[1], token)};
+		for (int c : {0, 1})
+			if (away[c] and matches[c])
+			{
+				away[c] = false;
+				resume_timers[c].cancel();
+				players[c] = s;
+				s->hello();
+				const char body[] = {static_cast<char>(log.size() >> 8),
+									 static_cast<char>(log.size() & 0xFF)};
+				s->send(header::resume, std::string_view(body, sizeof(body)));
+				for (std::size_t i = ply; i < log.size(); ++i)
+					s->send(header::move, log[i]);
+				if (outcome)
+					s->send(header::game_over, outcome);
+				return c;
+			}
+		return -1;
+	}
+
+	/**
+	 * @brief The connection of a player dropped without a disconnect
+	 * message. A player with a token keeps the seat for RESUME_TIMEOUT, and
+	 * leaves once it has passed.
+	 */
+	void lost(int color)
+	{
+		if (over or players[color]->protocol() < frames::VERSION)
+		{
+			leave(color);
+			return;
+		}
+		players[color]->close();
+		players[color].reset();
+		away[color] = true;
+		resume_timers[color].expires_after(RESUME_TIMEOUT);
+		resume_timers[color].async_wait(
+			[self = weak_from_this(), color](const asio::error_code &ec)
+			{
+				const auto g = self.lock();
+				if (!ec and g and g->away[color])
+					g->leave(color);
+			});
+	}
+
+	/**
+	 * @brief Add a watcher, and send it the position.
+	 */
+	void watch(const std::shared_ptr<spectator> &s)
+	{
+		watchers.push_back(s);
+		s->send(snapshot(), true, [this] { return snapshot(); });
+	}
+
+	/**
+	 * @brief Remove a watcher that has gone.
+	 */
+	void unwatch(const spectator *s)
+	{
+		for (auto &w : watchers)
+			if (w.get() == s)
+			{
+				w->close();
+				w = std::move(watchers.back());
+				watchers.pop_back();
+				break;
+			}
+	}
+
+	/**
+	 * @brief Handle a message from a player.
+	 * @param payload In the form of a frame, whichever protocol the player
+	 * uses
+	 */
+	void on_message(int color, header h, std::string_view payload)
+	{
+		CHESS_COUNT(messages_received);
+		switch (h)
+		{
+		case header::move:
+		{
+			std::string_view move;
+			int64_t clock;
+			const char *result = nullptr;
+			if (!frames::parse_move(payload, move, clock) or
+				!play(color, move, result))
+			{
+				players[color]->send(header::reject, payload);
+				break;
+			}
+			log.emplace_back(payload);
+			if (players[!color])
+				players[!color]->send(header::move, payload);
+			broadcast(header::move, payload);
+			if (result)
+			{
+				outcome = result;
+				for (auto &p : players)
+					if (p)
+						p->send(header::game_over, result);
+				broadcast(header::game_over, result);
+			}
+			break;
+		}
+		case header::fen:
+			if (payload.empty())
+				players[color]->send(header::fen, b.fen());
+			else
+				players[color]->send(header::reject, payload);
+			break;
+		case header::chat:
+		case header::sync:
+		case header::resync:
+		case header::delta:
+			if (players[!color])
+				players[!color]->send(h, payload);
+			break;
+		case header::metadata:
+			if (players[!color])
+				players[!color]->send(h, payload);
+			broadcast(h, payload);
+			break;
+		case header::ping:
+			players[color]->send(header::pong, payload);
+			break;
+		case header::pong:
+			break;
+		case header::disconnect:
+			leave(color);
+			break;
+		default:
+			players[color]->send(header::reject, payload);
+			break;
+		}
+	}
+
+	/**
+	 * @brief A player left, so the game is over for both.
+	 */
+	void leave(int color)
+	{
+		left[color] = true;
+		away[color] = false;
+		if (players[color])
+			players[color]->close();
+		players[color].reset();
+		if (players[!color])
+		{
+			players[!color]->send(header::disconnect, "    ");
+			players[!color]->close();
+			players[!color].reset();
+		}
+		left[!color] = true;
+		away[!color] = false;
+		broadcast(header::disconnect, "    ");
+		for (auto &w : watchers)
+			w->close();
+		watchers.clear();
+		if (registry)
+			registry->close(key);
+		owner.games.erase(uid);
+	}
+
+	/**
+	 * @brief Drop both players without telling them, when the server stops.
+	 */
+	void drop()
+	{
+		for (auto &p : players)
+			if (p)
+			{
+				p->close();
+				p.reset();
+			}
+		for (auto &w : watchers)
+			w->close();
+		watchers.clear();
+	}
+
+private:
+	shard &owner;
+	uint16_t uid;
+	lobby *registry;
+	uint64_t key;
+	chess::board b;
+	std::shared_ptr<session> players[2];
+	bool left[2] = {false, false};
+	bool away[2] = {false, false};	// dropped, with the seat kept
+	uint64_t tokens[2] = {0, 0};
+	asio::steady_timer resume_timers[2];
+	bool over;
+	const char *outcome = nullptr;	// the result once over
+	std::vector<std::string> log;	// every move played, as a frame payload
+	std::vector<std::shared_ptr<spectator>> watchers;
+	int ply = 0;
+	spectator::frame position;	// the FEN frame, made when first needed
+	int snapshot_ply;			// the ply of position
+
+	/**
+	 * @brief Encode a frame once for every watcher.
+	 */
+	void broadcast(header h, std::string_view payload)
+	{
+		if (watchers.empty())
+			return;
+		std::string encoded;
+		frames::append(encoded, h, payload);
+		const auto f = std::make_shared<const std::string>(std::move(encoded));
+		for (auto &w : watchers)
+			w->send(f, h == header::move, [this] { return snapshot(); });
+	}
+
+	/**
+	 * @brief A frame with the FEN of the game, shared by every watcher that
+	 * needs it until the next move.
+	 */
+	const spectator::frame &snapshot()
+	{
+		if (snapshot_ply != ply)
+		{
+			std::string encoded;
+			frames::append(encoded, header::fen, b.fen());
+			position = std::make_shared<const std::string>(std::move(encoded));
+			snapshot_ply = ply;
+		}
+		return position;
+	}
+
+	/**
+	 * @brief Play a move if it is legal.
+	 * @param move The move in coordinate notation, with an optional promotion
+	 * letter. Promotions are to a queen without one.
+	 * @param result Set to the result if the move ended the game
+	 * @return true if the move was played, false otherwise
+	 */
+	bool play(int color, std::string_view move, const char *&result)
+	{
+		if (over or (!players[!color] and !away[!color]) or b.turn() != color)
+			return false;
+		using status = chess::board::move_status;
+		chess::board::move_t m;
+		int promotion;
+		if (chess::board::parse_coordinates(move, m, promotion) != status::ok or
+			b.play(m, promotion) != status::ok)
+			return false;
+		++ply;
+
+		if (b.legal_moves().empty())
+			result = !b.is_check(b.turn()) ? "1/2 " : b.turn() ? "1-0 " : "0-1 ";
+		else if (b.is_draw())
+			result = "1/2 ";
+		over = result != nullptr;
+		return true;
+	}
+};
+
+void server::spectator::read()
+{
+	// watchers have nothing to say, so anything they send is ignored until
+	// they go
+	socket.async_read_some(asio::buffer(in),
+		[self = shared_from_this()](const asio::error_code &ec, std::size_t)
+		{
+			auto g = self->current;
+			if (!g)
+				return;
+			if (ec)
+				g->unwatch(self.get());
+			else
+				self->read();
+		});
+}
+
+void server::session::read()
+{
+	if (version >= frames::VERSION)
+	{
+		read_frames();
+		return;
+	}
+	asio::async_read(socket, asio::buffer(in),
+		[self = shared_from_this()](const asio::error_code &ec, std::size_t)
+		{
+			auto g = self->current;
+			if (!g)
+				return;
+			if (ec)
+			{
+				g->lost(self->color);
+				return;
+			}
+			chess::trace::span tick("tick", "server", "bytes",
+									handler::MSG_SIZE);
+			const auto h = static_cast<header>(self->in[0]);
+			const std::string_view body(self->in.data() + 1, self->in.size() - 1);
+			if (h == header::move)
+				g->on_message(self->color, h, frames::move_payload(body));
+			else
+				g->on_message(self->color, h, body);
+			if (!self->closing)
+				self->read();
+		});
+}
+
+void server::session::read_frames()
+{
+	socket.async_read_some(asio::buffer(frames_in.prepare(READ_SIZE), READ_SIZE),
+		[self = shared_from_this()](const asio::error_code &ec, std::size_t n)
+		{
+			auto g = self->current;
+			if (!g)
+				return;
+			if (ec)
+			{
+				g->lost(self->color);
+				return;
+			}
+			chess::trace::span tick("tick", "server", "bytes", n);
+			self->frames_in.commit(n);
+			header h;
+			std::string_view payload;
+			while (!self->closing and self->frames_in.next(h, payload))
+				g->on_message(self->color, h, payload);
+			if (!self->closing)
+				self->read_frames();
+		});
+}
+
+server::server(uint16_t port, unsigned threads, bool no_delay,
+			   lobby *registry, uint32_t ip)
+		: shards([threads] {
+			  std::vector<std::unique_ptr<shard>> s;
+			  for (unsigned i = 0; i < std::max(threads, 1u); ++i)
+				  s.push_back(std::make_unique<shard>());
+			  return s;
+		  }()),
+		  acceptor(shards[0]->io, tcp::endpoint(tcp::v4(), port)),
+		  next_shard(0),
+		  no_delay(no_delay),
+		  registry(registry),
+		  endpoint(lobby::key(ip, port, 0))
+{
+	accept();
+	for (auto &s : shards)
+		s->thread = std::thread([&io = s->io] {
+			chess::trace::name_thread("server shard");
+			io.run();
+		});
+}
+
+server::~server()
+{
+	for (auto &s : shards)
+	{
+		s->work.reset();
+		s->io.stop();
+	}
+	for (auto &s : shards)
+		s->thread.join();
+
+	// with no thread left to run its handlers the acceptor can be closed
+	// from here, which a handler posted before stop() was not sure to do
+	asio::error_code ec;
+	acceptor.close(ec);
+	for (auto &s : shards)
+	{
+		for (auto &[uid, g] : s->games)
+			g->drop();
+		s->games.clear();
+	}
+}
+
+uint16_t server::port() const
+{
+	return acceptor.local_endpoint().port();
+}
+
+std::size_t server::games() const
+{
+	std::size_t n = 0;
+	for (const auto &s : shards)
+		n += s->game_count;
+	return n;
+}
+
+std::size_t server::connections() const
+{
+	std::size_t n = 0;
+	for (const auto &s : shards)
+		n += s->connection_count;
+	return n;
+}
+
+void server::accept()
+{
+	// spread the handshakes over the threads
+	const std::size_t index = next_shard++ % shards.size();
+	acceptor.async_accept(shards[index]->io,
+		[this, index](const asio::error_code &ec, tcp::socket socket)
+		{
+			if (ec == asio::error::operation_aborted)
+				return;
+			if (!ec)
+			{
+				asio::error_code ignored;
+				socket.set_option(tcp::no_delay(no_delay), ignored);
+				handshake(std::make_shared<tcp::socket>(std::move(socket)), index);
+			}
+			accept();
+		});
+}
+
+void server::handshake(std::shared_ptr<tcp::socket> socket, std::size_t index)
+{
+	auto msg = std::make_shared<std::array<char, handler::MSG_SIZE>>();
+	++shards[index]->connection_count;
+	asio::async_read(*socket, asio::buffer(*msg),
+		[this, socket, msg, index](const asio::error_code &ec, std::size_t)
+		{
+			--shards[index]->connection_count;
+			if (ec)
+				return;
+			const auto field = [&msg](int i) -> uint16_t {
+				return static_cast<uint8_t>((*msg)[i]) << 8 |
+					   static_cast<uint8_t>((*msg)[i + 1]);
+			};
+
+			// a hello or a watch request carries the highest version the
+			// client speaks, and watchers need frames
+			uint16_t uid, version = frames::LEGACY_VERSION;
+			const auto h = static_cast<header>((*msg)[0]);
+			const bool hello = h == header::hello;
+			switch (h)
+			{
+			case header::connection_request:
+				uid = field(1);
+				break;
+			case header::hello:
+			case header::watch:
+			case header::resume:
+				version = std::min(frames::VERSION, field(1));
+				uid = field(3);
+				if (h != header::hello and version < frames::VERSION)
+					return;
+				break;
+			default:
+				return;
+			}
+			const auto enter = [this, h, uid, hello, version](
+				std::size_t owner, tcp::socket s)
+			{
+				if (h == header::watch)
+					watch(owner, std::move(s), uid, version);
+				else if (h == header::resume)
+					resume(owner, std::move(s), uid, version);
+				else
+					join(owner, std::move(s), uid, hello, version);
+			};
+
+			// hand the connection to the thread that owns the game
+			const std::size_t owner = uid % shards.size();
+			if (owner == index)
+			{
+				enter(owner, std::move(*socket));
+				return;
+			}
+			asio::error_code release_error;
+			const auto fd = socket->release(release_error);
+			if (release_error)
+				return;
+			asio::post(shards[owner]->io, [this, owner, fd, enter] {
+				enter(owner, tcp::socket(shards[owner]->io, tcp::v4(), fd));
+			});
+		});
+}
+
+void server::join(std::size_t index, tcp::socket socket, uint16_t uid,
+				  bool hello, uint16_t version)
+{
+	shard &s = *shards[index];
+
+	// the answer to a hello goes out in the same write as the board hash
+	auto player = std::make_shared<session>(std::move(socket), s, version);
+	if (hello)
+		player->hello();
+
+	// with a lobby, only games created in it can be played
+	auto found = s.games.find(uid);
+	if (found == s.games.end())
+	{
+		const uint64_t key = endpoint | uid;
+		if (registry and !registry->join(key))
+		{
+			player->send(header::reject, "none");
+			player->close();
+			return;
+		}
+		found = s.games.emplace(uid, std::make_shared<game>(s, uid, registry,
+															key)).first;
+	}
+	const auto &g = found->second;
+	uint64_t token;
+	const int color = g->seat(player, token);
+	if (color < 0)
+	{
+		player->send(header::reject, "full");
+		player->close();
+		return;
+	}
+	const uint32_t hash = chess::board()();
+	const char body[] = {
+		static_cast<char>(hash >> 24), static_cast<char>(hash >> 16),
+		static_cast<char>(hash >> 8), static_cast<char>(hash & 0xFF)};
+	player->send(header::board_hash, std::string_view(body, sizeof(body)));
+
+	// only frames can carry the token to resume with
+	if (version >= frames::VERSION)
+	{
+		char encoded[8];
+		for (int i = 0; i < 8; ++i)
+			encoded[i] = static_cast<char>(token >> (56 - 8 * i));
+		player->send(header::token, std::string_view(encoded, sizeof(encoded)));
+	}
+	player->start(g, color);
+}
+
+void server::resume(std::size_t index, tcp::socket socket, uint16_t uid,
+					uint16_t version)
+{
+	// the token and the ply follow the request in a frame of their own
+	auto s = std::make_shared<tcp::socket>(std::move(socket));
+	auto request =
+		std::make_shared<std::array<char, frames::HEADER_SIZE + RESUME_SIZE>>();
+	asio::async_read(*s, asio::buffer(*request),
+		[this, s, request, index, uid, version](const asio::error_code &ec,
+												std::size_t)
+		{
+			if (ec)
+				return;
+			shard &sh = *shards[index];
+			const auto &r = *request;
+			auto player = std::make_shared<session>(std::move(*s), sh, version);
+
+			const auto found = sh.games.find(uid);
+			int color = -1;
+			if (r[0] == 0 and r[1] == RESUME_SIZE and
+				static_cast<header>(r[2]) == header::resume and
+				found != sh.games.end())
+			{
+				uint64_t token = 0;
+				for (std::size_t i = 0; i < 8; ++i)
+					token = token << 8 | static_cast<uint8_t>(r[3 + i]);
+				const auto ply = static_cast<uint16_t>(
+					static_cast<uint8_t>(r[11]) << 8 | static_cast<uint8_t>(r[12]));
+				color = found->second->resume(player, token, ply);
+			}
+			if (color < 0)
+			{
+				player->send_fixed(header::reject, "none");
+				player->close();
+				return;
+			}
+			player->start(found->second, color);
+		});
+}
+
+void server::watch(std::size_t index, tcp::socket socket, uint16_t uid,
+				   uint16_t version)
+{
+	shard &s = *shards[index];
+	auto watcher = std::make_shared<spectator>(std::move(socket), s);
+	std::string hello(1, static_cast<char>(header::hello));
+	hello += static_cast<char>(version >> 8);
+	hello += static_cast<char>(version & 0xFF);
+	hello.append(2, '\0');
+	watcher->send(std::make_shared<const std::string>(std::move(hello)));
+
+	const auto found = s.games.find(uid);
+	if (found == s.games.end())
+	{
+		std::string reject;
+		frames::append(reject, header::reject, "none");
+		watcher->send(std::make_shared<const std::string>(std::move(reject)));
+		watcher->close();
+		return;
+	}
+	found->second->watch(watcher);
+	watcher->start(found->second);
+}
+
+std::size_t server::spectators() const
+{
+	std::size_t n = 0;
+	for (const auto &s : shards)
+		n += s->spectator_count;
+	return n;
+}
+
+}
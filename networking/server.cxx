@@ -0,0 +1,70 @@
+#include "server.hpp"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+int main(int argc, char **argv)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	if (argc < 2 or argc > 4)
+	{
+		std::cout << "Usage: " << argv[0] << " [port] [threads] [IPv4]\n"
+				  << "Hosts any number of games. Generate a game code for "
+					 "each game with code_generator\n"
+				  << "using this machine's address and the port, and give it "
+					 "to both players.\n"
+				  << "Given this machine's address, only games created by "
+					 "typing \"new\" can be\n"
+				  << "played, and those nobody joins within 10 minutes "
+					 "expire.\n"
+				  << "Type \"stats\" for the number of games, connections and "
+					 "spectators and \"quit\"\nto stop." << std::endl;
+		return 0;
+	}
+	const auto port = static_cast<uint16_t>(atoi(argv[1]));
+	if (argc >= 3)
+		threads = std::max(1, atoi(argv[2]));
+
+	try
+	{
+		std::unique_ptr<networking::lobby> registry;
+		uint32_t ip = 0;
+		if (argc == 4)
+		{
+			ip = networking::codes::ip_to_int(argv[3]);
+			registry = std::make_unique<networking::lobby>(
+				std::vector<std::pair<uint32_t, uint16_t>> {{ip, port}},
+				std::chrono::minutes(10));
+		}
+
+		networking::server s(port, threads, true, registry.get(), ip);
+		std::cout << "Serving on port " << port << " with " << threads
+				  << " threads" << std::endl;
+
+		std::string line;
+		while (std::getline(std::cin, line) and line != "quit")
+			if (line == "stats")
+			{
+				std::cout << s.games() << " games, " << s.connections()
+						  << " connections, " << s.spectators()
+						  << " spectators";
+				if (registry)
+					std::cout << ", " << registry->size() << " in the lobby";
+				std::cout << std::endl;
+			}
+			else if (line == "new" and registry)
+			{
+				const std::string code = registry->create();
+				std::cout << (code.empty() ? "No game codes left" : code)
+						  << std::endl;
+			}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
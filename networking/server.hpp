@@ -0,0 +1,154 @@
+#pragma once
+
+#include "handler.hpp"
+#include "lobby.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace networking {
+
+/**
+ * @brief A server hosting any number of games at once with asynchronous I/O.
+ *
+ * Clients connect and send a connection request with the unique ID of their
+ * game code, exactly as a slave does with a master, or a hello to use frames
+ * (see frame.hpp). The first two clients with the same ID play a game against
+ * each other, the first one with white. Each is answered with the hash of the
+ * starting board. Players with and without frames can play each other, and
+ * messages are translated between the two.
+ *
+ * The server runs one io_context per thread. Every game belongs to the thread
+ * chosen by its ID, along with the connections of both its players, so the
+ * state of a game is only ever touched by one thread and needs no lock. A
+ * connection accepted on another thread is handed over after its request.
+ *
+ * Every move is checked against the server's board of the game. Legal moves
+ * are passed on to the opponent. Illegal moves, and moves out of turn, are
+ * answered with a reject message carrying the move. Promotions are to a queen
+ * unless the move carries another piece. With frames, moves keep the clock
+ * they carry, a fen message with no payload is answered with the FEN of the
+ * game, and chat, metadata, sync, resync and delta messages are passed on to
+ * the opponent (see sync.hpp). A ping is answered with a pong carrying the
+ * same payload. When the game ends both players get a game_over message
+ * carrying "1-0 ", "0-1 " or "1/2 ". When a player leaves the opponent gets a
+ * disconnect message.
+ *
+ * Players with frames also get a token message after the board hash, with 8
+ * random bytes. If such a player's connection drops without a disconnect
+ * message, its seat is kept for game::RESUME_TIMEOUT and the game carries on
+ * without it, every move being logged. It takes the seat back by connecting
+ * and sending a resume message laid out like a hello, followed by a resume
+ * frame with the token and the number of moves it has, 2 bytes. It is
+ * answered with a hello, a resume frame with the number of moves played, 2
+ * bytes, and the moves it missed, then plays on. A resume request that does
+ * not match a seat being kept gets a fixed-size reject message carrying
+ * "none". See slave::resume().
+ *
+ * Any number of clients can watch a game in progress by sending a watch
+ * message laid out like a hello. Watchers always use frames. They are
+ * answered with a hello and a fen message with the position, then get every
+ * move and metadata message, the game_over message and the disconnect
+ * message. Each frame is
+ * encoded once and shared by every watcher. A watcher more than
+ * spectator::MAX_QUEUED frames behind gets the position instead of the moves
+ * it missed. A watch request for a game that has no players gets a reject
+ * message carrying "none".
+ */
+class server
+{
+public:
+	/**
+	 * @brief Start serving.
+	 * @param port The port to listen on
+	 * @param threads The number of I/O threads
+	 * @param no_delay Whether to turn Nagle's algorithm off for every
+	 * connection. Writes are already combined by the server, so this is on by
+	 * default.
+	 * @param registry A lobby to take games from, or nullptr to play any game
+	 * asked for. A game must have been created in the lobby to be played, and
+	 * is closed in it when it ends.
+	 * @param ip The address of this server in the lobby's game codes
+	 */
+	server(uint16_t port, unsigned threads, bool no_delay = true,
+		   lobby *registry = nullptr, uint32_t ip = 0);
+
+	/**
+	 * @brief Stop serving and drop every connection.
+	 */
+	~server();
+
+	server(const server &) = delete;
+	server &operator=(const server &) = delete;
+
+	/**
+	 * @brief The port being listened on, which was chosen by the system if
+	 * port 0 was asked for.
+	 */
+	uint16_t port() const;
+
+	/**
+	 * @brief The number of games with at least one player connected.
+	 */
+	std::size_t games() const;
+
+	/**
+	 * @brief The number of open connections, including those still sending
+	 * their connection request.
+	 */
+	std::size_t connections() const;
+
+	/**
+	 * @brief The number of connections watching a game.
+	 */
+	std::size_t spectators() const;
+
+private:
+	using tcp = asio::ip::tcp;
+
+	static constexpr std::size_t RESUME_SIZE = 10;	// the token and the ply
+
+	class session;
+	class spectator;
+	class game;
+
+	/**
+	 * @brief An I/O thread and everything it owns. The counters come first,
+	 * so they outlive the sessions and games whose destructors decrement
+	 * them, including the ones held by handlers that are only destroyed
+	 * with io, and io outlives the games and their timers.
+	 */
+	struct shard
+	{
+		std::atomic<std::size_t> game_count {0};
+		std::atomic<std::size_t> connection_count {0};
+		std::atomic<std::size_t> spectator_count {0};
+		asio::io_context io;
+		asio::executor_work_guard<asio::io_context::executor_type> work;
+		std::unordered_map<uint16_t, std::shared_ptr<game>> games;
+		std::thread thread;
+
+		shard() : work(asio::make_work_guard(io)) {}
+	};
+
+	std::vector<std::unique_ptr<shard>> shards;
+	tcp::acceptor acceptor;
+	std::size_t next_shard;
+	bool no_delay;
+	lobby *registry;
+	uint64_t endpoint;	// the lobby key of this server without the ID
+
+	void accept();
+	void handshake(std::shared_ptr<tcp::socket> socket, std::size_t index);
+	void join(std::size_t index, tcp::socket socket, uint16_t uid, bool hello,
+			  uint16_t version);
+	void watch(std::size_t index, tcp::socket socket, uint16_t uid,
+			   uint16_t version);
+	void resume(std::size_t index, tcp::socket socket, uint16_t uid,
+				uint16_t version);
+};
+
+}
@@ -0,0 +1,309 @@
+#include "shm_transport.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace networking {
+
+namespace {
+constexpr uint32_t MAGIC = 0x43534D31;	// "CSM1"
+
+/**
+ * @brief How many times to poll before sleeping. Polling only helps when the
+ * other side can run at the same time.
+ */
+const int SPINS = std::thread::hardware_concurrency() > 1 ? 4000 : 0;
+
+/**
+ * @brief How long a sleeping reader or writer waits before it checks that the
+ * other process is still alive.
+ */
+constexpr timespec LIVENESS_INTERVAL = {0, 200'000'000};
+
+/**
+ * @brief Futexes shared between processes, so not FUTEX_PRIVATE_FLAG.
+ * @return false if the wait timed out
+ */
+bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected)
+{
+	return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT,
+				   expected, &LIVENESS_INTERVAL, nullptr, 0) == 0 or
+		   errno != ETIMEDOUT;
+}
+
+void futex_wake(std::atomic<uint32_t> &word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE,
+			INT32_MAX, nullptr, nullptr, 0);
+}
+
+inline void pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+std::string segment_name(uint16_t port, uint16_t uid)
+{
+	return "/chess-" + std::to_string(port) + "-" + std::to_string(uid);
+}
+}
+
+/**
+ * @brief One direction of the connection. head and tail count every byte
+ * ever written and read.
+ */
+struct shm_transport::ring
+{
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) std::atomic<uint32_t> readable;	// bumped to wake the reader
+	std::atomic<uint32_t> reader_sleeping;
+	alignas(64) std::atomic<uint32_t> writable;	// bumped to wake the writer
+	std::atomic<uint32_t> writer_sleeping;
+	alignas(64) char data[RING_SIZE];
+};
+
+struct shm_transport::segment
+{
+	uint32_t magic;
+	std::atomic<uint32_t> attached;
+	std::atomic<uint32_t> accepted;
+	std::atomic<uint32_t> closed;
+	std::atomic<int32_t> pids[2];	// of the master and the slave
+	ring rings[2];	// from the master, and to it
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free and
+			  std::atomic<uint32_t>::is_always_lock_free,
+			  "Atomics in shared memory must be lock free");
+
+shm_transport::shm_transport(segment *shared, bool master, std::string name)
+		: shared(shared),
+		  in(&shared->rings[master ? 1 : 0]),
+		  out(&shared->rings[master ? 0 : 1]),
+		  peer(&shared->pids[master ? 1 : 0]),
+		  name(std::move(name)),
+		  named(master)
+{
+	shared->pids[master ? 0 : 1].store(getpid());
+}
+
+shm_transport::~shm_transport()
+{
+	close();
+	if (named)
+		shm_unlink(name.c_str());
+	munmap(shared, sizeof(segment));
+}
+
+std::unique_ptr<shm_transport> shm_transport::offer(uint16_t port, uint16_t uid)
+{
+	std::string name = segment_name(port, uid);
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return nullptr;
+	void *memory = MAP_FAILED;
+	if (ftruncate(fd, sizeof(segment)) == 0)
+		memory = mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE,
+					  MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+
+	// the memory starts zeroed, so only the magic number is left to write,
+	// last
+	auto *s = static_cast<segment *>(memory);
+	std::atomic_ref<uint32_t>(s->magic).store(MAGIC, std::memory_order_release);
+	return std::unique_ptr<shm_transport>(new shm_transport(s, true, name));
+}
+
+std::unique_ptr<shm_transport> shm_transport::attach(uint16_t port, uint16_t uid)
+{
+	std::string name = segment_name(port, uid);
+	const int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return nullptr;
+	void *memory = MAP_FAILED;
+	struct stat st;
+	if (fstat(fd, &st) == 0 and
+		static_cast<std::size_t>(st.st_size) == sizeof(segment))
+		memory = mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE,
+					  MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED)
+		return nullptr;
+
+	auto *s = static_cast<segment *>(memory);
+	uint32_t free = 0;
+	if (std::atomic_ref<uint32_t>(s->magic).load(std::memory_order_acquire) !=
+			MAGIC or
+		!s->attached.compare_exchange_strong(free, 1))
+	{
+		munmap(memory, sizeof(segment));
+		return nullptr;
+	}
+	return std::unique_ptr<shm_transport>(new shm_transport(s, false, name));
+}
+
+bool shm_transport::is_local(const asio::ip::address &address)
+{
+	if (address.is_loopback())
+		return true;
+	if (!address.is_v4())
+		return false;
+	ifaddrs *list;
+	if (getifaddrs(&list) != 0)
+		return false;
+	bool found = false;
+	const uint32_t ip = address.to_v4().to_uint();
+	for (ifaddrs *i = list; i and !found; i = i->ifa_next)
+		if (i->ifa_addr and i->ifa_addr->sa_family == AF_INET)
+			found = ntohl(reinterpret_cast<sockaddr_in *>(i->ifa_addr)
+							  ->sin_addr.s_addr) == ip;
+	freeifaddrs(list);
+	return found;
+}
+
+bool shm_transport::accept()
+{
+	if (!shared->attached.load())
+		return false;
+	shared->accepted.store(1);
+	shm_unlink(name.c_str());
+	named = false;
+	return true;
+}
+
+bool shm_transport::accepted() const
+{
+	return shared->accepted.load() != 0;
+}
+
+bool shm_transport::peer_alive()
+{
+	const pid_t pid = peer->load();
+	if (pid <= 0 or ::kill(pid, 0) == 0 or errno != ESRCH)
+		return true;
+	close();
+	return false;
+}
+
+bool shm_transport::write(const char *data, std::size_t size)
+{
+	while (size)
+	{
+		const uint64_t head = out->head.load(std::memory_order_relaxed);
+		uint64_t tail = out->tail.load(std::memory_order_acquire);
+		for (int spin = 0; head - tail == RING_SIZE; ++spin)
+		{
+			if (shared->closed.load(std::memory_order_relaxed))
+				return false;
+			if (spin < SPINS)
+				pause();
+			else
+			{
+				// announce the sleep, then look again, so a read in between
+				// is not missed
+				const uint32_t seen = out->writable.load();
+				out->writer_sleeping.store(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const bool woken = out->tail.load() != tail or
+					shared->closed.load() or futex_wait(out->writable, seen);
+				out->writer_sleeping.store(0);
+				if (!woken and !peer_alive())
+					return false;
+			}
+			tail = out->tail.load(std::memory_order_acquire);
+		}
+
+		const std::size_t n = std::min<std::size_t>(size, RING_SIZE - (head - tail));
+		const std::size_t at = head % RING_SIZE;
+		const std::size_t first = std::min(n, RING_SIZE - at);
+		std::memcpy(out->data + at, data, first);
+		std::memcpy(out->data, data + first, n - first);
+		out->head.store(head + n, std::memory_order_release);
+		data += n;
+		size -= n;
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (out->reader_sleeping.load(std::memory_order_relaxed))
+		{
+			out->readable.fetch_add(1);
+			futex_wake(out->readable);
+		}
+	}
+	return !shared->closed.load(std::memory_order_relaxed);
+}
+
+std::size_t shm_transport::read_some(char *buffer, std::size_t size)
+{
+	const uint64_t tail = in->tail.load(std::memory_order_relaxed);
+	uint64_t head = in->head.load(std::memory_order_acquire);
+	for (int spin = 0; head == tail; ++spin)
+	{
+		if (shared->closed.load(std::memory_order_relaxed))
+			return 0;
+		if (spin < SPINS)
+			pause();
+		else
+		{
+			const uint32_t seen = in->readable.load();
+			in->reader_sleeping.store(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const bool woken = in->head.load() != tail or
+				shared->closed.load() or futex_wait(in->readable, seen);
+			in->reader_sleeping.store(0);
+			if (!woken and !peer_alive())
+				return 0;
+		}
+		head = in->head.load(std::memory_order_acquire);
+	}
+
+	const std::size_t n = std::min<std::size_t>(size, head - tail);
+	const std::size_t at = tail % RING_SIZE;
+	const std::size_t first = std::min(n, RING_SIZE - at);
+	std::memcpy(buffer, in->data + at, first);
+	std::memcpy(buffer + first, in->data, n - first);
+	in->tail.store(tail + n, std::memory_order_release);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (in->writer_sleeping.load(std::memory_order_relaxed))
+	{
+		in->writable.fetch_add(1);
+		futex_wake(in->writable);
+	}
+	return n;
+}
+
+void shm_transport::close()
+{
+	if (shared->closed.exchange(1))
+		return;
+	for (ring &r : shared->rings)
+	{
+		r.readable.fetch_add(1);
+		futex_wake(r.readable);
+		r.writable.fetch_add(1);
+		futex_wake(r.writable);
+	}
+}
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define ASIO_STANDALONE
+#include <asio.hpp>
+
+namespace networking {
+
+/**
+ * @brief A connection between two processes on the same machine through
+ * shared memory, used by a master and a slave in place of their socket.
+ *
+ * The master offers a segment named after its port and the unique ID of the
+ * game. A slave on the same machine attaches to it before sending its
+ * connection request, and the master accepts it if the request comes from
+ * this machine, before it sends the board hash. From then on the socket is
+ * left idle, and the bytes of every message go through a ring per direction.
+ *
+ * Each ring has one writer and one reader. A reader with nothing to read
+ * spins for a moment, then sleeps on a futex that the writer only wakes when
+ * the reader has said it is sleeping, so a busy connection makes no system
+ * calls at all.
+ *
+ * As the socket is idle, the end of the other process would go unnoticed if
+ * it died without closing the connection, i.e. from SIGKILL or a crash. Each
+ * side writes its pid into the segment, and a reader or writer that has
+ * slept for 200 ms without being woken checks that the other process still
+ * exists, closing the connection if it does not. A dead peer is then noticed
+ * within 200 ms of anything waiting on it, like an end of file on a socket.
+ */
+class shm_transport
+{
+public:
+	static constexpr std::size_t RING_SIZE = 1 << 16;
+
+	~shm_transport();
+
+	shm_transport(const shm_transport &) = delete;
+	shm_transport &operator=(const shm_transport &) = delete;
+
+	/**
+	 * @brief Offer a segment for a game, replacing any left behind.
+	 * @return nullptr if shared memory is not available
+	 */
+	static std::unique_ptr<shm_transport> offer(uint16_t port, uint16_t uid);
+
+	/**
+	 * @brief Attach to the segment offered for a game.
+	 * @return nullptr if there is none, or a slave has attached already
+	 */
+	static std::unique_ptr<shm_transport> attach(uint16_t port, uint16_t uid);
+
+	/**
+	 * @brief Whether an address belongs to this machine.
+	 */
+	static bool is_local(const asio::ip::address &address);
+
+	/**
+	 * @brief Accept the slave attached to an offered segment, and remove the
+	 * name of the segment so nobody else can attach.
+	 * @return false if no slave has attached
+	 */
+	bool accept();
+
+	/**
+	 * @brief Whether the master has accepted this slave.
+	 */
+	bool accepted() const;
+
+	/**
+	 * @brief Write all the bytes, waiting for room in the ring if needed.
+	 * Only one thread may write.
+	 * @return false if the connection is closed
+	 */
+	bool write(const char *data, std::size_t size);
+
+	/**
+	 * @brief Read at least one byte, waiting for them if needed. Only one
+	 * thread may read.
+	 * @return The number of bytes read, or 0 once the connection is closed
+	 */
+	std::size_t read_some(char *out, std::size_t size);
+
+	/**
+	 * @brief Close the connection for both sides, waking anything waiting.
+	 */
+	void close();
+
+private:
+	struct ring;
+	struct segment;
+
+	segment *shared;
+	ring *in, *out;
+	std::atomic<int32_t> *peer;	// the pid of the other side, 0 until known
+	std::string name;
+	bool named;
+
+	shm_transport(segment *shared, bool master, std::string name);
+
+	/**
+	 * @brief Check that the other process still exists, closing the
+	 * connection if it does not.
+	 */
+	bool peer_alive();
+};
+
+}
@@ -1,32 +1,91 @@
 #include "slave.hpp"
 
+#include <algorithm>
+
 namespace networking {
 
-slave::slave(const std::string &code, uint32_t initial_board_hash)
-	: handler(code), server(server_ip, server_port)
+slave::slave(const std::string &code, uint32_t initial_board_hash,
+			 uint16_t max_version, bool shared_memory)
+	: handler(code), server(server_ip, server_port),
+	  uid(codes::decode_uid(code))
 {
 	socket.connect(server, error_code);
-	log_error();
+	if (error_code)
+		throw std::runtime_error("Could not connect to the server: " +
+								 error_code.message());
 
-	uint16_t uid = codes::decode_uid(code);
-	asio::write(socket, to_buffer(header::connection_request, uid), error_code);
-	log_error();
+	// attach before asking, so the master knows to accept shared memory
+	if (shared_memory and shm_transport::is_local(server_ip))
+		local = shm_transport::attach(server_port, uid);
 
 	char buffer[MSG_SIZE];
+	if (max_version > frames::LEGACY_VERSION)
+	{
+		const char hello[MSG_SIZE] = {
+			static_cast<char>(header::hello),
+			static_cast<char>(max_version >> 8),
+			static_cast<char>(max_version & 0xFF),
+			static_cast<char>(uid >> 8), static_cast<char>(uid & 0xFF)};
+		asio::write(socket, asio::buffer(hello), error_code);
+		log_error();
+		asio::read(socket, asio::buffer(buffer, MSG_SIZE), error_code);
+		log_error();
+		if (error_code or static_cast<header>(buffer[0]) != header::hello)
+		{
+			socket.close();
+			throw std::runtime_error("The server does not support protocol "
+									 "version " + std::to_string(max_version));
+		}
+		version = std::min<uint16_t>(max_version,
+			static_cast<uint8_t>(buffer[1]) << 8 | static_cast<uint8_t>(buffer[2]));
+	}
+	else
+	{
+		asio::write(socket, to_buffer(header::connection_request, uid),
+					error_code);
+		log_error();
+	}
+
+	// the board hash is a frame with a 4-byte payload when frames are used,
+	// which ends with the same 5 bytes as a fixed-size message
+	if (version >= frames::VERSION)
+	{
+		char length[frames::HEADER_SIZE - 1];
+		asio::read(socket, asio::buffer(length), error_code);
+	}
 	asio::read(socket, asio::buffer(buffer, MSG_SIZE), error_code);
 	log_error();
 
-	uint32_t server_hash = static_cast<uint32_t>(buffer[0]) << 24 |
-						   static_cast<uint32_t>(buffer[1]) << 16 |
-						   static_cast<uint32_t>(buffer[2]) << 8 |
-						   static_cast<uint32_t>(buffer[3]);
-	if (static_cast<header>(buffer[0]) == header::board_hash and
-		server_hash == initial_board_hash)
+	if (static_cast<header>(buffer[0]) == header::reject)
+	{
+		socket.close();
+		throw std::runtime_error("The server rejected the game: " +
+								 std::string(buffer + 1, MSG_SIZE - 1));
+	}
+
+	// the master accepts shared memory before it sends the board hash
+	if (local and !local->accepted())
+		local.reset();
+
+	uint32_t server_hash = to_uint32(buffer + 1);
+	const bool hash_read = static_cast<header>(buffer[0]) == header::board_hash;
+	if (hash_read and server_hash == initial_board_hash)
+	{
+		connected = true;
+		stats.connected();
+	}
+	else if (hash_read and version >= frames::VERSION)
+	{
+		// the boards differ, which the master's position repairs
 		connected = true;
+		stats.connected();
+		sync.request_position(*this);
+		flush();
+	}
 	else
 	{
-
-		asio::write(socket, to_buffer(header::disconnect, uid), error_code);
+		queue(header::disconnect, "    ");
+		flush();
 		socket.close();
 		throw std::runtime_error("Your board is not the same as the server's "
 								 "board. "
@@ -35,7 +94,52 @@ slave::slave(const std::string &code, uint32_t initial_board_hash)
 	}
 }
 
+bool slave::resume(uint16_t ply)
+{
+	const uint64_t t = token.load();
+	if (!t or version < frames::VERSION)
+		return false;
 
+	// a new socket, with the same options as the one that dropped
+	tcp::no_delay no_delay;
+	socket.get_option(no_delay, error_code);
+	asio::error_code ignored;
+	socket.close(ignored);
+	local.reset();
+	socket.connect(server, error_code);
+	if (error_code)
+	{
+		log_error();
+		return false;
+	}
+	socket.set_option(no_delay, ignored);
+
+	// the request and the token go out in one write, and the answer is a
+	// fixed-size hello followed by frames
+	std::string request = {
+		static_cast<char>(header::resume),
+		static_cast<char>(version >> 8), static_cast<char>(version & 0xFF),
+		static_cast<char>(uid >> 8), static_cast<char>(uid & 0xFF)};
+	std::string body;
+	for (int shift = 56; shift >= 0; shift -= 8)
+		body += static_cast<char>(t >> shift);
+	body += static_cast<char>(ply >> 8);
+	body += static_cast<char>(ply & 0xFF);
+	frames::append(request, header::resume, body);
+	asio::write(socket, asio::buffer(request), error_code);
 
+	char answer[MSG_SIZE];
+	if (!error_code)
+		asio::read(socket, asio::buffer(answer), error_code);
+	if (error_code or static_cast<header>(answer[0]) != header::hello)
+	{
+		log_error();
+		socket.close(ignored);
+		return false;
+	}
+	connected = true;
+	stats.connected();
+	return true;
+}
 
 }
@@ -1,17 +1,59 @@
 #pragma once
 
 #include "handler.hpp"
+#include "frame.hpp"
+#include "sync.hpp"
 
 namespace networking {
 
 class slave : public handler
 {
 public:
-	slave(const std::string &code, uint32_t initial_board_hash);
+	/**
+	 * @brief Connect to a master or a server.
+	 * @param version The highest protocol version to ask for. Anything above
+	 * frames::LEGACY_VERSION sends a hello instead of a connection request, and
+	 * the connection uses frames if the other side agrees.
+	 * @param shared_memory Whether to use shared memory if the master is on
+	 * this machine and offers it
+	 *
+	 * If the boards differ and the connection uses frames, the master's
+	 * position is asked for through game() instead of giving up.
+	 *
+	 * @throws std::runtime_error if the boards differ without frames, or the
+	 * other side does not speak the version asked for
+	 */
+	slave(const std::string &code, uint32_t initial_board_hash,
+		  uint16_t version = frames::LEGACY_VERSION, bool shared_memory = true);
 	~slave() override = default;
 
+	/**
+	 * @brief Take the seat back in a game on a server after the connection
+	 * dropped, with a single round trip. Call once the listener has returned,
+	 * and start it again if this succeeds.
+	 *
+	 * The first message read after it is a resume message carrying the
+	 * number of moves the server has, 2 bytes in network byte order, and the
+	 * moves this side missed follow as ordinary move messages, to be played
+	 * on its board. If the server has fewer moves than this side, the last
+	 * move sent was lost with the connection and should be sent again.
+	 *
+	 * @param ply The number of moves played on this side's board
+	 * @return false if the server did not give a token, which needs frames,
+	 * or does not know it, or cannot be reached
+	 */
+	bool resume(uint16_t ply);
+
+	/**
+	 * @brief The position of the game, kept in step with the master from
+	 * the start. Play moves and wait for the master's with it.
+	 */
+	position_sync &game() { return sync; }
+
 private:
 	tcp::endpoint server;
+	uint16_t uid;
+	position_sync sync;
 };
 
 }
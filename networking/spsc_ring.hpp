@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace networking {
+
+/**
+ * @brief A bounded lock-free queue for exactly one producer thread and one
+ * consumer thread.
+ *
+ * The two indices live on separate cache lines, and each side keeps a cached
+ * copy of the other side's index so it only reads the shared one when the
+ * ring looks full or empty.
+ *
+ * @tparam T The element type, which should be cheap to copy and move
+ * @tparam N The capacity, a power of two
+ */
+template <typename T, std::size_t N>
+class spsc_ring
+{
+	static_assert(N and !(N & (N - 1)), "The capacity must be a power of two");
+
+public:
+	/**
+	 * @brief Add an element. Only call from the producer thread.
+	 * @return false if the ring is full
+	 */
+	bool try_push(const T &value)
+	{
+		const uint64_t h = head.load(std::memory_order_relaxed);
+		if (h - tail_cache == N)
+		{
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h - tail_cache == N)
+				return false;
+		}
+		slots[h & (N - 1)] = value;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Take the oldest element. Only call from the consumer thread.
+	 * @return false if the ring is empty
+	 */
+	bool try_pop(T &value)
+	{
+		const uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t == head_cache)
+		{
+			head_cache = head.load(std::memory_order_acquire);
+			if (t == head_cache)
+				return false;
+		}
+		value = std::move(slots[t & (N - 1)]);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Whether the ring is empty. Exact from the consumer thread, a
+	 * snapshot from any other.
+	 */
+	inline bool empty() const
+	{
+		return head.load(std::memory_order_acquire) ==
+			   tail.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * @brief The number of elements in the ring. Exact from the producer or
+	 * consumer thread for the changes they make, a snapshot from any other.
+	 */
+	inline std::size_t size() const
+	{
+		// tail first: head only grows, so the later load of it cannot be
+		// behind, and the difference cannot wrap
+		const uint64_t t = tail.load(std::memory_order_acquire);
+		return head.load(std::memory_order_acquire) - t;
+	}
+
+	static constexpr std::size_t capacity() { return N; }
+
+private:
+	alignas(64) std::atomic<uint64_t> head {0};	// written by the producer
+	uint64_t tail_cache = 0;					// the producer's view of tail
+	alignas(64) std::atomic<uint64_t> tail {0};	// written by the consumer
+	uint64_t head_cache = 0;					// the consumer's view of head
+	alignas(64) std::array<T, N> slots;
+};
+
+}
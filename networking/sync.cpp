@@ -0,0 +1,254 @@
+#include "sync.hpp"
+#include "frame.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace networking {
+
+namespace {
+constexpr uint8_t DELTA_MOVES = 0, DELTA_FEN = 1;
+constexpr int PROMOTIONS[] = {0, chess::board::QUEEN_PROMOTION,
+							  chess::board::ROOK_PROMOTION,
+							  chess::board::BISHOP_PROMOTION,
+							  chess::board::KNIGHT_PROMOTION};
+
+void put16(std::string &out, uint16_t v)
+{
+	out += static_cast<char>(v >> 8);
+	out += static_cast<char>(v & 0xFF);
+}
+
+uint16_t get16(const char *p)
+{
+	return static_cast<uint8_t>(p[0]) << 8 | static_cast<uint8_t>(p[1]);
+}
+
+std::string ply_and_hash(int ply, uint32_t hash)
+{
+	std::string out;
+	put16(out, static_cast<uint16_t>(ply));
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out += static_cast<char>(hash >> shift);
+	return out;
+}
+
+/**
+ * @brief Encode a move in coordinate notation, i.e. "e7e8q".
+ * @return false if it is malformed
+ */
+bool encode(std::string_view move, uint16_t &code)
+{
+	chess::board::move_t m;
+	int promotion;
+	if (chess::board::parse_coordinates(move, m, promotion) !=
+		chess::board::move_status::ok)
+		return false;
+	// QUEEN_PROMOTION to KNIGHT_PROMOTION count down, to 1 to 4
+	if (promotion)
+		promotion = chess::board::QUEEN_PROMOTION - promotion + 1;
+	code = static_cast<uint16_t>(m.first | m.second << 6 | promotion << 12);
+	return true;
+}
+}
+
+position_sync::position_sync(const chess::board &start)
+		: start(start), current(start), first_ply(0), hashes {hash(start)},
+		  agreed(0), waiting(false), repaired(0)
+{
+}
+
+bool position_sync::play(handler &h, std::string_view move, int64_t clock)
+{
+	uint16_t code;
+	if (waiting or !encode(move, code) or !play(code))
+		return false;
+	h.queue_move(move, clock);
+	if (checked(h))
+		h.queue(header::sync, ply_and_hash(ply(), hashes.back()));
+	return true;
+}
+
+bool position_sync::receive(handler &h, header head, std::string_view body)
+{
+	switch (head)
+	{
+	case header::move:
+	{
+		if (!checked(h))
+		{
+			uint16_t code;
+			if (encode(body, code))
+				play(code);
+			return true;
+		}
+		// an illegal move means the sides differ already
+		std::string_view move;
+		int64_t clock;
+		uint16_t code;
+		if (!waiting and (!frames::parse_move(body, move, clock) or
+						  !encode(move, code) or !play(code)))
+			ask(h);
+		return true;
+	}
+	case header::sync:
+		if (body.size() != 6)
+			return true;
+		if (!waiting)
+		{
+			// this side may have moved since, so the hash is checked against
+			// the one it had at that ply
+			const int at = get16(body.data());
+			if (at >= first_ply and at <= ply() and
+				handler::to_uint32(body.data() + 2) == hashes[at - first_ply])
+				agreed = std::max(agreed, at);
+			else
+				ask(h);
+		}
+		return true;
+	case header::resync:
+	{
+		if (body.size() != 6)
+			return true;
+		const int base = get16(body.data());
+		const uint32_t base_hash = handler::to_uint32(body.data() + 2);
+		std::string delta = ply_and_hash(ply(), hashes.back());
+		if (base >= first_ply and base <= ply() and
+			hashes[base - first_ply] == base_hash)
+		{
+			delta += static_cast<char>(DELTA_MOVES);
+			for (std::size_t i = base - first_ply; i < moves.size(); ++i)
+				put16(delta, moves[i]);
+		}
+		else
+		{
+			delta += static_cast<char>(DELTA_FEN);
+			delta += current.fen();
+		}
+		h.queue(header::delta, delta);
+		return true;
+	}
+	case header::delta:
+	{
+		if (!waiting or body.size() < 7)
+			return true;
+		const int target = get16(body.data());
+		const uint32_t target_hash = handler::to_uint32(body.data() + 2);
+		const std::string_view rest = body.substr(7);
+		if (static_cast<uint8_t>(body[6]) == DELTA_MOVES)
+		{
+			// replay from the ply agreed on, which is what was asked for
+			rewind(agreed);
+			for (std::size_t i = 0; i + 1 < rest.size(); i += 2)
+				if (!play(get16(rest.data() + i)))
+					break;
+		}
+		else
+		{
+			try
+			{
+				reset(chess::board(std::string(rest)), target);
+			}
+			catch (std::invalid_argument &e)
+			{
+			}
+		}
+
+		waiting = false;
+		if (ply() == target and hashes.back() == target_hash)
+		{
+			agreed = ply();
+			++repaired;
+		}
+		else
+		{
+			// the moves did not get there, so ask for the position itself
+			ask(h, true);
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool position_sync::wait(handler &h, header &head, std::string &body)
+{
+	while (h.wait(head, body))
+	{
+		const bool handled = receive(h, head, body);
+		h.flush();
+		// after a move or a delta this side may have the move
+		if (!handled or head == header::move or head == header::delta)
+			return true;
+	}
+	return false;
+}
+
+bool position_sync::request_position(handler &h)
+{
+	if (!checked(h))
+		return false;
+	ask(h, true);
+	return true;
+}
+
+bool position_sync::checked(const handler &h)
+{
+	return h.protocol_version() >= frames::VERSION;
+}
+
+uint32_t position_sync::hash(const chess::board &b)
+{
+	return static_cast<uint32_t>(b.key());
+}
+
+bool position_sync::apply(chess::board &b, uint16_t move)
+{
+	const int from = move & 63, to = move >> 6 & 63, promotion = move >> 12;
+	if (promotion > 4 or !b.move(from, to))
+		return false;
+	if (b.promotion_pending())
+		b.move(to, PROMOTIONS[promotion ? promotion : 1]);
+	return true;
+}
+
+bool position_sync::play(uint16_t move)
+{
+	if (!apply(current, move))
+		return false;
+	moves.push_back(move);
+	hashes.push_back(hash(current));
+	return true;
+}
+
+void position_sync::rewind(int to)
+{
+	const std::size_t keep = to - first_ply;
+	moves.resize(keep);
+	hashes.resize(keep + 1);
+	current = start;
+	for (uint16_t m : moves)
+		apply(current, m);
+}
+
+void position_sync::reset(const chess::board &b, int ply)
+{
+	start = current = b;
+	first_ply = ply;
+	moves.clear();
+	hashes.assign(1, hash(b));
+	agreed = ply;
+}
+
+void position_sync::ask(handler &h, bool position)
+{
+	// no ply is ever past the last one, so that asks for the position
+	waiting = true;
+	h.queue(header::resync, position
+		? ply_and_hash(UINT16_MAX, 0)
+		: ply_and_hash(agreed, hashes[agreed - first_ply]));
+}
+
+}
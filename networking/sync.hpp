@@ -0,0 +1,120 @@
+#pragma once
+
+#include "handler.hpp"
+#include "../board.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace networking {
+
+/**
+ * @brief Keeps the position of a game in step with the other side over a
+ * connection using frames.
+ *
+ * Every move is followed by a sync message with the ply and a hash of the
+ * position after it. The other side compares the hash with its own, and if
+ * they differ, or the move was illegal for it, it sends a resync message with
+ * the last ply both agreed on and its hash there. The answer is a delta
+ * message, which carries the moves since that ply, 2 bytes each, or the FEN of
+ * the position if the two sides do not share that ply, so the game carries on
+ * after a single round trip.
+ *
+ * Payloads, integers in network byte order:
+ * 	- sync: the ply (2 bytes) and the hash (4 bytes)
+ * 	- resync: the same, for the last ply agreed on
+ * 	- delta: the ply and hash of the sender's position, 1 byte of kind, then
+ * 	for kind 0 the moves from the ply asked for on, each as from | to << 6 |
+ * 	promotion << 12 with the promotion 1-4 for a queen, rook, bishop or knight
+ * 	or 0, and for kind 1 the FEN
+ *
+ * Only the side that did not make the last move checks it, so both sides
+ * never ask at once. As that side may answer a move before its sync message
+ * arrives, the hash is compared with the one it had at the ply of the sync.
+ *
+ * Every master and slave keeps one from ply 0 of the standard position, see
+ * master::game() and slave::game(). Over a connection without frames the
+ * moves are only played, as nothing can be checked or repaired.
+ */
+class position_sync
+{
+public:
+	explicit position_sync(const chess::board &start = chess::board());
+
+	/**
+	 * @brief The current position.
+	 */
+	const chess::board &position() const { return current; }
+
+	/**
+	 * @brief The number of moves played since the start of the game.
+	 */
+	int ply() const { return first_ply + static_cast<int>(moves.size()); }
+
+	/**
+	 * @brief Whether a delta was asked for and has not arrived, during which
+	 * no move can be played.
+	 */
+	bool repairing() const { return waiting; }
+
+	/**
+	 * @brief The number of times the position was repaired.
+	 */
+	std::size_t recoveries() const { return repaired; }
+
+	/**
+	 * @brief Play a move made on this side, and queue it and its sync message
+	 * on the handler. The caller flushes.
+	 * @param move The move in coordinate notation, i.e. "e7e8q"
+	 * @param clock The mover's clock in milliseconds, or -1 for none
+	 * @return false if the move is illegal or the position is being repaired,
+	 * in which case nothing is queued
+	 */
+	bool play(handler &h, std::string_view move, int64_t clock = -1);
+
+	/**
+	 * @brief Handle a message from the other side. Moves are played, hashes
+	 * checked, and any answer queued on the handler. The caller flushes.
+	 * @return false if the message is not about the position, so the caller
+	 * should handle it
+	 */
+	bool receive(handler &h, header head, std::string_view body);
+
+	/**
+	 * @brief Block until a move or a delta has been handled, or a message
+	 * that is not about the position arrives, answering the others on the
+	 * way. A move has been played when it is returned, unless it was illegal
+	 * here and a repair was asked for.
+	 * @return false if the handler was disconnected first
+	 */
+	bool wait(handler &h, header &head, std::string &body);
+
+	/**
+	 * @brief Ask the other side for its whole position, i.e. when the boards
+	 * differed at connect. Moves can be played again once it arrives. The
+	 * caller flushes.
+	 * @return false if the connection does not use frames
+	 */
+	bool request_position(handler &h);
+
+private:
+	chess::board start;				// the position at first_ply
+	chess::board current;
+	int first_ply;
+	std::vector<uint16_t> moves;	// every move since start
+	std::vector<uint32_t> hashes;	// the hash after each of them, and start
+	int agreed;						// the last ply the other side confirmed
+	bool waiting;					// for a delta
+	std::size_t repaired;
+
+	static bool checked(const handler &h);
+	static uint32_t hash(const chess::board &b);
+	static bool apply(chess::board &b, uint16_t move);
+	bool play(uint16_t move);
+	void rewind(int to);
+	void reset(const chess::board &b, int ply);
+	void ask(handler &h, bool position = false);
+};
+
+}
@@ -0,0 +1,108 @@
+#include "worker.hpp"
+#include "coordinator.hpp"
+#include "../eval.hpp"
+#include "../search.hpp"
+
+namespace networking {
+
+namespace {
+/**
+ * @brief The score of a position without searching it, for a unit of depth
+ * 1 that is only the root move. Scored like the search scores the root.
+ */
+int static_score(const chess::board &b)
+{
+	if (b.legal_moves().empty())
+		return b.is_check(b.turn()) ? -chess::searcher::MATE : 0;
+	return b.is_draw() ? 0 : chess::evaluate(b);
+}
+}
+
+worker::worker(const std::string &code, std::size_t hash_mb)
+	: slave(code, chess::board()()), hash_mb(hash_mb)
+{
+}
+
+std::size_t worker::serve()
+{
+	chess::transposition_table tt(hash_mb);
+	chess::searcher search(tt);
+	chess::board b;
+	char promotion = 0;	// the letter sent ahead of a promotion
+	std::size_t completed = 0;
+
+	char msg[MSG_SIZE];
+	while (connected)
+	{
+		asio::read(socket, asio::buffer(msg, MSG_SIZE), error_code);
+		if (error_code)
+		{
+			log_error();
+			break;
+		}
+
+		switch (static_cast<header>(msg[0]))
+		{
+		case header::new_position:
+			b = chess::board();
+			promotion = 0;
+			break;
+		case header::move:
+		{
+			std::string move(msg + 1, 4);
+			if (move[1] == ' ')
+			{
+				promotion = move[0];
+				break;
+			}
+			if (promotion)
+				move += promotion;
+			promotion = 0;
+			if (!coordinator::apply_move(b, move))
+				std::cerr << "Illegal move from coordinator: " << move
+						  << std::endl;
+			break;
+		}
+		case header::work:
+		{
+			const uint32_t work = to_uint32(msg + 1);
+			const auto id = static_cast<uint16_t>(work >> 16);
+			const int depth = static_cast<uint8_t>(work >> 8);
+			const auto kind = static_cast<coordinator::task>(work & 0xFF);
+
+			int64_t value;
+			if (kind == coordinator::task::perft)
+				value = static_cast<int64_t>(chess::perft(b, depth - 1));
+			else if (depth == 1)
+				value = static_score(b);
+			else
+			{
+				chess::search_limits limits;
+				limits.depth = depth - 1;
+				value = search.run(b, limits).score;
+			}
+
+			// to_buffer reuses its storage, so copy each message out at once
+			std::string reply;
+			auto append = [&reply](const asio::const_buffer &buffer) {
+				reply.append(static_cast<const char *>(buffer.data()), buffer.size());
+			};
+			const auto bits = static_cast<uint64_t>(value);
+			append(to_buffer(header::result, static_cast<uint32_t>(id) << 16));
+			append(to_buffer(header::value, static_cast<uint32_t>(bits >> 32)));
+			append(to_buffer(header::value, static_cast<uint32_t>(bits)));
+			send(asio::buffer(reply));
+			++completed;
+			break;
+		}
+		case header::disconnect:
+			connected = false;
+			break;
+		default:
+			break;
+		}
+	}
+	return completed;
+}
+
+}
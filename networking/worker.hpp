@@ -0,0 +1,34 @@
+#pragma once
+
+#include "slave.hpp"
+
+namespace networking {
+
+/**
+ * @brief A worker of a distributed search. It connects to a coordinator with
+ * the game code the same way a slave connects to a master, then searches the
+ * work units it is sent until the coordinator disconnects.
+ */
+class worker : public slave
+{
+public:
+	/**
+	 * @brief Connect to the coordinator.
+	 * @param code The game code of the coordinator.
+	 * @param hash_mb The size of the transposition table used by this worker.
+	 * @throws std::runtime_error if the handshake with the coordinator fails
+	 */
+	worker(const std::string &code, std::size_t hash_mb = 64);
+	~worker() override = default;
+
+	/**
+	 * @brief Serve work units until the coordinator disconnects. Blocking.
+	 * @return The number of work units completed.
+	 */
+	std::size_t serve();
+
+private:
+	std::size_t hash_mb;
+};
+
+}
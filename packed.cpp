@@ -0,0 +1,59 @@
+#include "packed.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace chess {
+
+packed_position packed_position::pack(const board &b, int score,
+									  result_t result)
+{
+	packed_position p {};
+	int count = 0;
+	for (int pos = 0; pos < 64 and count < 32; ++pos)
+	{
+		for (bool color : {false, true})
+		{
+			const auto piece = b.at(pos, color);
+			if (piece == board::piece::empty)
+				continue;
+			const auto nibble = static_cast<uint8_t>(color << 3 |
+													 static_cast<uint8_t>(piece));
+			p.occupancy |= 1ull << pos;
+			p.pieces[count / 2] |= count % 2 ? nibble << 4 : nibble;
+			++count;
+		}
+	}
+	p.score = static_cast<int16_t>(std::clamp(score, -32767, 32767));
+	p.result = result;
+	p.side = b.turn();
+	return p;
+}
+
+board::piece packed_position::at(int pos, bool &color) const
+{
+	if (!(occupancy >> pos & 1))
+		return board::piece::empty;
+	// the index of the piece is the number of occupied squares before it
+	const int index = std::popcount(occupancy & ((1ull << pos) - 1));
+	const uint8_t nibble = pieces[index / 2] >> (index % 2 ? 4 : 0) & 0xF;
+	color = nibble >> 3;
+	return static_cast<board::piece>(nibble & 7);
+}
+
+bool packed_position::valid() const
+{
+	const int count = std::popcount(occupancy);
+	if (count > 32 or result > white_win)
+		return false;
+	for (int i = 0; i < count; ++i)
+	{
+		const int piece = pieces[i / 2] >> (i % 2 ? 4 : 0) & 7;
+		if (piece < static_cast<int>(board::piece::king) or
+			piece > static_cast<int>(board::piece::pawn))
+			return false;
+	}
+	return true;
+}
+
+}
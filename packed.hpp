@@ -0,0 +1,58 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <cstdint>
+
+namespace chess {
+
+/**
+ * @brief A position packed into 32 bytes, labelled with the search score and
+ * the result of the game it came from. Files of these are plain arrays with
+ * no header, so they can be memory-mapped and indexed directly.
+ *
+ * Castling rights and the en passant square are not stored; the format is
+ * meant for evaluation training, not for resuming play.
+ */
+struct packed_position
+{
+	enum result_t : uint8_t
+	{
+		black_win = 0, draw = 1, white_win = 2
+	};
+
+	uint64_t occupancy;		// bit i is set if square i is occupied
+	uint8_t pieces[16];		// 4 bits per occupied square in square order,
+							// color << 3 | board::piece, low nibble first
+	int16_t score;			// centipawns from white's point of view
+	uint8_t result;			// result_t
+	uint8_t side;			// the side to move, 0 for white and 1 for black
+	uint8_t reserved[4];
+
+	/**
+	 * @brief Pack a position.
+	 * @param b The position
+	 * @param score The score in centipawns from white's point of view
+	 * @param result The result of the game
+	 * @return The packed position
+	 */
+	static packed_position pack(const board &b, int score, result_t result);
+
+	/**
+	 * @brief Get the piece on a square.
+	 * @param pos The numerical position
+	 * @param color Set to the color of the piece if there is one
+	 * @return The piece, or board::piece::empty
+	 */
+	board::piece at(int pos, bool &color) const;
+
+	/**
+	 * @brief Check a record read from a file: at most 32 occupied squares,
+	 * each holding a piece, and a known result.
+	 */
+	bool valid() const;
+};
+
+static_assert(sizeof(packed_position) == 32, "packed_position must be 32 bytes");
+
+}
@@ -0,0 +1,265 @@
+#include "position_index.hpp"
+#include "game_log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace chess {
+
+namespace {
+struct run_entry
+{
+	uint64_t key;
+	uint32_t game;
+	uint16_t ply;
+	uint16_t move;
+
+	inline bool operator<(const run_entry &other) const
+	{
+		return std::tie(key, game, ply) <
+			   std::tie(other.key, other.game, other.ply);
+	}
+};
+
+void put_varint(std::string &out, uint64_t v)
+{
+	for (; v >= 0x80; v >>= 7)
+		out += static_cast<char>(v | 0x80);
+	out += static_cast<char>(v);
+}
+
+/**
+ * @brief Read a varint without going past end, so one cut short by a damaged
+ * file gives what there was of it.
+ */
+inline uint64_t get_varint(const uint8_t *&p, const uint8_t *end)
+{
+	uint64_t v = 0;
+	for (int shift = 0; p < end and shift < 64; shift += 7)
+	{
+		const uint8_t byte = *p++;
+		v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+	return v;
+}
+
+/**
+ * @brief Replay a game and add every position it reached to the run.
+ * @return false if the game contained an illegal move
+ */
+bool index_game(std::string_view text, game_format format, uint32_t game,
+				std::vector<run_entry> &run)
+{
+	board b;
+	move_tokenizer tokens(text, format);
+	std::string_view token;
+	uint16_t ply = 0;
+	bool legal = true;
+	while (tokens.next(token) and ply < UINT16_MAX)
+	{
+		if (ply == 0 and !tokens.fen().empty())
+		{
+			try
+			{
+				b = board(std::string(tokens.fen()));
+			}
+			catch (std::invalid_argument &e)
+			{
+				return false;
+			}
+		}
+		const uint64_t key = b.key();
+		board::move_t m;
+		int promotion;
+		if (!play_token(b, token, format, m, promotion))
+		{
+			legal = false;
+			break;
+		}
+		run.push_back({key, game, ply++,
+					   game_log::encode_move(m.first, m.second, promotion)});
+	}
+	run.push_back({b.key(), game, ply, 0});
+	return legal;
+}
+}
+
+position_index::build_summary position_index::build(std::string_view text,
+	game_format format, unsigned threads, const std::string &path)
+{
+	const std::vector<std::string_view> games = split_games(text, format);
+	threads = std::max(threads, 1u);
+
+	// each thread collects the positions of the games it takes into its own
+	// run and sorts it
+	constexpr std::size_t BLOCK = 64;
+	std::atomic<std::size_t> next_game(0);
+	std::atomic<std::size_t> errors(0);
+	std::vector<std::vector<run_entry>> runs(threads);
+
+	auto collect = [&](std::vector<run_entry> &run) {
+		for (std::size_t first = next_game.fetch_add(BLOCK);
+			 first < games.size(); first = next_game.fetch_add(BLOCK))
+		{
+			const std::size_t last = std::min(first + BLOCK, games.size());
+			for (std::size_t i = first; i < last; ++i)
+				if (!index_game(games[i], format, static_cast<uint32_t>(i), run))
+					++errors;
+		}
+		std::sort(run.begin(), run.end());
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; ++t)
+		pool.emplace_back(collect, std::ref(runs[t]));
+	collect(runs[0]);
+	for (auto &t : pool)
+		t.join();
+
+	// merge the runs, grouping the postings by key
+	using cursor = std::pair<const run_entry *, const run_entry *>;
+	auto later = [](const cursor &a, const cursor &b) { return *b.first < *a.first; };
+	std::priority_queue<cursor, std::vector<cursor>, decltype(later)> heads(later);
+	for (const auto &run : runs)
+		if (!run.empty())
+			heads.emplace(run.data(), run.data() + run.size());
+
+	std::vector<key_entry> keys;
+	std::string postings;
+	uint64_t total = 0;
+	uint32_t previous_game = 0;
+	while (!heads.empty())
+	{
+		auto [cur, end] = heads.top();
+		heads.pop();
+		const run_entry &e = *cur;
+
+		if (keys.empty() or keys.back().key != e.key)
+		{
+			keys.push_back({e.key, postings.size()});
+			previous_game = 0;
+		}
+		put_varint(postings, e.game - previous_game);
+		put_varint(postings, e.ply);
+		put_varint(postings, e.move);
+		previous_game = e.game;
+		++total;
+
+		if (++cur != end)
+			heads.emplace(cur, end);
+	}
+	runs.clear();
+
+	file_header h {};
+	std::memcpy(h.magic, "CPIX", 4);
+	h.version = VERSION;
+	h.keys = keys.size();
+	h.games = games.size();
+	h.postings = total;
+	h.bytes = postings.size();
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+	out.write(reinterpret_cast<const char *>(keys.data()),
+			  keys.size() * sizeof(key_entry));
+	out.write(postings.data(), postings.size());
+	if (!out)
+		throw std::runtime_error("Could not write " + path);
+
+	build_summary summary;
+	summary.games = games.size();
+	summary.keys = keys.size();
+	summary.postings = total;
+	summary.errors = errors;
+	summary.bytes = sizeof(h) + keys.size() * sizeof(key_entry) + postings.size();
+	return summary;
+}
+
+position_index::position_index(const std::string &path)
+: file(path, false), entries(nullptr), data(nullptr)
+{
+	const std::string_view view = file.view();
+	if (view.size() < sizeof(file_header) or
+		std::memcmp(header().magic, "CPIX", 4) != 0)
+		throw std::runtime_error(path + " is not a position index");
+	if (header().version != VERSION)
+		throw std::runtime_error(path + " has an unsupported index version");
+	if ((view.size() - sizeof(file_header)) / sizeof(key_entry) < header().keys or
+		view.size() - sizeof(file_header) - header().keys * sizeof(key_entry) <
+		header().bytes)
+		throw std::runtime_error(path + " is truncated");
+
+	entries = reinterpret_cast<const key_entry *>(view.data() + sizeof(file_header));
+	data = reinterpret_cast<const uint8_t *>(entries + header().keys);
+
+	// lookups take the postings of a key to run up to the next offset, and
+	// find keys by binary search, so both have to be in order
+	uint64_t offset = 0;
+	for (uint64_t i = 0; i < header().keys; ++i)
+	{
+		if (entries[i].offset < offset or entries[i].offset > header().bytes or
+			(i and entries[i].key <= entries[i - 1].key))
+			throw std::runtime_error(path + " is corrupt");
+		offset = entries[i].offset;
+	}
+}
+
+const position_index::key_entry *position_index::find(uint64_t key) const
+{
+	const key_entry *end = entries + header().keys;
+	const key_entry *it = std::lower_bound(entries, end, key,
+		[](const key_entry &e, uint64_t k) { return e.key < k; });
+	return it != end and it->key == key ? it : nullptr;
+}
+
+std::vector<position_index::posting> position_index::lookup(uint64_t key) const
+{
+	std::vector<posting> result;
+	const key_entry *e = find(key);
+	if (!e)
+		return result;
+
+	const uint8_t *p = data + e->offset;
+	const uint8_t *end = data + (e + 1 < entries + header().keys ?
+								 e[1].offset : header().bytes);
+	uint32_t game = 0;
+	while (p < end)
+	{
+		game += static_cast<uint32_t>(get_varint(p, end));
+		const auto ply = static_cast<uint32_t>(get_varint(p, end));
+		const auto move = static_cast<uint16_t>(get_varint(p, end));
+		result.push_back({game, ply, move});
+	}
+	return result;
+}
+
+std::vector<position_index::move_stat> position_index::move_stats(
+	uint64_t key) const
+{
+	std::vector<uint16_t> moves;
+	for (const auto &p : lookup(key))
+		if (p.move)
+			moves.push_back(p.move);
+	std::sort(moves.begin(), moves.end());
+
+	std::vector<move_stat> stats;
+	for (uint16_t m : moves)
+	{
+		if (stats.empty() or stats.back().move != m)
+			stats.push_back({m, 0});
+		++stats.back().count;
+	}
+	std::stable_sort(stats.begin(), stats.end(),
+		[](const move_stat &a, const move_stat &b) { return a.count > b.count; });
+	return stats;
+}
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "replay.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chess {
+
+/**
+ * @brief An on-disk index from the Zobrist key of a position to every game
+ * of an archive that reached it.
+ *
+ * The file is memory-mapped and used in place:
+ * 	- a 40 byte header: the magic "CPIX", the version, the number of keys,
+ * 	games and postings, and the size of the postings in bytes
+ * 	- the keys in ascending order, each with the offset of its postings,
+ * 	which end where those of the next key begin
+ * 	- the postings of each key, sorted by game and ply. A posting is three
+ * 	varints: the game id minus the previous game id of the same key, the ply,
+ * 	and the move played from the position in game_log::encode_move() format,
+ * 	or 0 if the game ended there.
+ *
+ * Game ids are the indices of the games in the archive.
+ */
+class position_index
+{
+public:
+	struct posting
+	{
+		uint32_t game;
+		uint32_t ply;
+		uint16_t move;	// 0 if the game ended in the position
+	};
+
+	struct move_stat
+	{
+		uint16_t move;
+		uint32_t count;
+	};
+
+	struct build_summary
+	{
+		std::size_t games = 0;
+		std::size_t keys = 0;
+		std::size_t postings = 0;
+		std::size_t errors = 0;		// games cut short by an illegal move
+		std::size_t bytes = 0;		// size of the index file
+	};
+
+	/**
+	 * @brief Open an index, checking that its keys and offsets are in order.
+	 * @throws std::runtime_error if the file cannot be mapped, is not an
+	 * index or is corrupt
+	 */
+	explicit position_index(const std::string &path);
+
+	/**
+	 * @brief Index every position of every game in an archive. Games are
+	 * split across threads, each producing a sorted run of postings, and the
+	 * runs are merged into the index.
+	 * @param text The archive
+	 * @param format The format of the archive
+	 * @param threads The number of threads to use
+	 * @param path Where to write the index
+	 * @throws std::runtime_error if the index cannot be written
+	 */
+	static build_summary build(std::string_view text, game_format format,
+							   unsigned threads, const std::string &path);
+
+	/**
+	 * @brief All games that reached a position, by game and ply.
+	 */
+	std::vector<posting> lookup(uint64_t key) const;
+
+	/**
+	 * @brief How often each move was played from a position, most frequent
+	 * first. Games that ended in the position are not counted.
+	 */
+	std::vector<move_stat> move_stats(uint64_t key) const;
+
+	inline uint64_t keys() const { return header().keys; }
+	inline uint64_t games() const { return header().games; }
+	inline uint64_t postings() const { return header().postings; }
+
+private:
+	static constexpr uint32_t VERSION = 1;
+
+	struct file_header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t keys;
+		uint64_t games;
+		uint64_t postings;
+		uint64_t bytes;		// size of the postings
+	};
+
+	struct key_entry
+	{
+		uint64_t key;
+		uint64_t offset;	// from the start of the postings
+	};
+
+	mapped_file file;
+	const key_entry *entries;
+	const uint8_t *data;	// the postings
+
+	inline const file_header &header() const
+	{ return *reinterpret_cast<const file_header *>(file.view().data()); }
+
+	const key_entry *find(uint64_t key) const;
+};
+
+}
@@ -0,0 +1,392 @@
+#include "replay.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace chess {
+
+mapped_file::mapped_file(const std::string &path, bool sequential)
+: data(nullptr), size(0)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Could not open " + path);
+
+	struct stat st {};
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		throw std::runtime_error("Could not stat " + path);
+	}
+	size = static_cast<std::size_t>(st.st_size);
+	if (size)
+	{
+		void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Could not map " + path);
+		}
+		madvise(p, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+		data = static_cast<const char *>(p);
+	}
+	close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+	if (data)
+		munmap(const_cast<char *>(data), size);
+}
+
+const char *find_byte(const char *begin, const char *end, char c)
+{
+#if defined(__SSE2__)
+	const __m128i needle = _mm_set1_epi8(c);
+	for (; end - begin >= 16; begin += 16)
+	{
+		const __m128i chunk =
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+		if (mask)
+			return begin + __builtin_ctz(mask);
+	}
+#endif
+	for (; begin < end; ++begin)
+		if (*begin == c)
+			return begin;
+	return end;
+}
+
+namespace {
+constexpr bool is_space(char c)
+{
+	return c == ' ' or c == '\t' or c == '\n' or c == '\r' or c == '\v' or
+		   c == '\f';
+}
+
+/**
+ * Characters that end a token in the movetext
+ */
+constexpr bool is_delimiter(char c)
+{
+	return is_space(c) or c == '{' or c == '}' or c == '(' or c == ')' or
+		   c == '[' or c == ';';
+}
+
+bool blank(std::string_view line)
+{
+	return std::all_of(line.begin(), line.end(), is_space);
+}
+
+/**
+ * Find the next "quit" token at or after pos
+ * @return Its position, or npos if there is none
+ */
+std::size_t find_quit(std::string_view text, std::size_t pos)
+{
+	constexpr std::string_view QUIT = "quit";
+	for (pos = text.find(QUIT, pos); pos != std::string_view::npos;
+		 pos = text.find(QUIT, pos + 1))
+	{
+		const std::size_t after = pos + QUIT.size();
+		if ((pos == 0 or is_space(text[pos - 1])) and
+			(after == text.size() or is_space(text[after])))
+			return pos;
+	}
+	return std::string_view::npos;
+}
+}
+
+game_format detect_format(std::string_view text)
+{
+	for (char c : text)
+		if (!is_space(c))
+			return c == '[' ? game_format::pgn : game_format::moves;
+	return game_format::moves;
+}
+
+std::vector<std::string_view> split_games(std::string_view text,
+										  game_format format)
+{
+	std::vector<std::string_view> games;
+	std::size_t quit = format == game_format::moves ? find_quit(text, 0)
+													 : std::string_view::npos;
+	if (quit != std::string_view::npos)
+	{
+		// every game ends with "quit", across as many lines as it takes
+		std::size_t start = 0;
+		for (; quit != std::string_view::npos; quit = find_quit(text, start))
+		{
+			const std::string_view game = text.substr(start, quit - start);
+			if (!blank(game))
+				games.push_back(game);
+			start = quit + 4;
+		}
+		if (!blank(text.substr(start)))
+			games.push_back(text.substr(start));
+		return games;
+	}
+
+	const char *p = text.data(), *end = p + text.size();
+	const char *game_start = p;
+	bool in_movetext = false;
+
+	while (p < end)
+	{
+		const char *eol = find_byte(p, end, '\n');
+		const std::string_view line(p, eol - p);
+
+		if (format == game_format::moves)
+		{
+			if (!blank(line))
+				games.push_back(line);
+		}
+		else if (!line.empty() and line.front() == '[')
+		{
+			// a tag after movetext starts the next game
+			if (in_movetext)
+			{
+				games.emplace_back(game_start, p - game_start);
+				game_start = p;
+				in_movetext = false;
+			}
+		}
+		else if (!blank(line))
+			in_movetext = true;
+
+		p = eol + (eol < end);
+	}
+	if (format == game_format::pgn and in_movetext)
+		games.emplace_back(game_start, end - game_start);
+	return games;
+}
+
+move_tokenizer::move_tokenizer(std::string_view game, game_format format)
+: cur(game.data()), end(game.data() + game.size()), format(format)
+{
+}
+
+void move_tokenizer::skip_tag()
+{
+	const char *close = find_byte(cur, end, ']');
+	const std::string_view tag(cur, close - cur);
+	constexpr std::string_view FEN = "[FEN \"";
+	if (tag.substr(0, FEN.size()) == FEN)
+	{
+		auto value = tag.substr(FEN.size());
+		fen_tag = value.substr(0, value.find('"'));
+	}
+	cur = close + (close < end);
+}
+
+bool move_tokenizer::next(std::string_view &token)
+{
+	while (cur < end)
+	{
+		const char c = *cur;
+		if (is_space(c))
+		{
+			++cur;
+			continue;
+		}
+
+		if (format == game_format::pgn)
+		{
+			switch (c)
+			{
+			case '[':
+				skip_tag();
+				continue;
+			case '{':
+				cur = find_byte(cur, end, '}');
+				cur += cur < end;
+				continue;
+			case ';':
+				cur = find_byte(cur, end, '\n');
+				continue;
+			case '(':
+			{
+				// variations nest, and may contain comments
+				int depth = 0;
+				for (; cur < end; ++cur)
+				{
+					if (*cur == '{')
+						cur = find_byte(cur, end, '}');
+					if (cur < end and *cur == '(')
+						++depth;
+					if (cur < end and *cur == ')' and --depth == 0)
+						break;
+				}
+				cur += cur < end;
+				continue;
+			}
+			case ')':
+			case '}':
+				++cur;
+				continue;
+			default:
+				break;
+			}
+		}
+
+		const char *start = cur;
+		while (cur < end and !is_delimiter(*cur))
+			++cur;
+		std::string_view t(start, cur - start);
+
+		if (format == game_format::moves)
+		{
+			if (t == "quit")
+			{
+				cur = end;
+				return false;
+			}
+			token = t;
+			return true;
+		}
+
+		if (t == "1-0" or t == "0-1" or t == "1/2-1/2" or t == "*")
+		{
+			cur = end;
+			return false;
+		}
+		if (t.front() == '$')
+			continue;
+		if (t.substr(0, 3) != "0-0" and t.front() >= '0' and t.front() <= '9')
+		{
+			// a move number, possibly glued to the move: "12." "12..." "1.e4"
+			while (!t.empty() and t.front() >= '0' and t.front() <= '9')
+				t.remove_prefix(1);
+			if (t.empty() or t.front() != '.')
+				continue;
+			while (!t.empty() and t.front() == '.')
+				t.remove_prefix(1);
+			if (t.empty())
+				continue;
+		}
+		token = t;
+		return true;
+	}
+	return false;
+}
+
+bool play_token(board &b, std::string_view token, game_format format)
+{
+	board::move_t m;
+	int promotion;
+	return play_token(b, token, format, m, promotion);
+}
+
+bool play_token(board &b, std::string_view token, game_format format,
+				board::move_t &m, int &promotion)
+{
+	promotion = 0;
+
+	if (format == game_format::pgn)
+	{
+		if (!b.find_san(token, m, promotion))
+			return false;
+	}
+	else if (board::parse_coordinates(token, m, promotion) !=
+			 board::move_status::ok)
+		return false;
+
+	// play() leaves the board untouched if the move is illegal, or if a
+	// promotion is given for a move that does not promote
+	const bool promotes = b.is_promotion(m.first, m.second);
+	if (b.play(m, promotion) != board::move_status::ok)
+		return false;
+	if (promotes and !promotion)
+		promotion = board::QUEEN_PROMOTION;
+	return true;
+}
+
+replay_summary replay_games(std::string_view text, game_format format,
+							unsigned threads)
+{
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+
+	const std::vector<std::string_view> games = split_games(text, format);
+
+	// games are handed out in blocks so the shared counter is touched rarely
+	constexpr std::size_t BLOCK = 64;
+	std::atomic<std::size_t> next_game(0);
+	std::vector<replay_summary> partial(std::max(threads, 1u));
+
+	auto replay = [&](replay_summary &out) {
+		trace::name_thread("replay");
+		for (std::size_t first = next_game.fetch_add(BLOCK);
+			 first < games.size(); first = next_game.fetch_add(BLOCK))
+		{
+			const std::size_t last = std::min(first + BLOCK, games.size());
+			trace::span block("block", "replay", "first game", first);
+			for (std::size_t i = first; i < last; ++i)
+			{
+				board b;
+				move_tokenizer tokens(games[i], format);
+				std::string_view token;
+				int ply = 0;
+				while (tokens.next(token))
+				{
+					if (ply == 0 and !tokens.fen().empty())
+					{
+						try
+						{
+							b = board(std::string(tokens.fen()));
+						}
+						catch (std::invalid_argument &e)
+						{
+							out.errors.push_back({i, 0, e.what()});
+							break;
+						}
+					}
+					if (!play_token(b, token, format))
+					{
+						out.errors.push_back(
+							{i, ply, "illegal move " + std::string(token)});
+						break;
+					}
+					++ply;
+				}
+				out.moves += ply;
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (std::size_t t = 1; t < partial.size(); ++t)
+		pool.emplace_back(replay, std::ref(partial[t]));
+	replay(partial[0]);
+	for (auto &t : pool)
+		t.join();
+
+	replay_summary summary;
+	summary.games = games.size();
+	for (auto &p : partial)
+	{
+		summary.moves += p.moves;
+		std::move(p.errors.begin(), p.errors.end(),
+				  std::back_inserter(summary.errors));
+	}
+	std::sort(summary.errors.begin(), summary.errors.end(),
+			  [](const auto &a, const auto &b) { return a.game < b.game; });
+	summary.seconds = std::chrono::duration<double>(clock::now() - start).count();
+	return summary;
+}
+
+}
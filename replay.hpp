@@ -0,0 +1,143 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chess {
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ */
+class mapped_file
+{
+public:
+	/**
+	 * @brief Map a file into memory.
+	 * @param path The path of the file
+	 * @param sequential Whether the file will be read front to back, so the
+	 * kernel should read ahead, or at random
+	 * @throws std::runtime_error if the file cannot be opened or mapped
+	 */
+	explicit mapped_file(const std::string &path, bool sequential = true);
+	~mapped_file();
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	inline std::string_view view() const { return {data, size}; }
+
+private:
+	const char *data;
+	std::size_t size;
+};
+
+/**
+ * @brief Find the first occurrence of a byte, scanning 16 bytes at a time
+ * with SSE2 where it is available.
+ * @return Pointer to the byte, or end if there is none
+ */
+const char *find_byte(const char *begin, const char *end, char c);
+
+/**
+ * @brief The formats of game archives.
+ * 	- moves: moves in coordinate notation, i.e. "e2e4 e7e5 g1f3". A "quit"
+ * 	token ends a game, which may span lines as in the old test files, and a
+ * 	file without any has one game per line.
+ * 	- pgn: Portable Game Notation. Tags other than FEN, comments, variations,
+ * 	move numbers, annotations and results are skipped.
+ */
+enum class game_format
+{
+	moves, pgn
+};
+
+/**
+ * @brief Guess the format from the first character that is not whitespace.
+ */
+game_format detect_format(std::string_view text);
+
+/**
+ * @brief Split an archive into its games without copying them.
+ * @return One view per game into the text
+ */
+std::vector<std::string_view> split_games(std::string_view text,
+										  game_format format);
+
+/**
+ * @brief Splits the text of a single game into moves without allocating.
+ * Everything that is not a move is skipped.
+ */
+class move_tokenizer
+{
+public:
+	move_tokenizer(std::string_view game, game_format format);
+
+	/**
+	 * @brief Get the next move.
+	 * @param token Set to the move
+	 * @return false at the end of the game
+	 */
+	bool next(std::string_view &token);
+
+	/**
+	 * @brief The FEN tag of a PGN game, or an empty view if there is none.
+	 */
+	inline std::string_view fen() const { return fen_tag; }
+
+private:
+	const char *cur, *end;
+	game_format format;
+	std::string_view fen_tag;
+
+	void skip_tag();
+};
+
+/**
+ * @brief Play a move from either format on the board. Coordinate moves may
+ * carry a promotion suffix, i.e. "e7e8q". Does not allocate or throw.
+ * @return true if the move was legal and played, false otherwise
+ */
+bool play_token(board &b, std::string_view token, game_format format);
+
+/**
+ * @brief Play a move like play_token(), and tell which move it was.
+ * @param m Set to the squares the piece moved from and to
+ * @param promotion Set to the board::X_PROMOTION value of a promotion, or 0
+ */
+bool play_token(board &b, std::string_view token, game_format format,
+				board::move_t &m, int &promotion);
+
+/**
+ * @brief The result of replaying an archive.
+ */
+struct replay_summary
+{
+	struct error
+	{
+		std::size_t game;	// index of the game in the archive
+		int ply;			// index of the offending move in the game
+		std::string message;
+	};
+
+	std::size_t games = 0;
+	std::size_t moves = 0;
+	std::vector<error> errors;	// sorted by game
+	double seconds = 0;
+};
+
+/**
+ * @brief Replay every game of an archive, spread over a number of threads,
+ * checking that every move is legal. A game stops at its first illegal move.
+ * @param text The archive
+ * @param format The format of the archive
+ * @param threads The number of threads to use
+ * @return How many games and moves were replayed, and what went wrong
+ */
+replay_summary replay_games(std::string_view text, game_format format,
+							unsigned threads);
+
+}
@@ -0,0 +1,518 @@
+#include "search.hpp"
+#include "eval.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+namespace chess {
+
+uint64_t perft(const board &b, int depth)
+{
+	if (depth <= 0)
+		return b.promotion_pending() ? 4 : 1;
+
+	const auto moves = b.legal_moves();
+	if (depth == 1 and !b.promotion_pending())
+	{
+		uint64_t count = 0;
+		for (auto [from, to] : moves)
+			count += b.is_promotion(from, to) ? 4 : 1;
+		return count;
+	}
+
+	uint64_t count = 0;
+	for (auto [from, to] : moves)
+	{
+		board child = b;
+		child.move(from, to);
+		if (child.promotion_pending())
+			// the promotion is part of the same ply
+			count += perft(child, depth);
+		else
+			count += perft(child, depth - 1);
+	}
+	return count;
+}
+
+transposition_table::transposition_table(std::size_t megabytes)
+: mask(0)
+{
+	resize(megabytes);
+}
+
+void transposition_table::resize(std::size_t megabytes)
+{
+	std::size_t count = 1;
+	while (count * 2 * sizeof(slot) <= (megabytes << 20))
+		count *= 2;
+	slots = std::make_unique<slot[]>(count);
+	mask = count - 1;
+	clear();
+}
+
+void transposition_table::clear()
+{
+	for (std::size_t i = 0; i <= mask; ++i)
+	{
+		slots[i].key.store(0, std::memory_order_relaxed);
+		slots[i].data.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool transposition_table::probe(uint64_t key, entry &e) const
+{
+	const slot &s = slots[key & mask];
+	const uint64_t data = s.data.load(std::memory_order_relaxed);
+	if ((s.key.load(std::memory_order_relaxed) ^ data) != key or !data)
+		return false;
+
+	const auto from = static_cast<uint8_t>(data);
+	const auto to = static_cast<uint8_t>(data >> 8);
+	e.move = from == 0xFF ? board::move_t{-1, -1} : board::move_t{from, to};
+	e.score = static_cast<int16_t>(data >> 16);
+	e.depth = static_cast<uint8_t>(data >> 32);
+	e.type = static_cast<bound>(data >> 40);
+	return true;
+}
+
+void transposition_table::store(uint64_t key, const entry &e)
+{
+	const uint64_t data =
+		static_cast<uint64_t>(static_cast<uint8_t>(e.move.first)) |
+		static_cast<uint64_t>(static_cast<uint8_t>(e.move.second)) << 8 |
+		static_cast<uint64_t>(static_cast<uint16_t>(e.score)) << 16 |
+		static_cast<uint64_t>(static_cast<uint8_t>(e.depth)) << 32 |
+		static_cast<uint64_t>(e.type) << 40;
+	slot &s = slots[key & mask];
+	s.key.store(key ^ data, std::memory_order_relaxed);
+	s.data.store(data, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The state of a single search thread.
+ */
+class searcher::worker
+{
+public:
+	worker(searcher &s, int id) : nodes(0), s(s), id(id), killers() {}
+
+	/**
+	 * @brief Run iterative deepening until the depth limit is reached or the
+	 * search is stopped.
+	 * @param root The position to search
+	 * @param on_info Called after every completed iteration if set
+	 * @return The result of the deepest completed iteration
+	 */
+	search_info iterate(const board &root, const info_callback &on_info);
+
+	std::atomic<uint64_t> nodes;
+
+private:
+	searcher &s;
+	const int id;
+	board::move_t killers[MAX_PLY][2];
+	board::move_t root_best;
+
+	/**
+	 * Check the time and node limits every this many nodes, plus one
+	 */
+	static constexpr uint64_t CHECK_INTERVAL = 63;
+
+	bool count_node();
+	int negamax(const board &b, int depth, int alpha, int beta, int ply);
+	int quiesce(const board &b, int alpha, int beta, int ply);
+	void order(const board &b, board::move_list &moves,
+			   board::move_t tt_move, int ply) const;
+	std::vector<board::move_t> principal_variation(board b, int depth) const;
+
+	static void make(board &b, board::move_t m);
+	static int to_tt(int score, int ply);
+	static int from_tt(int score, int ply);
+};
+
+search_info searcher::worker::iterate(const board &root,
+									  const info_callback &on_info)
+{
+	search_info result;
+
+	// helper threads start one ply deeper every other thread so they do not
+	// all search the same tree in lockstep
+	for (int depth = 1 + (id & 1); depth <= s.max_depth; ++depth)
+	{
+		trace::span iteration("iteration", "search", "depth", depth);
+		root_best = NO_MOVE;
+		const int score = negamax(root, depth, -MATE - 1, MATE + 1, 0);
+		if (s.stopped.load(std::memory_order_relaxed))
+		{
+			// keep the best move of an unfinished iteration only if there
+			// is nothing better
+			if (result.pv.empty() and root_best != NO_MOVE)
+				result.pv = {root_best};
+			break;
+		}
+
+		result.depth = depth;
+		result.score = score;
+		result.pv = principal_variation(root, depth);
+		result.nodes = s.nodes();
+		result.elapsed = s.elapsed();
+		if (on_info)
+			on_info(result);
+
+		// another iteration would take several times as long as this one,
+		// so do not start it if it cannot finish before the soft limit
+		if (id == 0 and s.soft_limit and
+			!s.pondering.load(std::memory_order_relaxed) and
+			result.elapsed >= s.soft_limit / 2)
+			break;
+		if (score > MATE - MAX_PLY or score < -MATE + MAX_PLY)
+			if (id == 0 and !s.pondering and !s.infinite)
+				break;
+	}
+
+	result.nodes = s.nodes();
+	result.elapsed = s.elapsed();
+	return result;
+}
+
+bool searcher::worker::count_node()
+{
+	const uint64_t count = nodes.load(std::memory_order_relaxed) + 1;
+	nodes.store(count, std::memory_order_relaxed);
+	if (id == 0 and (count & CHECK_INTERVAL) == 0 and s.should_stop())
+		return true;
+	return s.stopped.load(std::memory_order_relaxed);
+}
+
+int searcher::worker::negamax(const board &b, int depth, int alpha, int beta,
+							  int ply)
+{
+	if (count_node())
+		return 0;
+	// a repetition inside the search is scored as the draw it would become
+	if (ply > 0 and b.is_draw(2))
+		return 0;
+	if (depth <= 0)
+		return quiesce(b, alpha, beta, ply);
+
+	const uint64_t key = b.key();
+	transposition_table::entry e {};
+	board::move_t tt_move = NO_MOVE;
+	if (s.tt.probe(key, e))
+	{
+		tt_move = e.move;
+		const int score = from_tt(e.score, ply);
+		if (ply > 0 and e.depth >= depth and
+			(e.type == transposition_table::bound::exact or
+			 (e.type == transposition_table::bound::lower and score >= beta) or
+			 (e.type == transposition_table::bound::upper and score <= alpha)))
+			return score;
+	}
+
+	auto moves = b.legal_moves();
+	if (moves.empty())
+		return b.is_check(b.turn()) ? -MATE + ply : 0;
+	if (ply >= MAX_PLY - 1)
+		return evaluate(b);
+
+	order(b, moves, tt_move, ply);
+
+	const int alpha_orig = alpha;
+	int best = -MATE - 1;
+	board::move_t best_move = NO_MOVE;
+	for (auto m : moves)
+	{
+		board child = b;
+		make(child, m);
+		const int score = -negamax(child, depth - 1, -beta, -alpha, ply + 1);
+		if (s.stopped.load(std::memory_order_relaxed))
+			return 0;
+
+		if (score > best)
+		{
+			best = score;
+			best_move = m;
+			if (ply == 0)
+				root_best = m;
+		}
+		if (score > alpha)
+			alpha = score;
+		if (alpha >= beta)
+		{
+			if (b.at(m.second, !b.turn()) == board::piece::empty and
+				killers[ply][0] != m)
+			{
+				killers[ply][1] = killers[ply][0];
+				killers[ply][0] = m;
+			}
+			break;
+		}
+	}
+
+	const auto type = best >= beta ? transposition_table::bound::lower :
+					  best > alpha_orig ? transposition_table::bound::exact :
+					  transposition_table::bound::upper;
+	s.tt.store(key, {best_move, to_tt(best, ply), depth, type});
+	return best;
+}
+
+int searcher::worker::quiesce(const board &b, int alpha, int beta, int ply)
+{
+	if (count_node())
+		return 0;
+
+	const int stand_pat = evaluate(b);
+	if (stand_pat >= beta or ply >= MAX_PLY - 1)
+		return stand_pat;
+	if (stand_pat > alpha)
+		alpha = stand_pat;
+
+	auto moves = b.legal_moves(true);
+	order(b, moves, NO_MOVE, ply);
+
+	int best = stand_pat;
+	for (auto m : moves)
+	{
+		board child = b;
+		make(child, m);
+		const int score = -quiesce(child, -beta, -alpha, ply + 1);
+		if (s.stopped.load(std::memory_order_relaxed))
+			return 0;
+
+		if (score > best)
+			best = score;
+		if (score > alpha)
+			alpha = score;
+		if (alpha >= beta)
+			break;
+	}
+	return best;
+}
+
+void searcher::worker::order(const board &b, board::move_list &moves,
+							 board::move_t tt_move, int ply) const
+{
+	int scores[board::move_list::CAPACITY];
+	for (int i = 0; i < moves.size; ++i)
+	{
+		const auto [from, to] = moves[i];
+		const int victim = static_cast<int>(b.at(to, !b.turn()));
+		const int attacker = static_cast<int>(b.at(from, b.turn()));
+		if (moves[i] == tt_move)
+			scores[i] = 1 << 20;
+		else if (victim)
+			// most valuable victim, least valuable attacker
+			scores[i] = (1 << 16) + PIECE_VALUE[victim] * 8 - PIECE_VALUE[attacker] / 8;
+		else if (moves[i] == killers[ply][0])
+			scores[i] = 1 << 15;
+		else if (moves[i] == killers[ply][1])
+			scores[i] = (1 << 15) - 1;
+		else
+			scores[i] = b.is_promotion(from, to) ? 1 << 14 : 0;
+	}
+
+	// insertion sort, the lists are short
+	for (int i = 1; i < moves.size; ++i)
+	{
+		const auto m = moves[i];
+		const int score = scores[i];
+		int j = i - 1;
+		for (; j >= 0 and scores[j] < score; --j)
+		{
+			moves[j + 1] = moves[j];
+			scores[j + 1] = scores[j];
+		}
+		moves[j + 1] = m;
+		scores[j + 1] = score;
+	}
+}
+
+std::vector<board::move_t> searcher::worker::principal_variation(board b,
+																  int depth) const
+{
+	std::vector<board::move_t> pv;
+	transposition_table::entry e {};
+	while (depth-- > 0 and s.tt.probe(b.key(), e))
+	{
+		const auto moves = b.legal_moves();
+		if (std::find(moves.begin(), moves.end(), e.move) == moves.end())
+			break;
+		pv.push_back(e.move);
+		make(b, e.move);
+	}
+	if (pv.empty() and root_best != NO_MOVE)
+		pv.push_back(root_best);
+	return pv;
+}
+
+void searcher::worker::make(board &b, board::move_t m)
+{
+	b.move(m.first, m.second);
+	if (b.promotion_pending())
+		b.move(m.second, board::QUEEN_PROMOTION);
+}
+
+int searcher::worker::to_tt(int score, int ply)
+{
+	// mate scores are stored relative to the node rather than the root
+	if (score > MATE - MAX_PLY)
+		return score + ply;
+	if (score < -MATE + MAX_PLY)
+		return score - ply;
+	return score;
+}
+
+int searcher::worker::from_tt(int score, int ply)
+{
+	if (score > MATE - MAX_PLY)
+		return score - ply;
+	if (score < -MATE + MAX_PLY)
+		return score + ply;
+	return score;
+}
+
+searcher::searcher(transposition_table &tt, int threads)
+: tt(tt), thread_count(std::max(threads, 1)), stopped(true), pondering(false),
+start_time(0), infinite(false), soft_limit(0), hard_limit(0), node_limit(0),
+max_depth(MAX_PLY - 1)
+{
+}
+
+searcher::~searcher()
+{
+	stop();
+	wait();
+}
+
+void searcher::set_threads(int threads)
+{
+	thread_count = std::max(threads, 1);
+}
+
+void searcher::prepare(const search_limits &limits, bool color)
+{
+	stopped = false;
+	pondering = limits.ponder;
+	infinite = limits.infinite;
+	node_limit = limits.nodes;
+	max_depth = limits.depth ? std::min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+	start_time = clock::now().time_since_epoch().count();
+
+	soft_limit = hard_limit = 0;
+	if (limits.movetime)
+		soft_limit = hard_limit = limits.movetime;
+	else if (limits.time[color])
+	{
+		// time kept in reserve for the GUI and the network
+		constexpr int64_t OVERHEAD = 30;
+		const int64_t time = limits.time[color], inc = limits.inc[color];
+		const int64_t moves = limits.movestogo ? limits.movestogo : 30;
+		soft_limit = time / moves + inc * 3 / 4;
+		hard_limit = std::max<int64_t>(1, std::min(soft_limit * 4, time - OVERHEAD));
+		soft_limit = std::min(soft_limit, hard_limit);
+	}
+}
+
+int64_t searcher::elapsed() const
+{
+	const auto now = clock::now().time_since_epoch().count();
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		clock::duration(now - start_time.load())).count();
+}
+
+uint64_t searcher::nodes() const
+{
+	uint64_t total = 0;
+	for (const auto &w : workers)
+		total += w->nodes.load(std::memory_order_relaxed);
+	return total;
+}
+
+bool searcher::should_stop()
+{
+	if ((hard_limit and !pondering.load(std::memory_order_relaxed) and
+		 elapsed() >= hard_limit) or
+		(node_limit and nodes() >= node_limit))
+		stopped = true;
+	return stopped.load(std::memory_order_relaxed);
+}
+
+void searcher::start(const board &b, const search_limits &limits,
+					 info_callback on_info, bestmove_callback on_bestmove)
+{
+	stop();
+	wait();
+
+	workers.clear();
+	for (int i = 0; i < thread_count; ++i)
+		workers.push_back(std::make_unique<worker>(*this, i));
+	prepare(limits, b.turn());
+
+	main_thread = std::thread([this, b, on_info = std::move(on_info),
+							   on_bestmove = std::move(on_bestmove)] {
+		trace::name_thread("search");
+		std::vector<std::thread> helpers;
+		for (int i = 1; i < thread_count; ++i)
+			helpers.emplace_back([this, &b, i] {
+				trace::name_thread("search helper");
+				workers[i]->iterate(b, {});
+			});
+
+		const search_info result = workers[0]->iterate(b, on_info);
+
+		// the best move of a pondering or infinite search may only be
+		// reported once the GUI says so
+		{
+			std::unique_lock lock(mutex);
+			cv.wait(lock, [this] {
+				return stopped.load() or !(pondering.load() or infinite);
+			});
+			stopped = true;
+		}
+		for (auto &helper : helpers)
+			helper.join();
+
+		on_bestmove(result.pv.empty() ? NO_MOVE : result.pv[0],
+					result.pv.size() > 1 ? result.pv[1] : NO_MOVE);
+	});
+}
+
+void searcher::stop()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopped = true;
+	}
+	cv.notify_all();
+}
+
+void searcher::ponderhit()
+{
+	{
+		std::lock_guard lock(mutex);
+		start_time = clock::now().time_since_epoch().count();
+		pondering = false;
+	}
+	cv.notify_all();
+}
+
+void searcher::wait()
+{
+	if (main_thread.joinable())
+		main_thread.join();
+}
+
+search_info searcher::run(const board &b, const search_limits &limits)
+{
+	workers.clear();
+	workers.push_back(std::make_unique<worker>(*this, 0));
+	search_limits sync_limits = limits;
+	sync_limits.ponder = sync_limits.infinite = false;
+	prepare(sync_limits, b.turn());
+
+	search_info result = workers[0]->iterate(b, {});
+	stopped = true;
+	return result;
+}
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "board.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chess {
+
+/**
+ * @brief Count the leaf nodes of the legal move tree to a given depth. Each
+ * promotion counts as four moves, one per piece.
+ * @param b The position to start from
+ * @param depth The depth in plies
+ * @return The number of leaf nodes
+ */
+uint64_t perft(const board &b, int depth);
+
+/**
+ * @brief The limits of a search. A value of zero means there is no limit.
+ */
+struct search_limits
+{
+	int depth = 0;				// maximum depth in plies
+	uint64_t nodes = 0;			// maximum number of nodes over all threads
+	int64_t movetime = 0;		// exact time to search in milliseconds
+	int64_t time[2] = {0, 0};	// clock time left in milliseconds by color
+	int64_t inc[2] = {0, 0};	// increment per move in milliseconds by color
+	int movestogo = 0;			// moves until the next time control
+	bool infinite = false;		// search until stopped
+	bool ponder = false;		// search on the opponent's time until ponderhit
+};
+
+/**
+ * @brief The progress of a search after each completed iteration, and its
+ * result once it is finished.
+ */
+struct search_info
+{
+	int depth = 0;
+	int score = 0;				// centipawns from the side to move
+	uint64_t nodes = 0;
+	int64_t elapsed = 0;		// milliseconds since the search started
+	std::vector<board::move_t> pv;
+};
+
+/**
+ * @brief A transposition table shared between search threads. Entries are
+ * stored as two 64-bit words with the key xor-ed with the data, so a torn
+ * write from a concurrent thread is detected on probe instead of requiring a
+ * lock.
+ */
+class transposition_table
+{
+public:
+	enum class bound : uint8_t
+	{
+		none = 0, exact, lower, upper
+	};
+
+	struct entry
+	{
+		board::move_t move;
+		int score;
+		int depth;
+		bound type;
+	};
+
+	explicit transposition_table(std::size_t megabytes = 16);
+
+	/**
+	 * @brief Resize the table, which also clears it.
+	 * @param megabytes The size of the table. Rounded down to a power of two
+	 * number of entries.
+	 */
+	void resize(std::size_t megabytes);
+
+	void clear();
+
+	/**
+	 * @brief Look up a position.
+	 * @param key The Zobrist key of the position
+	 * @param e Filled with the stored entry. Not modified if there is none.
+	 * @return true if the position was found, false otherwise
+	 */
+	bool probe(uint64_t key, entry &e) const;
+
+	void store(uint64_t key, const entry &e);
+
+private:
+	struct slot
+	{
+		std::atomic<uint64_t> key;
+		std::atomic<uint64_t> data;
+	};
+
+	std::unique_ptr<slot[]> slots;
+	std::size_t mask;
+};
+
+/**
+ * @brief Iterative deepening alpha-beta search. A search runs asynchronously
+ * on one main thread and any number of helper threads which share the
+ * transposition table (lazy SMP), or synchronously on the calling thread.
+ */
+class searcher
+{
+public:
+	using info_callback = std::function<void(const search_info &)>;
+	using bestmove_callback =
+		std::function<void(board::move_t best, board::move_t ponder)>;
+
+	static constexpr int MATE = 32000;
+	static constexpr int MAX_PLY = 64;
+	static constexpr board::move_t NO_MOVE = {-1, -1};
+
+	explicit searcher(transposition_table &tt, int threads = 1);
+	~searcher();
+
+	/**
+	 * @brief Set the number of threads used by start(). Only takes effect on
+	 * the next search.
+	 */
+	void set_threads(int threads);
+
+	/**
+	 * @brief Start searching in the background. Any search in progress is
+	 * stopped first.
+	 * @param b The position to search
+	 * @param limits When to stop searching
+	 * @param on_info Called from the main search thread after every
+	 * completed iteration
+	 * @param on_bestmove Called from the main search thread exactly once when
+	 * the search is finished. The ponder move is NO_MOVE if there is none.
+	 */
+	void start(const board &b, const search_limits &limits,
+			   info_callback on_info, bestmove_callback on_bestmove);
+
+	/**
+	 * @brief Stop the search. The best move is reported through the callback
+	 * as soon as the search threads notice, which they check at every node.
+	 */
+	void stop();
+
+	/**
+	 * @brief The opponent played the move that was pondered on. The search
+	 * continues with the time limits starting from now.
+	 */
+	void ponderhit();
+
+	/**
+	 * @brief Block until the search in progress, if any, has finished.
+	 */
+	void wait();
+
+	/**
+	 * @brief Search on the calling thread until the limits are reached.
+	 * Pondering and infinite searches are not supported here.
+	 * @return The result of the deepest completed iteration
+	 */
+	search_info run(const board &b, const search_limits &limits);
+
+private:
+	class worker;
+	friend class worker;
+
+	using clock = std::chrono::steady_clock;
+
+	transposition_table &tt;
+	int thread_count;
+
+	std::vector<std::unique_ptr<worker>> workers;
+	std::thread main_thread;
+
+	std::atomic<bool> stopped;
+	std::atomic<bool> pondering;
+	std::atomic<int64_t> start_time;	// clock ticks
+	bool infinite;
+	int64_t soft_limit, hard_limit;	// milliseconds, 0 for none
+	uint64_t node_limit;
+	int max_depth;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	void prepare(const search_limits &limits, bool color);
+	int64_t elapsed() const;
+	uint64_t nodes() const;
+	bool should_stop();
+};
+
+}
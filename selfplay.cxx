@@ -0,0 +1,399 @@
+#include "board.hpp"
+#include "game_log.hpp"
+#include "packed.hpp"
+#include "search.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief The output file. Threads reserve a range of it with a single atomic
+ * add and write their records there, so no lock is ever taken and records
+ * from different threads never interleave. A failed write does not throw,
+ * since it happens on the threads playing games and when their buffers are
+ * destroyed; the first error is kept for main() to report instead.
+ */
+class record_file
+{
+public:
+	explicit record_file(const std::string &path)
+	: fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), offset(0)
+	{
+		if (fd < 0)
+			throw std::runtime_error("Could not open " + path);
+	}
+
+	~record_file() { close(fd); }
+
+	record_file(const record_file &) = delete;
+	record_file &operator=(const record_file &) = delete;
+
+	/**
+	 * @return false if the records could not be written
+	 */
+	bool write(const chess::packed_position *records, std::size_t count)
+	{
+		const char *data = reinterpret_cast<const char *>(records);
+		std::size_t size = count * sizeof(chess::packed_position);
+		off_t at = offset.fetch_add(size, std::memory_order_relaxed);
+		while (size)
+		{
+			const ssize_t written = pwrite(fd, data, size, at);
+			if (written < 0 and errno == EINTR)
+				continue;
+			if (written <= 0)
+			{
+				// a write that makes no progress would loop forever
+				int none = 0;
+				error.compare_exchange_strong(none, written < 0 ? errno : EIO);
+				return false;
+			}
+			data += written;
+			at += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	inline uint64_t bytes() const { return offset.load(); }
+
+	/**
+	 * @brief Whether a write has failed, after which there is no point in
+	 * playing on.
+	 */
+	inline bool failed() const
+	{
+		return error.load(std::memory_order_relaxed) != 0;
+	}
+
+	/**
+	 * @brief The errno of the first write that failed, or 0.
+	 */
+	inline int first_error() const { return error.load(); }
+
+private:
+	int fd;
+	std::atomic<off_t> offset;
+	std::atomic<int> error {0};
+};
+
+/**
+ * @brief Records of one thread, written out to the file a block at a time.
+ */
+class record_buffer
+{
+public:
+	static constexpr std::size_t CAPACITY = 4096;	// 128 KiB
+
+	explicit record_buffer(record_file &file) : file(file)
+	{
+		records.reserve(CAPACITY);
+	}
+
+	~record_buffer() { flush(); }
+
+	void append(const std::vector<chess::packed_position> &game)
+	{
+		if (records.size() + game.size() > CAPACITY)
+			flush();
+		records.insert(records.end(), game.begin(), game.end());
+	}
+
+	/**
+	 * @brief Write out the records. A failure is kept by the file.
+	 */
+	void flush()
+	{
+		if (!records.empty() and !file.failed())
+			file.write(records.data(), records.size());
+		records.clear();
+	}
+
+private:
+	record_file &file;
+	std::vector<chess::packed_position> records;
+};
+
+struct match_options
+{
+	uint64_t games = 1000;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	int random_plies = 8;		// random moves at the start of each game
+	int max_plies = 400;		// longer games are adjudicated as draws
+	std::size_t hash = 16;		// transposition table per thread in MB
+	uint64_t seed = 1;
+	chess::search_limits limits;
+};
+
+struct match_stats
+{
+	uint64_t games = 0;
+	uint64_t positions = 0;
+	uint64_t results[3] = {0, 0, 0};	// by packed_position::result_t
+};
+
+/**
+ * @brief A game in progress, and where its moves are logged if anywhere.
+ */
+struct game
+{
+	chess::board b;
+	chess::game_log *log = nullptr;
+	uint32_t id = 0;
+
+	void play(int from, int to, int promotion = 0)
+	{
+		b.move(from, to);
+		if (b.promotion_pending())
+			b.move(to, promotion ? promotion : chess::board::QUEEN_PROMOTION);
+		if (log)
+			log->move(id, from, to, promotion);
+	}
+};
+
+/**
+ * @brief Play random legal moves to diversify the openings. Stops early if
+ * the game ends.
+ */
+void randomize(game &g, int plies, std::mt19937_64 &rng)
+{
+	constexpr int PROMOTIONS[4] = {
+		chess::board::QUEEN_PROMOTION, chess::board::ROOK_PROMOTION,
+		chess::board::BISHOP_PROMOTION, chess::board::KNIGHT_PROMOTION
+	};
+	for (; plies > 0; --plies)
+	{
+		const auto moves = g.b.legal_moves();
+		if (moves.empty() or g.b.is_draw())
+			return;
+		const auto [from, to] = moves[rng() % moves.size];
+		g.play(from, to, g.b.is_promotion(from, to) ? PROMOTIONS[rng() % 4] : 0);
+	}
+}
+
+/**
+ * @brief Play one game of the engine against itself.
+ * @param positions Filled with every searched position, labelled with the
+ * result
+ * @param log Where to log the moves, or nullptr
+ * @return The result of the game
+ */
+chess::packed_position::result_t play(chess::searcher &search,
+									  const match_options &options,
+									  std::mt19937_64 &rng,
+									  std::vector<chess::packed_position> &positions,
+									  chess::game_log *log)
+{
+	using chess::packed_position;
+
+	positions.clear();
+	game g;
+	if (log)
+	{
+		g.log = log;
+		g.id = log->start();
+	}
+	randomize(g, options.random_plies, rng);
+
+	packed_position::result_t result = packed_position::draw;
+	for (int ply = 0; ply < options.max_plies; ++ply)
+	{
+		if (g.b.is_draw())
+			break;
+		if (g.b.legal_moves().empty())
+		{
+			if (g.b.is_check(g.b.turn()))
+				result = g.b.turn() ? packed_position::white_win
+									: packed_position::black_win;
+			break;
+		}
+
+		const chess::search_info info = search.run(g.b, options.limits);
+		if (info.pv.empty())
+			break;
+		const int score = g.b.turn() ? -info.score : info.score;
+		positions.push_back(packed_position::pack(g.b, score, result));
+
+		const auto [from, to] = info.pv.front();
+		g.play(from, to);
+	}
+
+	// indexed by packed_position::result_t
+	constexpr chess::game_log::result_t LOG_RESULT[3] = {
+		chess::game_log::black_win, chess::game_log::draw,
+		chess::game_log::white_win
+	};
+	if (log)
+		log->end(g.id, LOG_RESULT[result]);
+	for (auto &p : positions)
+		p.result = result;
+	return result;
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-g games] [-t threads] [-n nodes] "
+			  "[-m movetime] [-d depth] [-r random plies] [-p max plies] "
+			  "[-H hash MB] [-s seed] [-l game log] output\n"
+			  "Plays the engine against itself and writes every searched "
+			  "position to the output\n"
+			  "as a 32 byte packed_position labelled with the score and the "
+			  "game result.\n"
+			  "With -l every move is also appended to a game log as it is "
+			  "played." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	match_options options;
+	std::string path, log_path;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg[0] != '-')
+		{
+			path = arg;
+			continue;
+		}
+		if (i + 1 >= argc or arg.size() != 2)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		const char *value = argv[++i];
+		try
+		{
+			switch (arg[1])
+			{
+			case 'g': options.games = std::stoull(value); break;
+			case 't': options.threads = std::max(1, atoi(value)); break;
+			case 'n': options.limits.nodes = std::stoull(value); break;
+			case 'm': options.limits.movetime = atoi(value); break;
+			case 'd': options.limits.depth = atoi(value); break;
+			case 'r': options.random_plies = atoi(value); break;
+			case 'p': options.max_plies = atoi(value); break;
+			case 'H': options.hash = std::stoul(value); break;
+			case 's': options.seed = std::stoull(value); break;
+			case 'l': log_path = value; break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		catch (std::logic_error &e)
+		{
+			// from std::stoull and friends, for a value that is not a number
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (path.empty())
+	{
+		usage(argv[0]);
+		return 0;
+	}
+	if (!options.limits.depth and !options.limits.nodes and
+		!options.limits.movetime)
+		options.limits.nodes = 5000;
+
+	record_file file(path);
+	std::unique_ptr<chess::game_log> log;
+	if (!log_path.empty())
+		log = std::make_unique<chess::game_log>(log_path);
+	std::atomic<uint64_t> next_game(0), finished(0);
+	std::vector<match_stats> stats(options.threads);
+
+	// every thread plays its own games with its own search and table, so the
+	// only shared state is the game counter and the file offset
+	auto play_games = [&](unsigned index) {
+		chess::transposition_table tt(options.hash);
+		chess::searcher search(tt);
+		std::mt19937_64 rng(options.seed * 0x9E3779B97F4A7C15ull + index);
+		record_buffer buffer(file);
+		std::vector<chess::packed_position> positions;
+		match_stats &s = stats[index];
+
+		while (!file.failed() and
+			   next_game.fetch_add(1, std::memory_order_relaxed) < options.games)
+		{
+			tt.clear();
+			const auto result = play(search, options, rng, positions, log.get());
+			buffer.append(positions);
+			++s.games;
+			s.positions += positions.size();
+			++s.results[result];
+			finished.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	auto games_per_hour = [&](uint64_t games) {
+		const double seconds =
+			std::chrono::duration<double>(clock::now() - start).count();
+		return seconds > 0 ? games * 3600 / seconds : 0;
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < options.threads; ++i)
+		pool.emplace_back(play_games, i);
+
+	// progress once every ten seconds
+	auto last_report = clock::now();
+	while (finished.load() < options.games and !file.failed())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (clock::now() - last_report >= std::chrono::seconds(10))
+		{
+			last_report = clock::now();
+			const uint64_t done = finished.load();
+			std::cerr << done << '/' << options.games << " games, "
+					  << static_cast<uint64_t>(games_per_hour(done))
+					  << " games/hour" << std::endl;
+		}
+	}
+	for (auto &t : pool)
+		t.join();
+	if (file.failed())
+	{
+		std::cerr << "Could not write " << path << ": "
+				  << std::strerror(file.first_error()) << std::endl;
+		return 1;
+	}
+
+	match_stats total;
+	for (const auto &s : stats)
+	{
+		total.games += s.games;
+		total.positions += s.positions;
+		for (int r = 0; r < 3; ++r)
+			total.results[r] += s.results[r];
+	}
+
+	using chess::packed_position;
+	std::cout << total.games << " games, " << total.positions << " positions\n"
+			  << "white wins " << total.results[packed_position::white_win]
+			  << ", draws " << total.results[packed_position::draw]
+			  << ", black wins " << total.results[packed_position::black_win]
+			  << '\n'
+			  << static_cast<uint64_t>(games_per_hour(total.games))
+			  << " games/hour on " << options.threads << " threads" << std::endl;
+	return 0;
+}
@@ -0,0 +1,225 @@
+#include "stats.hpp"
+
+#include <array>
+#include <csignal>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace chess::stats {
+
+namespace {
+constexpr std::size_t COUNTERS = static_cast<std::size_t>(counter::COUNT);
+
+constexpr const char *NAMES[COUNTERS] = {
+	"moves", "moves_rejected", "is_check", "is_check_squares", "trial_moves",
+	"hashes", "messages_sent", "messages_received"
+};
+
+uint64_t divided(uint64_t n, uint64_t d)
+{
+	return d ? n * 100 / d : 0;
+}
+
+/**
+ * @brief Writes text to a file descriptor through a fixed buffer, without
+ * allocating or locking, so it can be used from a signal handler.
+ */
+class raw_writer
+{
+public:
+	explicit raw_writer(int fd) : fd(fd), used(0) {}
+	~raw_writer() { flush(); }
+
+	raw_writer &operator<<(const char *s)
+	{
+		while (*s)
+			put(*s++);
+		return *this;
+	}
+
+	raw_writer &operator<<(char c)
+	{
+		put(c);
+		return *this;
+	}
+
+	raw_writer &operator<<(uint64_t n)
+	{
+		char digits[20];
+		int count = 0;
+		do
+		{
+			digits[count++] = static_cast<char>('0' + n % 10);
+			n /= 10;
+		} while (n);
+		while (count)
+			put(digits[--count]);
+		return *this;
+	}
+
+	/**
+	 * @brief Write a number kept in hundredths with two decimals.
+	 */
+	raw_writer &hundredths(uint64_t n)
+	{
+		*this << n / 100;
+		put('.');
+		put(static_cast<char>('0' + n / 10 % 10));
+		put(static_cast<char>('0' + n % 10));
+		return *this;
+	}
+
+	void flush()
+	{
+		std::size_t done = 0;
+		while (done < used)
+		{
+			const ssize_t n = ::write(fd, buffer + done, used - done);
+			if (n <= 0)
+				break;
+			done += static_cast<std::size_t>(n);
+		}
+		used = 0;
+	}
+
+private:
+	int fd;
+	std::size_t used;
+	char buffer[512];
+
+	void put(char c)
+	{
+		if (used == sizeof(buffer))
+			flush();
+		buffer[used++] = c;
+	}
+};
+
+/**
+ * @brief The same for a stream.
+ */
+struct stream_writer
+{
+	std::ostream &os;
+
+	template <typename T>
+	stream_writer &operator<<(const T &v)
+	{
+		os << v;
+		return *this;
+	}
+
+	stream_writer &hundredths(uint64_t n)
+	{
+		os << n / 100 << '.' << n / 10 % 10 << n % 10;
+		return *this;
+	}
+};
+
+/**
+ * @brief Write the totals with anything that has operator<< for strings,
+ * characters and unsigned numbers, and hundredths().
+ */
+template <typename W>
+void write_totals(W &out)
+{
+	uint64_t totals[COUNTERS];
+	for (std::size_t i = 0; i < COUNTERS; ++i)
+	{
+		totals[i] = total(static_cast<counter>(i));
+		out << "stats: " << NAMES[i] << ' ' << totals[i] << '\n';
+	}
+	const auto at = [&totals](counter c) {
+		return totals[static_cast<std::size_t>(c)];
+	};
+	const uint64_t legal = at(counter::moves) - at(counter::moves_rejected);
+	out << "stats: per legal move: ";
+	out.hundredths(divided(at(counter::is_check), legal)) << " is_check, ";
+	out.hundredths(divided(at(counter::is_check_squares), legal))
+		<< " squares, ";
+	out.hundredths(divided(at(counter::trial_moves), legal))
+		<< " trial moves\n";
+}
+}
+
+#ifdef CHESS_STATS
+namespace {
+constexpr std::size_t MAX_THREADS = 256;
+
+// one more set than there are threads, shared by any thread beyond
+// MAX_THREADS, whose counts may then be lost to races
+std::array<thread_counters, MAX_THREADS + 1> sets;
+
+/**
+ * @brief Takes a set of counters for its thread, and gives it back when the
+ * thread ends.
+ */
+struct owner
+{
+	thread_counters *mine;
+
+	owner() : mine(&sets[MAX_THREADS])
+	{
+		for (std::size_t i = 0; i < MAX_THREADS; ++i)
+			if (!sets[i].taken.exchange(true, std::memory_order_acquire))
+			{
+				mine = &sets[i];
+				break;
+			}
+	}
+
+	~owner()
+	{
+		if (mine != &sets[MAX_THREADS])
+			mine->taken.store(false, std::memory_order_release);
+	}
+};
+
+void on_signal(int)
+{
+	raw_writer out(STDERR_FILENO);
+	write_totals(out);
+}
+
+[[maybe_unused]] const bool installed = [] {
+	std::signal(SIGUSR1, on_signal);
+	std::atexit([] { on_signal(0); });
+	return true;
+}();
+}
+
+thread_counters &local()
+{
+	thread_local owner o;
+	return *o.mine;
+}
+#endif
+
+const char *name(counter c)
+{
+	return NAMES[static_cast<std::size_t>(c)];
+}
+
+uint64_t total(counter c)
+{
+#ifdef CHESS_STATS
+	uint64_t sum = 0;
+	for (const auto &s : sets)
+		sum += s.counts[static_cast<std::size_t>(c)].load(
+			std::memory_order_relaxed);
+	return sum;
+#else
+	(void)c;
+	return 0;
+#endif
+}
+
+void dump(std::ostream &os)
+{
+	if (!ENABLED)
+		return;
+	stream_writer out {os};
+	write_totals(out);
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * @brief Counters of the main operations, to find out what a workload really
+ * costs, i.e. how many squares is_check looks at for each legal move.
+ *
+ * They are only kept in a build with CHESS_STATS defined, which the CMake
+ * option of the same name does. Otherwise CHESS_COUNT expands to nothing and
+ * the counters cost nothing at all. When kept, every thread has counters of
+ * its own on a cache line of its own, bumped with a plain load and store. The
+ * totals over every thread are written to stderr when the program exits, and
+ * whenever it gets SIGUSR1.
+ */
+#ifdef CHESS_STATS
+#define CHESS_COUNT(c) ::chess::stats::add(::chess::stats::counter::c)
+#define CHESS_COUNT_N(c, n) ::chess::stats::add(::chess::stats::counter::c, (n))
+#else
+#define CHESS_COUNT(c) ((void)0)
+#define CHESS_COUNT_N(c, n) ((void)0)
+#endif
+
+namespace chess::stats {
+
+enum class counter
+{
+	moves,				// calls to board::move
+	moves_rejected,		// of those, the ones that returned false
+	is_check,			// calls to board::is_check
+	is_check_squares,	// squares is_check tried as attackers
+	trial_moves,		// moves made and taken back to see if the king is safe
+	hashes,				// hashes and keys of positions computed from scratch
+	messages_sent,
+	messages_received,
+	COUNT
+};
+
+#ifdef CHESS_STATS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+/**
+ * @brief The name of a counter, as it is dumped.
+ */
+const char *name(counter c);
+
+/**
+ * @brief The sum of a counter over every thread, including those that ended.
+ * Always 0 when the counters are not kept.
+ */
+uint64_t total(counter c);
+
+/**
+ * @brief Write every total, and how many is_check calls, squares and trial
+ * moves each legal move took. Writes nothing when the counters are not kept.
+ */
+void dump(std::ostream &os);
+
+#ifdef CHESS_STATS
+/**
+ * @brief The counters of one thread. A thread takes a free set when it first
+ * counts something and gives it back when it ends, so the counts of threads
+ * that ended stay in the totals.
+ */
+struct alignas(64) thread_counters
+{
+	std::atomic<uint64_t> counts[static_cast<std::size_t>(counter::COUNT)] {};
+	std::atomic<bool> taken {false};
+};
+
+/**
+ * @brief The counters of the calling thread.
+ */
+thread_counters &local();
+
+inline void add(counter c, uint64_t n = 1)
+{
+	auto &v = local().counts[static_cast<std::size_t>(c)];
+	v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+#endif
+
+}
@@ -0,0 +1,220 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace chess::trace {
+
+namespace detail {
+std::atomic<bool> active {false};
+}
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+// spans kept per thread and trace, any more are dropped
+constexpr std::size_t CAPACITY = 1 << 16;
+
+struct event
+{
+	const char *name;
+	const char *category;
+	const char *arg_name;
+	int64_t arg;
+	int64_t begin;
+	int64_t duration;
+	uint32_t tid;
+};
+
+/**
+ * @brief The spans of one thread. Only the thread using it writes events,
+ * and publishes them by storing the count, so stop() can read them while the
+ * thread carries on. A buffer is used again by a new thread once its thread
+ * ends, and only the thread using it clears it.
+ */
+struct buffer
+{
+	std::unique_ptr<event[]> events {new event[CAPACITY]};
+	std::atomic<std::size_t> count {0};
+	std::atomic<uint32_t> generation {0};	// of the spans in it
+	std::atomic<bool> taken {true};
+};
+
+std::atomic<int64_t> origin {0};		// when tracing started, in clock ticks
+std::atomic<uint32_t> generation {0};	// bumped by every start()
+
+// buffers and thread names are only added, and never freed, so a thread
+// that ends leaves its spans behind
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<buffer>> buffers;
+std::vector<std::pair<uint32_t, const char *>> thread_names;
+uint32_t next_tid = 1;
+std::string output;
+
+thread_local uint32_t tid = 0;
+thread_local const char *label = nullptr;
+
+uint32_t thread_id()
+{
+	if (!tid)
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		tid = next_tid++;
+		if (label)
+			thread_names.emplace_back(tid, label);
+	}
+	return tid;
+}
+
+/**
+ * @brief Takes a buffer for its thread on the first span, and gives it back
+ * when the thread ends.
+ */
+struct owner
+{
+	buffer *mine = nullptr;
+
+	buffer &get()
+	{
+		if (mine)
+			return *mine;
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		for (auto &b : buffers)
+			if (!b->taken.exchange(true, std::memory_order_acquire))
+				return *(mine = b.get());
+		buffers.push_back(std::make_unique<buffer>());
+		return *(mine = buffers.back().get());
+	}
+
+	~owner()
+	{
+		if (mine)
+			mine->taken.store(false, std::memory_order_release);
+	}
+};
+
+/**
+ * @brief Write nanoseconds as microseconds, which the format uses.
+ */
+void write_us(std::ostream &os, int64_t ns)
+{
+	const char fraction[] = {
+		static_cast<char>('0' + ns / 100 % 10),
+		static_cast<char>('0' + ns / 10 % 10),
+		static_cast<char>('0' + ns % 10), '\0'
+	};
+	os << ns / 1000 << '.' << fraction;
+}
+
+[[maybe_unused]] const bool from_environment = [] {
+	if (const char *path = std::getenv("CHESS_TRACE"); path and *path)
+	{
+		start(path);
+		std::atexit([] { stop(); });
+	}
+	return true;
+}();
+}
+
+namespace detail {
+int64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		clock_type::duration(clock_type::now().time_since_epoch().count() -
+							 origin.load(std::memory_order_relaxed))).count();
+}
+
+void record(const char *name, const char *category, int64_t begin,
+			const char *arg_name, int64_t arg)
+{
+	const int64_t end = now();
+	thread_local owner o;
+	buffer &b = o.get();
+
+	const uint32_t current = generation.load(std::memory_order_relaxed);
+	std::size_t count = b.count.load(std::memory_order_relaxed);
+	if (b.generation.load(std::memory_order_relaxed) != current)
+	{
+		// the spans are from an earlier trace
+		count = 0;
+		b.count.store(0, std::memory_order_relaxed);
+		b.generation.store(current, std::memory_order_release);
+	}
+	if (count == CAPACITY)
+		return;
+	b.events[count] = {name, category, arg_name, arg, begin, end - begin,
+					   thread_id()};
+	b.count.store(count + 1, std::memory_order_release);
+}
+}
+
+void start(const std::string &path)
+{
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		output = path;
+	}
+	origin.store(clock_type::now().time_since_epoch().count(),
+				 std::memory_order_relaxed);
+	generation.fetch_add(1, std::memory_order_relaxed);
+	detail::active.store(true, std::memory_order_relaxed);
+}
+
+bool stop()
+{
+	if (!detail::active.exchange(false, std::memory_order_relaxed))
+		return false;
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::ofstream out(output);
+	if (!out.is_open())
+		return false;
+
+	const uint32_t current = generation.load(std::memory_order_relaxed);
+	out << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto &[id, name] : thread_names)
+	{
+		out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\","
+			   "\"pid\":1,\"tid\":" << id << ",\"args\":{\"name\":\"" << name
+			<< "\"}}";
+		first = false;
+	}
+	for (const auto &b : buffers)
+	{
+		if (b->generation.load(std::memory_order_acquire) != current)
+			continue;
+		const std::size_t count = b->count.load(std::memory_order_acquire);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const event &e = b->events[i];
+			out << (first ? "" : ",\n") << "{\"name\":\"" << e.name
+				<< "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"ts\":";
+			write_us(out, e.begin);
+			out << ",\"dur\":";
+			write_us(out, e.duration);
+			out << ",\"pid\":1,\"tid\":" << e.tid;
+			if (e.arg_name)
+				out << ",\"args\":{\"" << e.arg_name << "\":" << e.arg << '}';
+			out << '}';
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	return out.good();
+}
+
+void name_thread(const char *name)
+{
+	label = name;
+	if (!tid)
+		return;
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	thread_names.emplace_back(tid, name);
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace chess::trace {
+
+/**
+ * @brief Timeline tracing in the Chrome trace event format, which
+ * chrome://tracing and Perfetto open.
+ *
+ * Code marks what it does with scoped spans. Every thread appends its spans
+ * to a buffer of its own without locking, and the buffers are written out as
+ * one JSON file when tracing stops. Tracing is off unless started, either
+ * with start() or by setting the environment variable CHESS_TRACE to the path
+ * of the file, which is then written when the program exits. While it is off
+ * a span costs a relaxed load and a branch, so spans can stay in release
+ * builds.
+ */
+
+namespace detail {
+extern std::atomic<bool> active;
+
+int64_t now();
+void record(const char *name, const char *category, int64_t begin,
+			const char *arg_name, int64_t arg);
+}
+
+/**
+ * @brief Whether spans are being recorded.
+ */
+inline bool enabled()
+{
+	return detail::active.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Start recording, throwing away anything recorded before.
+ * @param path Where stop() writes the trace
+ */
+void start(const std::string &path);
+
+/**
+ * @brief Stop recording and write the trace. Spans still open on other
+ * threads are left out.
+ * @return false if nothing was being recorded or the file could not be written
+ */
+bool stop();
+
+/**
+ * @brief Name the calling thread in the trace.
+ * @param name A string that lives as long as the program, i.e. a literal
+ */
+void name_thread(const char *name);
+
+/**
+ * @brief Records the time from its construction to its destruction. The
+ * name, category and argument name must live as long as the program, i.e. be
+ * literals.
+ */
+class span
+{
+public:
+	span(const char *name, const char *category)
+			: name(name), category(category), arg_name(nullptr), arg_value(0),
+			  begin(enabled() ? detail::now() : -1)
+	{
+	}
+
+	/**
+	 * @brief A span with a number shown with it, i.e. a depth or a size.
+	 */
+	span(const char *name, const char *category, const char *arg_name,
+		 int64_t value)
+			: name(name), category(category), arg_name(arg_name),
+			  arg_value(value), begin(enabled() ? detail::now() : -1)
+	{
+	}
+
+	span(const span &) = delete;
+	span &operator=(const span &) = delete;
+
+	~span()
+	{
+		if (begin >= 0)
+			detail::record(name, category, begin, arg_name, arg_value);
+	}
+
+	/**
+	 * @brief Change the number, for one only known at the end of the span.
+	 */
+	void arg(int64_t value) { arg_value = value; }
+
+private:
+	const char *name;
+	const char *category;
+	const char *arg_name;
+	int64_t arg_value;
+	int64_t begin;	// in ns since tracing started, or -1 when not tracing
+};
+
+}
@@ -0,0 +1,177 @@
+#include "eval.hpp"
+#include "packed.hpp"
+#include "replay.hpp"
+#include "tuner.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr const char *TABLE_NAMES[7] = {
+	nullptr, "KING_TABLE", "QUEEN_TABLE", "ROOK_TABLE", "BISHOP_TABLE",
+	"KNIGHT_TABLE", "PAWN_TABLE"
+};
+
+/**
+ * @brief Print the weights as the piece values and piece-square tables of
+ * eval.cpp. The value of a piece is the average of its weights over the
+ * squares it can stand on, and the tables hold what is left.
+ */
+void print_tables(const chess::texel_tuner::weight_array &w)
+{
+	constexpr int PAWN = static_cast<int>(chess::board::piece::pawn);
+	constexpr int KING = static_cast<int>(chess::board::piece::king);
+
+	int value[7] = {0, 0, 0, 0, 0, 0, 0};
+	for (int p = KING + 1; p < 7; ++p)
+	{
+		// pawns never stand on the first or last rank
+		const int first = p == PAWN ? 8 : 0, last = p == PAWN ? 56 : 64;
+		const double sum = std::accumulate(w.begin() + (p - 1) * 64 + first,
+										   w.begin() + (p - 1) * 64 + last, 0.0);
+		value[p] = static_cast<int>(std::lround(sum / (last - first)));
+	}
+
+	std::cout << "constexpr int PIECE_VALUE[7] = {";
+	for (int p = 0; p < 7; ++p)
+		std::cout << value[p] << (p < 6 ? ", " : "};\n");
+
+	for (int p = KING; p < 7; ++p)
+	{
+		std::cout << "constexpr int " << TABLE_NAMES[p] << "[64] = {";
+		for (int i = 0; i < 64; ++i)
+		{
+			const bool dead = p == PAWN and (i < 8 or i >= 56);
+			const int bonus = dead ? 0 :
+				static_cast<int>(std::lround(w[(p - 1) * 64 + i])) - value[p];
+			std::cout << (i % 8 ? "," : i ? ",\n\t" : "\n\t")
+					  << std::setw(3) << bonus;
+		}
+		std::cout << "\n};\n";
+	}
+}
+
+void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [-t threads] [-e epochs] [-r rate] "
+			  "[-k scale] positions\n"
+			  "Tunes the evaluation weights to the game results of a file of "
+			  "packed positions,\n"
+			  "such as the output of chess_selfplay, and prints them in the "
+			  "layout of eval.cpp.\n"
+			  "The scale of the sigmoid is fitted to the data unless it is "
+			  "given." << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	int epochs = 200;
+	double rate = 1;
+	double scale = 0;
+	std::string path;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg[0] != '-')
+		{
+			path = arg;
+			continue;
+		}
+		if (i + 1 >= argc or arg.size() != 2)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		const char *value = argv[++i];
+		try
+		{
+			switch (arg[1])
+			{
+			case 't': threads = std::max(1, atoi(value)); break;
+			case 'e': epochs = atoi(value); break;
+			case 'r': rate = std::stod(value); break;
+			case 'k': scale = std::stod(value); break;
+			default:
+				usage(argv[0]);
+				return 0;
+			}
+		}
+		catch (std::logic_error &e)
+		{
+			// from std::stoull and friends, for a value that is not a number
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (path.empty())
+	{
+		usage(argv[0]);
+		return 0;
+	}
+
+	try
+	{
+		const chess::mapped_file file(path);
+		const std::string_view data = file.view();
+		if (data.size() % sizeof(chess::packed_position))
+		{
+			std::cerr << path << " is not a file of packed positions" << std::endl;
+			return 1;
+		}
+		const std::span<const chess::packed_position> positions(
+			reinterpret_cast<const chess::packed_position *>(data.data()),
+			data.size() / sizeof(chess::packed_position));
+		// the tuner indexes its weights with the pieces, so a damaged
+		// record would write outside them
+		for (std::size_t i = 0; i < positions.size(); ++i)
+			if (!positions[i].valid())
+			{
+				std::cerr << path << ": position " << i << " is corrupt"
+						  << std::endl;
+				return 1;
+			}
+
+		using clock = std::chrono::steady_clock;
+		const auto start = clock::now();
+		auto seconds = [&] {
+			return std::chrono::duration<double>(clock::now() - start).count();
+		};
+
+		chess::texel_tuner tuner(positions, threads);
+		if (scale > 0)
+			tuner.set_scale(scale);
+		else
+			tuner.fit_scale();
+		std::cerr << positions.size() << " positions, scale " << tuner.scale()
+				  << ", error " << tuner.error() << std::endl;
+
+		for (int epoch = 1; epoch <= epochs; ++epoch)
+		{
+			const double error = tuner.step(rate);
+			if (epoch % 10 == 0 or epoch == epochs)
+				std::cerr << "epoch " << epoch << " error " << error << " ("
+						  << seconds() << " s)" << std::endl;
+		}
+		std::cerr << "final error " << tuner.error() << " after " << seconds()
+				  << " s on " << threads << " threads" << std::endl;
+
+		print_tables(tuner.weights());
+	}
+	catch (std::runtime_error &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,178 @@
+#include "tuner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace chess {
+
+void extract_features(const packed_position &p, feature_list &features)
+{
+	alignas(16) uint8_t nibbles[32];
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i bytes =
+		_mm_loadu_si128(reinterpret_cast<const __m128i *>(p.pieces));
+	const __m128i low = _mm_and_si128(bytes, mask);
+	const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+	// interleave so that nibble i of the record ends up in byte i
+	_mm_store_si128(reinterpret_cast<__m128i *>(nibbles),
+					_mm_unpacklo_epi8(low, high));
+	_mm_store_si128(reinterpret_cast<__m128i *>(nibbles + 16),
+					_mm_unpackhi_epi8(low, high));
+#else
+	for (int i = 0; i < 16; ++i)
+	{
+		nibbles[2 * i] = p.pieces[i] & 0x0F;
+		nibbles[2 * i + 1] = p.pieces[i] >> 4;
+	}
+#endif
+
+	int n = 0;
+	for (uint64_t occupied = p.occupancy; occupied and n < 32;
+		 occupied &= occupied - 1, ++n)
+	{
+		const int pos = __builtin_ctzll(occupied);
+		const bool color = nibbles[n] >> 3;
+		const auto piece = static_cast<board::piece>(nibbles[n] & 7);
+		features.index[n] = static_cast<uint16_t>(weight_index(piece, pos, color));
+		features.sign[n] = color ? -1 : 1;
+	}
+	features.size = n;
+}
+
+namespace {
+constexpr double LN10_400 = 2.302585092994046 / 400;
+
+inline double sigmoid(double scale, double eval)
+{
+	return 1 / (1 + std::exp(-scale * eval * LN10_400));
+}
+}
+
+texel_tuner::texel_tuner(std::span<const packed_position> positions,
+						 unsigned threads)
+: positions(positions), threads(std::max(1u, threads)), k(1), m {}, v {},
+  steps(0)
+{
+	const auto &initial = chess::weights();
+	std::copy(initial.begin(), initial.end(), w.begin());
+}
+
+double texel_tuner::pass(double scale, weight_array *gradient) const
+{
+	std::vector<accumulator> partial(threads);
+	const std::size_t chunk = (positions.size() + threads - 1) / threads;
+
+	auto work = [&](unsigned t) {
+		accumulator &acc = partial[t];
+		acc.gradient.fill(0);
+		acc.error = 0;
+
+		const std::size_t first = std::min(positions.size(), t * chunk);
+		const std::size_t last = std::min(positions.size(), first + chunk);
+		feature_list f;
+		for (std::size_t i = first; i < last; ++i)
+		{
+			extract_features(positions[i], f);
+			double eval = 0;
+			for (int j = 0; j < f.size; ++j)
+				eval += f.sign[j] * w[f.index[j]];
+
+			const double result = positions[i].result * 0.5;
+			const double s = sigmoid(scale, eval);
+			const double diff = s - result;
+			acc.error += diff * diff;
+			if (gradient)
+			{
+				const double g = diff * s * (1 - s);
+				for (int j = 0; j < f.size; ++j)
+					acc.gradient[f.index[j]] += g * f.sign[j];
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; ++t)
+		pool.emplace_back(work, t);
+	work(0);
+	for (auto &t : pool)
+		t.join();
+
+	const double n = std::max<std::size_t>(positions.size(), 1);
+	double error = 0;
+	for (const auto &acc : partial)
+		error += acc.error;
+	if (gradient)
+	{
+		gradient->fill(0);
+		for (const auto &acc : partial)
+			for (int i = 0; i < WEIGHT_COUNT; ++i)
+				(*gradient)[i] += acc.gradient[i];
+		const double factor = 2 * scale * LN10_400 / n;
+		for (auto &g : *gradient)
+			g *= factor;
+	}
+	return error / n;
+}
+
+double texel_tuner::error() const
+{
+	return pass(k, nullptr);
+}
+
+double texel_tuner::fit_scale()
+{
+	// golden section search, the error is unimodal in the scale
+	constexpr double PHI = 0.6180339887498949;
+	double low = 0.05, high = 4;
+	double a = high - PHI * (high - low), b = low + PHI * (high - low);
+	double error_a = pass(a, nullptr), error_b = pass(b, nullptr);
+	while (high - low > 1e-3)
+	{
+		if (error_a < error_b)
+		{
+			high = b;
+			b = a;
+			error_b = error_a;
+			a = high - PHI * (high - low);
+			error_a = pass(a, nullptr);
+		}
+		else
+		{
+			low = a;
+			a = b;
+			error_a = error_b;
+			b = low + PHI * (high - low);
+			error_b = pass(b, nullptr);
+		}
+	}
+	k = (low + high) / 2;
+	return k;
+}
+
+double texel_tuner::step(double rate)
+{
+	constexpr double BETA1 = 0.9, BETA2 = 0.999, EPSILON = 1e-8;
+
+	weight_array gradient;
+	const double error = pass(k, &gradient);
+	++steps;
+	const double correction1 = 1 - std::pow(BETA1, steps);
+	const double correction2 = 1 - std::pow(BETA2, steps);
+	for (int i = 0; i < WEIGHT_COUNT; ++i)
+	{
+		m[i] = BETA1 * m[i] + (1 - BETA1) * gradient[i];
+		v[i] = BETA2 * v[i] + (1 - BETA2) * gradient[i] * gradient[i];
+		w[i] -= rate * (m[i] / correction1) /
+				(std::sqrt(v[i] / correction2) + EPSILON);
+	}
+	return error;
+}
+
+}
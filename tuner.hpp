@@ -0,0 +1,95 @@
+#pragma once
+
+#include "eval.hpp"
+#include "packed.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace chess {
+
+/**
+ * @brief The evaluation features of a position: the weight index of every
+ * piece, and +1 for white pieces or -1 for black ones.
+ */
+struct feature_list
+{
+	int size = 0;
+	std::array<uint16_t, 32> index;
+	std::array<int8_t, 32> sign;
+};
+
+/**
+ * @brief Extract the features of a packed position. The piece nibbles are
+ * unpacked 16 bytes at a time with SSE2 where it is available.
+ */
+void extract_features(const packed_position &p, feature_list &features);
+
+/**
+ * @brief Fits the evaluation weights to game results with Texel's method:
+ * minimise the mean squared difference between the result and the expected
+ * score sigmoid(k * eval), by gradient descent with Adam.
+ *
+ * Every pass over the positions is split across threads, each summing into
+ * its own accumulator, which are added together at the end of the pass.
+ */
+class texel_tuner
+{
+public:
+	using weight_array = std::array<double, WEIGHT_COUNT>;
+
+	/**
+	 * @param positions The training set. Must outlive the tuner.
+	 * @param threads The number of threads to use
+	 */
+	texel_tuner(std::span<const packed_position> positions, unsigned threads);
+
+	/**
+	 * @brief The mean squared error over the training set with the current
+	 * weights and scale.
+	 */
+	double error() const;
+
+	/**
+	 * @brief Find the scale that minimises the error with the current weights,
+	 * so that tuning does not shift all the weights to match the scale.
+	 * @return The scale
+	 */
+	double fit_scale();
+
+	inline double scale() const { return k; }
+	inline void set_scale(double scale) { k = scale; }
+
+	/**
+	 * @brief Run one pass over the training set and move the weights against
+	 * the gradient.
+	 * @param rate The largest step of a weight in centipawns
+	 * @return The error before the step
+	 */
+	double step(double rate);
+
+	inline const weight_array &weights() const { return w; }
+
+private:
+	struct alignas(64) accumulator
+	{
+		weight_array gradient;
+		double error;
+	};
+
+	std::span<const packed_position> positions;
+	unsigned threads;
+	double k;
+	weight_array w;
+	weight_array m, v;	// Adam moments
+	int steps;
+
+	/**
+	 * @brief Sum the error, and the gradient if requested, over all positions.
+	 */
+	double pass(double scale, weight_array *gradient) const;
+};
+
+}
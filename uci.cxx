@@ -0,0 +1,243 @@
+#include "board.hpp"
+#include "search.hpp"
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace {
+
+std::mutex output_mutex;
+
+/**
+ * @brief Write a line to the GUI. The search thread and the input thread both
+ * write, so every line goes out whole.
+ */
+void send(const std::string &line)
+{
+	std::lock_guard lock(output_mutex);
+	std::cout << line << std::endl;
+}
+
+/**
+ * @brief Format a move in UCI long algebraic notation, i.e. "e2e4" or
+ * "e7e8q". Promotions played by the search are always to a queen.
+ */
+std::string to_uci(const chess::board &b, chess::board::move_t m)
+{
+	if (m == chess::searcher::NO_MOVE)
+		return "0000";
+	char str[chess::board::MOVE_CHARS];
+	char *end = chess::board::format_move(m,
+		b.is_promotion(m.first, m.second) ? chess::board::QUEEN_PROMOTION : 0,
+		str);
+	return std::string(str, end);
+}
+
+/**
+ * @brief Play a move given in UCI long algebraic notation.
+ * @return move_status::ok if the move was played, or why it was not
+ */
+chess::board::move_status play_uci(chess::board &b, std::string_view str)
+{
+	chess::board::move_t m;
+	int promotion;
+	const auto status = chess::board::parse_coordinates(str, m, promotion);
+	return status == chess::board::move_status::ok ?
+		b.play(m, promotion) : status;
+}
+
+/**
+ * @brief Handle "position [startpos | fen <fen>] [moves <move>...]".
+ */
+void set_position(chess::board &b, std::istringstream &ss)
+{
+	std::string token, fen;
+	ss >> token;
+	if (token == "startpos")
+	{
+		b = chess::board();
+		ss >> token;
+	}
+	else if (token == "fen")
+	{
+		while (ss >> token and token != "moves")
+			fen += token + ' ';
+		try
+		{
+			b = chess::board(fen);
+		}
+		catch (std::invalid_argument &e)
+		{
+			send(std::string("info string ") + e.what());
+			return;
+		}
+	}
+	else
+		return;
+
+	if (token != "moves")
+		return;
+	while (ss >> token)
+	{
+		const auto status = play_uci(b, token);
+		if (status != chess::board::move_status::ok)
+		{
+			send(std::string("info string ") +
+				 chess::board::describe(status) + ' ' + token);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Parse the arguments of "go" into search limits.
+ */
+chess::search_limits parse_go(std::istringstream &ss)
+{
+	chess::search_limits limits;
+	std::string token;
+	while (ss >> token)
+	{
+		if (token == "depth")
+			ss >> limits.depth;
+		else if (token == "nodes")
+			ss >> limits.nodes;
+		else if (token == "movetime")
+			ss >> limits.movetime;
+		else if (token == "wtime")
+			ss >> limits.time[0];
+		else if (token == "btime")
+			ss >> limits.time[1];
+		else if (token == "winc")
+			ss >> limits.inc[0];
+		else if (token == "binc")
+			ss >> limits.inc[1];
+		else if (token == "movestogo")
+			ss >> limits.movestogo;
+		else if (token == "infinite")
+			limits.infinite = true;
+		else if (token == "ponder")
+			limits.ponder = true;
+	}
+	return limits;
+}
+
+std::string format_info(const chess::board &root, const chess::search_info &info)
+{
+	std::ostringstream ss;
+	ss << "info depth " << info.depth << " score ";
+	const int mate_distance = chess::searcher::MATE - std::abs(info.score);
+	if (mate_distance < chess::searcher::MAX_PLY)
+		ss << "mate " << (info.score > 0 ? 1 : -1) * (mate_distance + 1) / 2;
+	else
+		ss << "cp " << info.score;
+	ss << " nodes " << info.nodes << " time " << info.elapsed;
+	if (info.elapsed)
+		ss << " nps " << info.nodes * 1000 / info.elapsed;
+	ss << " pv";
+
+	chess::board b = root;
+	for (auto m : info.pv)
+	{
+		ss << ' ' << to_uci(b, m);
+		b.move(m.first, m.second);
+		if (b.promotion_pending())
+			b.move(m.second, chess::board::QUEEN_PROMOTION);
+	}
+	return ss.str();
+}
+
+}
+
+int main()
+{
+	chess::transposition_table tt(16);
+	chess::searcher search(tt);
+	chess::board board;
+
+	// the input thread only parses commands; searching happens on the search
+	// threads so "stop" and "ponderhit" are handled while a search runs
+	std::string line;
+	while (std::getline(std::cin, line))
+	{
+		std::istringstream ss(line);
+		std::string cmd;
+		ss >> cmd;
+
+		if (cmd == "uci")
+		{
+			send("id name chess");
+			send("id author jonah-chen");
+			send("option name Hash type spin default 16 min 1 max 65536");
+			send("option name Threads type spin default 1 min 1 max 256");
+			send("option name Ponder type check default false");
+			send("uciok");
+		}
+		else if (cmd == "isready")
+			send("readyok");
+		else if (cmd == "ucinewgame")
+		{
+			search.stop();
+			search.wait();
+			tt.clear();
+		}
+		else if (cmd == "setoption")
+		{
+			std::string token, name, value;
+			ss >> token >> name >> token >> value;
+			search.stop();
+			search.wait();
+			try
+			{
+				if (name == "Hash")
+					tt.resize(std::stoul(value));
+				else if (name == "Threads")
+					search.set_threads(std::stoi(value));
+			}
+			catch (std::exception &e)
+			{
+				send("info string invalid value " + value + " for " + name);
+			}
+		}
+		else if (cmd == "position")
+		{
+			search.stop();
+			search.wait();
+			set_position(board, ss);
+		}
+		else if (cmd == "go")
+		{
+			const chess::board root = board;
+			search.start(root, parse_go(ss),
+				[root](const chess::search_info &info) {
+					send(format_info(root, info));
+				},
+				[root](chess::board::move_t best, chess::board::move_t ponder) {
+					std::string msg = "bestmove " + to_uci(root, best);
+					if (ponder != chess::searcher::NO_MOVE)
+					{
+						chess::board next = root;
+						next.move(best.first, best.second);
+						if (next.promotion_pending())
+							next.move(best.second, chess::board::QUEEN_PROMOTION);
+						msg += " ponder " + to_uci(next, ponder);
+					}
+					send(msg);
+				});
+		}
+		else if (cmd == "stop")
+			search.stop();
+		else if (cmd == "ponderhit")
+			search.ponderhit();
+		else if (cmd == "d")
+			send(board.fen());
+		else if (cmd == "quit")
+			break;
+	}
+
+	search.stop();
+	search.wait();
+	return 0;
+}